@@ -0,0 +1,341 @@
+/*
+ * Description:
+ * Resolver.cpp implements the cached, racing connectToHost() declared in
+ * Resolver.h.
+ *
+ * It is intended to be part of a series on network programming.
+ */
+#include "Resolver.h"
+#include <sys/socket.h>
+#include <iostream>
+#include <vector>
+#include <map>
+#include <cstring>
+#include <cerrno>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+
+struct Address
+{
+    sockaddr_storage addr;
+    socklen_t length;
+    int family;
+};
+
+struct CacheEntry
+{
+    std::vector<Address> addresses;
+    int error;
+    long long expires;
+};
+
+struct Attempt
+{
+    int sd;
+    std::size_t index;
+};
+
+//forward declarations
+static long long nowMs();
+static int resolve(const std::string& host, const std::string& port,
+                   std::vector<Address>& addresses);
+static void interleave(std::vector<Address>& addresses);
+static void prefer(const std::string& key, const Address& address);
+static int race(const std::vector<Address>& addresses, int timeoutMs,
+                std::size_t& winner);
+
+static std::map<std::string, CacheEntry> cache;
+static pthread_mutex_t cacheMutex = PTHREAD_MUTEX_INITIALIZER;
+static int ttlSeconds = DEFAULT_RESOLVER_TTL_SEC;
+
+int connectToHost(const std::string& host, const std::string& port, int timeoutMs)
+{
+    std::vector<Address> addresses;
+    int result = resolve(host, port, addresses);
+    if (result != 0)
+    {
+        std::cerr << "getaddrinfo: " << gai_strerror(result) << std::endl;
+        return -1;
+    }
+
+    std::size_t winner;
+    int sd = race(addresses, timeoutMs, winner);
+    if (sd < 0)
+    {
+        perror("socket error");
+        return -1;
+    }
+
+    //the next connection to this host starts with the address that worked
+    if (winner != 0)
+        prefer(host + "/" + port, addresses[winner]);
+
+    return sd;
+}
+
+void setResolverTtl(int seconds)
+{
+    pthread_mutex_lock(&cacheMutex);
+    ttlSeconds = seconds;
+    cache.clear();
+    pthread_mutex_unlock(&cacheMutex);
+}
+
+void clearResolverCache()
+{
+    pthread_mutex_lock(&cacheMutex);
+    cache.clear();
+    pthread_mutex_unlock(&cacheMutex);
+}
+
+static long long nowMs()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec*1000LL + now.tv_nsec/1000000;
+}
+
+/**
+ * Look up host and port, going to getaddrinfo() only if there is no cached
+ * answer that is still fresh. Failed lookups are cached for a shorter time so
+ * a typo doesn't hammer the DNS server but a fixed record is picked up soon.
+ *
+ * Returns 0 on success or a getaddrinfo() error code.
+ */
+static int resolve(const std::string& host, const std::string& port,
+                   std::vector<Address>& addresses)
+{
+    std::string key = host + "/" + port;
+
+    pthread_mutex_lock(&cacheMutex);
+    std::map<std::string, CacheEntry>::iterator it = cache.find(key);
+    if (it != cache.end() && nowMs() < it->second.expires)
+    {
+        addresses = it->second.addresses;
+        int error = it->second.error;
+        pthread_mutex_unlock(&cacheMutex);
+        return error;
+    }
+    int ttl = ttlSeconds;
+    pthread_mutex_unlock(&cacheMutex);
+
+    addrinfo* serverAddress;
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_ADDRCONFIG;
+
+    CacheEntry entry;
+    entry.error = getaddrinfo(host.c_str(), port.c_str(), &hints, &serverAddress);
+    if (entry.error == 0)
+    {
+        for (addrinfo* addr = serverAddress; addr != NULL; addr = addr->ai_next)
+        {
+            Address address;
+            std::memcpy(&address.addr, addr->ai_addr, addr->ai_addrlen);
+            address.length = addr->ai_addrlen;
+            address.family = addr->ai_family;
+            entry.addresses.push_back(address);
+        }
+        freeaddrinfo(serverAddress);
+
+        interleave(entry.addresses);
+    }
+
+    addresses = entry.addresses;
+
+    if (ttl > 0)
+    {
+        entry.expires = nowMs() + 1000LL*(entry.error == 0 ? ttl : NEGATIVE_RESOLVER_TTL_SEC);
+
+        pthread_mutex_lock(&cacheMutex);
+        cache[key] = entry;
+        pthread_mutex_unlock(&cacheMutex);
+    }
+
+    return entry.error;
+}
+
+/**
+ * Reorder the addresses so that families alternate, starting with whichever
+ * family getaddrinfo() preferred.
+ */
+static void interleave(std::vector<Address>& addresses)
+{
+    if (addresses.empty())
+        return;
+
+    int firstFamily = addresses[0].family;
+    std::vector<Address> first, second;
+    for (std::size_t i = 0; i < addresses.size(); i++)
+    {
+        if (addresses[i].family == firstFamily)
+            first.push_back(addresses[i]);
+        else
+            second.push_back(addresses[i]);
+    }
+
+    addresses.clear();
+    for (std::size_t i = 0; i < first.size() || i < second.size(); i++)
+    {
+        if (i < first.size())
+            addresses.push_back(first[i]);
+        if (i < second.size())
+            addresses.push_back(second[i]);
+    }
+}
+
+static void prefer(const std::string& key, const Address& address)
+{
+    pthread_mutex_lock(&cacheMutex);
+    std::map<std::string, CacheEntry>::iterator it = cache.find(key);
+    if (it != cache.end())
+    {
+        std::vector<Address>& cached = it->second.addresses;
+        for (std::size_t i = 0; i < cached.size(); i++)
+        {
+            if (cached[i].length == address.length &&
+                std::memcmp(&cached[i].addr, &address.addr, address.length) == 0)
+            {
+                Address winner = cached[i];
+                cached.erase(cached.begin() + i);
+                cached.insert(cached.begin(), winner);
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&cacheMutex);
+}
+
+/**
+ * Race non-blocking connects to the addresses, starting a new attempt every
+ * CONNECT_ATTEMPT_DELAY_MS or as soon as an earlier attempt fails.
+ *
+ * Returns the connected socket (switched back to blocking mode) and sets
+ * winner to the index of its address, or returns -1 with errno set.
+ */
+static int race(const std::vector<Address>& addresses, int timeoutMs,
+                std::size_t& winner)
+{
+    std::vector<Attempt> attempts;
+    std::vector<pollfd> fds;
+    std::size_t next = 0;
+    int lastError = ECONNREFUSED;
+    int sd = -1;
+
+    long long deadline = nowMs() + timeoutMs;
+    long long nextStart = 0;
+
+    while (sd < 0)
+    {
+        long long now = nowMs();
+        if (now >= deadline)
+        {
+            lastError = ETIMEDOUT;
+            break;
+        }
+
+        //start the next attempt if it's time or nothing else is running
+        if (next < addresses.size() && (now >= nextStart || attempts.empty()))
+        {
+            const Address& address = addresses[next];
+            int newSd = socket(address.family, SOCK_STREAM | SOCK_NONBLOCK, 0);
+            if (newSd < 0)
+            {
+                lastError = errno;
+                next++;
+                continue;
+            }
+
+            if (connect(newSd, (const sockaddr*)&address.addr, address.length) == 0)
+            {
+                sd = newSd;
+                winner = next;
+                break;
+            }
+
+            if (errno != EINPROGRESS)
+            {
+                lastError = errno;
+                close(newSd);
+                next++;
+                continue;
+            }
+
+            Attempt attempt = {newSd, next};
+            attempts.push_back(attempt);
+            next++;
+            nextStart = now + CONNECT_ATTEMPT_DELAY_MS;
+            continue;
+        }
+
+        if (attempts.empty())
+            break;
+
+        long long wait = deadline - now;
+        if (next < addresses.size() && nextStart - now < wait)
+            wait = nextStart - now;
+
+        fds.resize(attempts.size());
+        for (std::size_t i = 0; i < attempts.size(); i++)
+        {
+            fds[i].fd = attempts[i].sd;
+            fds[i].events = POLLOUT;
+            fds[i].revents = 0;
+        }
+
+        if (poll(&fds[0], fds.size(), (int)wait) < 0 && errno != EINTR)
+        {
+            lastError = errno;
+            break;
+        }
+
+        for (std::size_t i = fds.size(); i-- > 0;)
+        {
+            if (fds[i].revents == 0)
+                continue;
+
+            int error = 0;
+            socklen_t length = sizeof(error);
+            getsockopt(attempts[i].sd, SOL_SOCKET, SO_ERROR, &error, &length);
+
+            if (error == 0 && sd < 0)
+            {
+                sd = attempts[i].sd;
+                winner = attempts[i].index;
+            }
+            else
+            {
+                if (error != 0)
+                    lastError = error;
+                close(attempts[i].sd);
+
+                //a failure lets the next address go right away
+                nextStart = now;
+            }
+
+            attempts.erase(attempts.begin() + i);
+        }
+    }
+
+    for (std::size_t i = 0; i < attempts.size(); i++)
+        close(attempts[i].sd);
+
+    if (sd < 0)
+    {
+        errno = lastError;
+        return -1;
+    }
+
+    //callers expect an ordinary blocking socket
+    int flags = fcntl(sd, F_GETFL, 0);
+    fcntl(sd, F_SETFL, flags & ~O_NONBLOCK);
+
+    return sd;
+}
@@ -0,0 +1,51 @@
+/*
+ * Description:
+ * Resolver.h declares connectToHost(), which is shared by the programs in the
+ * series that open TCP connections.
+ *
+ * Name lookups are cached in-process for a fixed TTL, so a program that makes
+ * many connections to the same host only pays for getaddrinfo() once. The
+ * addresses that come back are raced Happy Eyeballs style (RFC 8305): IPv6
+ * and IPv4 addresses are interleaved and a new non-blocking connect is started
+ * every CONNECT_ATTEMPT_DELAY_MS (or as soon as one fails) until one of them
+ * succeeds, so an address that doesn't answer costs a fraction of a second
+ * instead of a full TCP connect timeout.
+ *
+ * It is intended to be part of a series on network programming.
+ */
+#ifndef _RESOLVER_H_
+#define _RESOLVER_H_
+
+#include <string>
+
+enum
+{
+    CONNECT_ATTEMPT_DELAY_MS = 250,
+    DEFAULT_CONNECT_TIMEOUT_MS = 10000,
+    DEFAULT_RESOLVER_TTL_SEC = 60,
+    NEGATIVE_RESOLVER_TTL_SEC = 5
+};
+
+/**
+ * Attempts to create connection to a given host using the specified port.
+ * Gives up once timeoutMs has passed without any address accepting.
+ *
+ * Any encountered errors will be printed to stderr.
+ *
+ * Returns a (blocking) socket descriptor if successful, or -1 on failure.
+ */
+int connectToHost(const std::string& host, const std::string& port,
+                  int timeoutMs = DEFAULT_CONNECT_TIMEOUT_MS);
+
+/**
+ * Change how long successful lookups are cached. A TTL of 0 turns the cache
+ * off.
+ */
+void setResolverTtl(int seconds);
+
+/**
+ * Forget every cached lookup.
+ */
+void clearResolverCache();
+
+#endif
@@ -0,0 +1,75 @@
+/*
+ * Description:
+ * TcpInfo.cpp implements the TCP_INFO snapshot declared in TcpInfo.h.
+ *
+ * It is intended to be part of a series on network programming.
+ */
+#include "TcpInfo.h"
+#include <cstring>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/tcp.h>
+
+bool sampleTcpInfo(int sd, TcpSample& sample)
+{
+    //the kernel fills in as much of the struct as it knows about
+    tcp_info info;
+    std::memset(&info, 0, sizeof(info));
+    socklen_t length = sizeof(info);
+    std::memset(&sample, 0, sizeof(sample));
+
+    if (sd < 0 || getsockopt(sd, IPPROTO_TCP, TCP_INFO, &info, &length) < 0)
+        return false;
+
+    sample.rttUs = info.tcpi_rtt;
+    sample.rttvarUs = info.tcpi_rttvar;
+    sample.minRttUs = info.tcpi_min_rtt;
+    sample.rcvRttUs = info.tcpi_rcv_rtt;
+    sample.rcvSpace = info.tcpi_rcv_space;
+    sample.cwnd = info.tcpi_snd_cwnd;
+    sample.mss = info.tcpi_snd_mss;
+    sample.retransmits = info.tcpi_total_retrans;
+    sample.deliveryRate = info.tcpi_delivery_rate;
+    sample.appLimited = info.tcpi_delivery_rate_app_limited;
+    sample.busyUs = info.tcpi_busy_time;
+    sample.rwndLimitedUs = info.tcpi_rwnd_limited;
+    sample.sndbufLimitedUs = info.tcpi_sndbuf_limited;
+    sample.bytesAcked = info.tcpi_bytes_acked;
+    sample.bytesReceived = info.tcpi_bytes_received;
+    return true;
+}
+
+TcpLimit tcpLimit(const TcpSample& sample)
+{
+    if (sample.busyUs == 0)
+        return TCP_NOT_SENDING;
+    if (sample.rwndLimitedUs * 2 >= sample.busyUs)
+        return TCP_RECEIVER_LIMITED;
+    if (sample.sndbufLimitedUs * 2 >= sample.busyUs)
+        return TCP_SNDBUF_LIMITED;
+    if (sample.appLimited)
+        return TCP_APPLICATION_LIMITED;
+    return TCP_NETWORK_LIMITED;
+}
+
+const char* tcpLimitName(TcpLimit limit)
+{
+    static const char* names[TCP_LIMITS] =
+    {
+        "not sending", "network", "receiver", "sndbuf", "application"
+    };
+    return names[limit];
+}
+
+void printTcpSample(std::ostream& out, const TcpSample& sample)
+{
+    out << "rtt = " << sample.rttUs << "us, rttvar = " << sample.rttvarUs << "us";
+    out << ", min rtt = " << sample.minRttUs << "us, rcv rtt = " << sample.rcvRttUs << "us";
+    out << ", cwnd = " << sample.cwnd << ", retransmits = " << sample.retransmits;
+    out << ", delivery rate = " << sample.deliveryRate * 8 / 1e6 << "Mbps";
+    out << ", rcv space = " << sample.rcvSpace;
+    out << ", busy = " << sample.busyUs / 1000 << "ms";
+    out << ", rwnd limited = " << sample.rwndLimitedUs / 1000 << "ms";
+    out << ", sndbuf limited = " << sample.sndbufLimitedUs / 1000 << "ms";
+    out << ", limit = " << tcpLimitName(tcpLimit(sample));
+}
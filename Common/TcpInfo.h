@@ -0,0 +1,74 @@
+/*
+ * Description:
+ * TcpInfo.h declares a snapshot of what the kernel knows about a TCP
+ * connection (getsockopt(TCP_INFO)): its round-trip time, congestion window,
+ * retransmissions and delivery rate, and for how long sending was held back by
+ * the receiver's window or by the send buffer. User-space timing says a run
+ * was slow; this says whether the network, the receiver or the application
+ * was the reason.
+ *
+ * The busy and limited times only count while the connection has data to
+ * send, so they describe the sending side. On a connection that only
+ * receives they stay at 0, and the receive side's own estimates (rcv rtt,
+ * rcv space) are the ones to look at.
+ *
+ * It is intended to be part of a series on network programming.
+ */
+#ifndef _TCPINFO_H_
+#define _TCPINFO_H_
+
+#include <cstdint>
+#include <ostream>
+
+enum TcpLimit
+{
+    TCP_NOT_SENDING,
+    TCP_NETWORK_LIMITED,        //the congestion window, i.e. the path
+    TCP_RECEIVER_LIMITED,       //the peer's advertised window
+    TCP_SNDBUF_LIMITED,         //our send buffer was too small
+    TCP_APPLICATION_LIMITED,    //the application didn't give it enough data
+    TCP_LIMITS
+};
+
+struct TcpSample
+{
+    uint32_t rttUs;             //smoothed round-trip time
+    uint32_t rttvarUs;
+    uint32_t minRttUs;
+    uint32_t rcvRttUs;          //the receiver's own estimate
+    uint32_t rcvSpace;          //receive buffer space the kernel tuned for
+    uint32_t cwnd;              //congestion window, in segments
+    uint32_t mss;
+    uint32_t retransmits;       //segments retransmitted over the connection
+    uint64_t deliveryRate;      //bytes per second, for the most recent sample
+    bool appLimited;            //whether that sample was limited by the application
+    uint64_t busyUs;            //time with data in flight or waiting to go
+    uint64_t rwndLimitedUs;
+    uint64_t sndbufLimitedUs;
+    uint64_t bytesAcked;
+    uint64_t bytesReceived;
+};
+
+/**
+ * Reads TCP_INFO for a socket. Fields an older kernel doesn't report are 0.
+ *
+ * Returns false if sd isn't a TCP socket.
+ */
+bool sampleTcpInfo(int sd, TcpSample& sample);
+
+/**
+ * What held the sender back most over the connection so far: the receiver
+ * or the send buffer if either accounts for half of the busy time, then the
+ * application if the latest delivery rate sample says so, else the network.
+ */
+TcpLimit tcpLimit(const TcpSample& sample);
+
+const char* tcpLimitName(TcpLimit limit);
+
+/**
+ * Prints the sample as "rtt = 45us, rttvar = 10us, ..., limit = network",
+ * without a newline, so the caller can put a label in front.
+ */
+void printTcpSample(std::ostream& out, const TcpSample& sample);
+
+#endif
@@ -0,0 +1,657 @@
+/*
+ * Description:
+ * Crawler.cpp implements the retriever's crawl mode declared in Crawler.h.
+ *
+ * It is intended to be part of a series on network programming.
+ */
+#include "Crawler.h"
+#include "HttpClient.h"
+#include "LinkScanner.h"
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/stat.h>
+
+//forward declarations
+static std::string toLower(const std::string& str);
+static bool startsWithIgnoreCase(const std::string& str, const char* prefix);
+static bool before(const timespec& a, const timespec& b);
+static std::string escapeQuery(const std::string& query);
+static bool isDirectory(const std::string& path);
+static bool isUnder(const std::string& path, const std::string& dir);
+
+CrawlOptions::CrawlOptions()
+{
+    concurrency = 8;
+    perHost = 8;
+    delayMs = 0;
+    maxPages = 100000;
+    sameHost = true;
+    outputDir = "mirror";
+}
+
+Crawler::Crawler(const CrawlOptions& options) : options(options)
+{
+    queued = 0;
+    active = 0;
+    fetched = 0;
+    failed = 0;
+    totalBytes = 0;
+
+    //timed waits are for politeness delays, so they should not be affected
+    //by the wall clock being changed
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&changed, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&mutex, nullptr);
+    pthread_mutex_init(&files, nullptr);
+}
+
+Crawler::~Crawler()
+{
+    pthread_cond_destroy(&changed);
+    pthread_mutex_destroy(&mutex);
+    pthread_mutex_destroy(&files);
+}
+
+bool Crawler::run(const std::string& startUrl)
+{
+    Url start;
+    if (!parseAbsolute(startUrl, start))
+    {
+        std::cerr << "Error: could not understand the URL " << startUrl << std::endl;
+        return false;
+    }
+
+    startHost = start.hostKey();
+    enqueue(start);
+
+    timespec begin, end;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+
+    std::vector<pthread_t> threads(options.concurrency);
+    for (int i = 0; i < options.concurrency; i++)
+        pthread_create(&threads[i], nullptr, worker, this);
+
+    for (int i = 0; i < options.concurrency; i++)
+        pthread_join(threads[i], nullptr);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec)/1e9;
+
+    std::cout << "Crawled " << fetched << " pages (" << failed << " failed), "
+              << totalBytes << " bytes in " << seconds << " sec";
+    if (seconds > 0)
+        std::cout << " (" << (long)(fetched/seconds) << " pages/sec)";
+    std::cout << std::endl;
+
+    return true;
+}
+
+void* Crawler::worker(void* args)
+{
+    ((Crawler*)args)->work();
+    return nullptr;
+}
+
+/**
+ * Each worker keeps its own connection open for as long as it keeps getting
+ * pages from the same host and the server allows it.
+ */
+void Crawler::work()
+{
+    int sd = -1;
+    std::string connectedTo;
+    std::vector<Url> found;
+    Url url;
+
+    while (take(url))
+    {
+        long long bytes = 0;
+        found.clear();
+
+        bool ok = fetch(sd, connectedTo, url, found, bytes);
+        release(url, found, ok, bytes);
+    }
+
+    if (sd >= 0)
+        close(sd);
+}
+
+/**
+ * Wait for a page that can be fetched without breaking the per host limits.
+ *
+ * Returns false once there is nothing left to fetch and no other worker can
+ * find anything new.
+ */
+bool Crawler::take(Url& url)
+{
+    pthread_mutex_lock(&mutex);
+
+    while (true)
+    {
+        timespec now, earliest;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        bool anyPending = false;
+        bool haveEarliest = false;
+
+        for (std::map<std::string, Host>::iterator it = hosts.begin(); it != hosts.end(); ++it)
+        {
+            Host& host = it->second;
+            if (host.pending.empty())
+                continue;
+
+            anyPending = true;
+            if (host.active >= options.perHost)
+                continue;
+
+            if (before(now, host.nextAllowed))
+            {
+                if (!haveEarliest || before(host.nextAllowed, earliest))
+                    earliest = host.nextAllowed;
+                haveEarliest = true;
+                continue;
+            }
+
+            std::size_t colon = it->first.rfind(':');
+            url.host = it->first.substr(0, colon);
+            url.port = it->first.substr(colon+1);
+            url.path = host.pending.front();
+            host.pending.pop_front();
+
+            host.active++;
+            active++;
+
+            host.nextAllowed = now;
+            host.nextAllowed.tv_sec += options.delayMs / 1000;
+            host.nextAllowed.tv_nsec += (options.delayMs % 1000) * 1000000L;
+            if (host.nextAllowed.tv_nsec >= 1000000000L)
+            {
+                host.nextAllowed.tv_sec++;
+                host.nextAllowed.tv_nsec -= 1000000000L;
+            }
+
+            pthread_mutex_unlock(&mutex);
+            return true;
+        }
+
+        if (!anyPending && active == 0)
+        {
+            pthread_cond_broadcast(&changed);
+            pthread_mutex_unlock(&mutex);
+            return false;
+        }
+
+        if (haveEarliest)
+            pthread_cond_timedwait(&changed, &mutex, &earliest);
+        else
+            pthread_cond_wait(&changed, &mutex);
+    }
+}
+
+/**
+ * Record the result of a fetch and queue the links that were found in it.
+ */
+void Crawler::release(const Url& url, const std::vector<Url>& found, bool ok,
+                      long long bytes)
+{
+    pthread_mutex_lock(&mutex);
+
+    for (std::size_t i = 0; i < found.size(); i++)
+    {
+        if (options.sameHost && found[i].hostKey() != startHost)
+            continue;
+        enqueue(found[i]);
+    }
+
+    hosts[url.hostKey()].active--;
+    active--;
+
+    if (ok)
+        fetched++;
+    else
+        failed++;
+    totalBytes += bytes;
+
+    pthread_cond_broadcast(&changed);
+    pthread_mutex_unlock(&mutex);
+}
+
+/**
+ * Queue url unless it has been seen before or the page limit was reached.
+ * The caller must hold the mutex (or be the only thread running).
+ */
+bool Crawler::enqueue(const Url& url)
+{
+    if (queued >= options.maxPages)
+        return false;
+
+    if (!seen.insert(url.key()))
+        return false;
+
+    hosts[url.hostKey()].pending.push_back(url.path);
+    queued++;
+    return true;
+}
+
+/**
+ * Fetch a single page, reusing the worker's connection when it is still open
+ * to the same host.
+ *
+ * Returns true if a complete response was received.
+ */
+bool Crawler::fetch(int& sd, std::string& connectedTo, const Url& url,
+                    std::vector<Url>& found, long long& bytes)
+{
+    std::string hostKey = url.hostKey();
+    bool reused = (sd >= 0 && connectedTo == hostKey);
+
+    if (!reused)
+    {
+        if (sd >= 0)
+            close(sd);
+
+        sd = connectToHost(url.host, url.port);
+        connectedTo = hostKey;
+        if (sd < 0)
+            return false;
+    }
+
+    bool keepAlive = false;
+    bool gotNothing = false;
+    bool ok = fetchOnce(sd, url, found, bytes, keepAlive, gotNothing);
+
+    //a server is allowed to close an idle keep-alive connection at any time,
+    //so one failure on a reused connection gets a second try on a new one
+    if (!ok && reused && gotNothing)
+    {
+        close(sd);
+        sd = connectToHost(url.host, url.port);
+        if (sd < 0)
+            return false;
+
+        ok = fetchOnce(sd, url, found, bytes, keepAlive, gotNothing);
+    }
+
+    if (!keepAlive)
+    {
+        close(sd);
+        sd = -1;
+    }
+
+    return ok;
+}
+
+bool Crawler::fetchOnce(int sd, const Url& url, std::vector<Url>& found,
+                        long long& bytes, bool& keepAlive, bool& gotNothing)
+{
+    keepAlive = false;
+    gotNothing = false;
+
+    std::string request = "GET " + url.path + " HTTP/1.1\r\n";
+    request += "Host: " + url.host + (url.port == "80" ? "" : ":" + url.port) + "\r\n";
+    request += "Connection: keep-alive\r\n";
+    request += "\r\n";
+
+    if (!sendRequest(sd, request))
+    {
+        gotNothing = true;
+        return false;
+    }
+
+    ResponseParser parser;
+    LinkScanner scanner;
+    std::string path;
+    FILE* out = nullptr;
+    bool html = false;
+
+    LinkScanner::LinkHandler onLink = [&](const std::string& link)
+    {
+        Url next;
+        if (resolve(url, link, next))
+            found.push_back(next);
+    };
+
+    //pages are written out and scanned as they arrive, so nothing bigger than
+    //one read buffer is ever held in memory
+    long long result = readResponse(sd, parser,
+        [&](const char* data, std::size_t length)
+        {
+            if (out != nullptr)
+                fwrite(data, 1, length, out);
+            if (html)
+                scanner.scan(data, length, onLink);
+        },
+        [&]()
+        {
+            const std::string* location = parser.header("Location");
+            if (parser.statusCode() >= 300 && parser.statusCode() < 400 && location != nullptr)
+                onLink(*location);
+
+            if (parser.statusCode() != 200)
+                return;
+
+            const std::string* type = parser.header("Content-Type");
+            html = (type != nullptr && toLower(*type).find("text/html") != std::string::npos);
+
+            path = outputPath(url);
+            if (path.empty())
+                std::cerr << "Error: not mirroring " << url.key() << std::endl;
+            else
+                out = openOutput(path);
+        });
+
+    bool ok = (result > 0 && parser.isDone());
+    gotNothing = (result == 0);
+    keepAlive = ok && parser.keepAlive();
+    bytes += (result > 0) ? result : 0;
+
+    if (out != nullptr)
+    {
+        fclose(out);
+        if (!ok)
+            unlink(path.c_str());
+    }
+
+    return ok;
+}
+
+/**
+ * Pages are mirrored to outputDir/host_port/path, with index.html standing in
+ * for directory URLs. A query is kept as part of the file name, escaped so
+ * that it can't add directories to the path.
+ *
+ * Returns an empty string for a URL that would be written outside the mirror.
+ */
+std::string Crawler::outputPath(const Url& url) const
+{
+    std::size_t query = url.path.find('?');
+    std::string path = url.path.substr(0, query);
+
+    //the parsers have already removed dot segments, but anything they missed
+    //would climb out of the mirror, so it is checked again here
+    for (std::size_t start = 1; start <= path.length(); )
+    {
+        std::size_t end = path.find('/', start);
+        if (end == std::string::npos)
+            end = path.length();
+
+        std::string segment = path.substr(start, end-start);
+        if (segment == "." || segment == "..")
+            return "";
+
+        start = end + 1;
+    }
+
+    if (path[path.length()-1] == '/')
+        path += "index.html";
+    if (query != std::string::npos)
+        path += escapeQuery(url.path.substr(query));
+
+    return options.outputDir + "/" + url.host + "_" + url.port + path;
+}
+
+/**
+ * Create the directories above path and open it for writing.
+ *
+ * The same name can be needed as a file and as a directory, as with /a and
+ * /a/b. Whichever comes second wins the name as a directory, and the page
+ * becomes its index.html, so path is updated to where it was really opened.
+ * The final path is also checked to be under outputDir, so that a symbolic
+ * link in the mirror can't redirect a page elsewhere.
+ */
+FILE* Crawler::openOutput(std::string& path)
+{
+    pthread_mutex_lock(&files);
+
+    for (std::size_t pos = path.find('/', 1); pos != std::string::npos;
+         pos = path.find('/', pos+1))
+    {
+        std::string dir = path.substr(0, pos);
+        if (mkdir(dir.c_str(), 0755) == 0 || isDirectory(dir) || pos <= options.outputDir.length())
+            continue;
+
+        //host directories always contain a '_', so this can't clash with one
+        std::string moving = options.outputDir + "/.moving";
+        if (rename(dir.c_str(), moving.c_str()) < 0 || mkdir(dir.c_str(), 0755) < 0 ||
+            rename(moving.c_str(), (dir + "/index.html").c_str()) < 0)
+        {
+            perror(dir.c_str());
+            pthread_mutex_unlock(&files);
+            return nullptr;
+        }
+    }
+
+    if (isDirectory(path))
+        path += "/index.html";
+
+    FILE* out = nullptr;
+    if (!isUnder(path.substr(0, path.rfind('/')), options.outputDir))
+        std::cerr << "Error: " << path << " is outside " << options.outputDir << std::endl;
+    else if ((out = fopen(path.c_str(), "w")) == nullptr)
+        perror(path.c_str());
+
+    pthread_mutex_unlock(&files);
+    return out;
+}
+
+/**
+ * Parse host[:port][/path] with or without a leading "http://".
+ */
+bool Crawler::parseAbsolute(const std::string& link, Url& url)
+{
+    std::string rest = link;
+    if (startsWithIgnoreCase(rest, "http://"))
+        rest = rest.substr(7);
+
+    std::size_t hostEnd = rest.find_first_of(":/?");
+    url.host = toLower(rest.substr(0, hostEnd));
+    if (url.host.empty())
+        return false;
+
+    url.port = "80";
+    if (hostEnd != std::string::npos && rest[hostEnd] == ':')
+    {
+        std::size_t portEnd = rest.find_first_of("/?", hostEnd+1);
+        url.port = rest.substr(hostEnd+1, portEnd == std::string::npos ? std::string::npos : portEnd-(hostEnd+1));
+        if (url.port.empty())
+            url.port = "80";
+        if (url.port.find_first_not_of("0123456789") != std::string::npos)
+            return false;
+
+        hostEnd = portEnd;
+    }
+
+    std::string path = (hostEnd == std::string::npos) ? "/" : rest.substr(hostEnd);
+    if (path[0] == '?')
+        path = "/" + path;
+
+    std::size_t query = path.find('?');
+    url.path = removeDotSegments(path.substr(0, query));
+    if (query != std::string::npos)
+        url.path += path.substr(query);
+
+    return true;
+}
+
+/**
+ * Turn a link found on the page at base into an absolute URL.
+ *
+ * Returns false for links that can't be crawled, such as other schemes (https
+ * included, since we don't speak TLS) or links to the same page.
+ */
+bool Crawler::resolve(const Url& base, const std::string& link, Url& url)
+{
+    std::string target = link.substr(0, link.find('#'));
+    if (target.empty())
+        return false;
+
+    if (startsWithIgnoreCase(target, "http://"))
+        return parseAbsolute(target, url);
+    if (target.compare(0, 2, "//") == 0)
+        return parseAbsolute(target.substr(2), url);
+
+    //anything else with a scheme (mailto:, javascript:, https:) is skipped
+    std::size_t special = target.find_first_of(":/?");
+    if (special != std::string::npos && target[special] == ':')
+        return false;
+
+    url.host = base.host;
+    url.port = base.port;
+
+    std::string basePath = base.path.substr(0, base.path.find('?'));
+    std::string path;
+    if (target[0] == '/')
+        path = target;
+    else if (target[0] == '?')
+        path = basePath + target;
+    else
+        path = basePath.substr(0, basePath.rfind('/')+1) + target;
+
+    std::size_t query = path.find('?');
+    url.path = removeDotSegments(path.substr(0, query));
+    if (query != std::string::npos)
+        url.path += path.substr(query);
+
+    return true;
+}
+
+/**
+ * Collapse "." and ".." segments so that every spelling of a path maps to the
+ * same key in the seen set.
+ */
+std::string Crawler::removeDotSegments(const std::string& path)
+{
+    std::vector<std::string> segments;
+    bool trailingSlash = false;
+
+    std::size_t start = (path.length() > 0 && path[0] == '/') ? 1 : 0;
+    while (start <= path.length())
+    {
+        std::size_t end = path.find('/', start);
+        if (end == std::string::npos)
+            end = path.length();
+
+        std::string segment = path.substr(start, end-start);
+        if (segment == ".")
+        {
+            trailingSlash = true;
+        }
+        else if (segment == "..")
+        {
+            if (!segments.empty())
+                segments.pop_back();
+            trailingSlash = true;
+        }
+        else
+        {
+            segments.push_back(segment);
+            trailingSlash = false;
+        }
+
+        start = end + 1;
+    }
+
+    std::string result = "/";
+    for (std::size_t i = 0; i < segments.size(); i++)
+    {
+        if (i > 0)
+            result += "/";
+        result += segments[i];
+    }
+
+    if (trailingSlash && !segments.empty())
+        result += "/";
+
+    return result;
+}
+
+Crawler::Host::Host()
+{
+    active = 0;
+    nextAllowed.tv_sec = 0;
+    nextAllowed.tv_nsec = 0;
+}
+
+std::string Crawler::Url::hostKey() const
+{
+    return host + ":" + port;
+}
+
+std::string Crawler::Url::key() const
+{
+    return host + ":" + port + path;
+}
+
+static std::string toLower(const std::string& str)
+{
+    std::string lower = str;
+    for (std::size_t i = 0; i < lower.length(); i++)
+        lower[i] = std::tolower((unsigned char)lower[i]);
+    return lower;
+}
+
+static bool startsWithIgnoreCase(const std::string& str, const char* prefix)
+{
+    std::size_t length = std::strlen(prefix);
+    return str.length() >= length && toLower(str.substr(0, length)) == prefix;
+}
+
+static bool before(const timespec& a, const timespec& b)
+{
+    return a.tv_sec < b.tv_sec || (a.tv_sec == b.tv_sec && a.tv_nsec < b.tv_nsec);
+}
+
+/**
+ * Percent-encode the characters that would let a query change which directory
+ * a page is written to, and '%' itself so that different queries can't end up
+ * with the same name.
+ */
+static std::string escapeQuery(const std::string& query)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    std::string escaped;
+    for (std::size_t i = 0; i < query.length(); i++)
+    {
+        char c = query[i];
+        if (c == '/' || c == '.' || c == '%' || c == '\\')
+        {
+            escaped += '%';
+            escaped += hex[(unsigned char)c >> 4];
+            escaped += hex[c & 0xf];
+        }
+        else
+        {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+static bool isDirectory(const std::string& path)
+{
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+/**
+ * Whether the existing directory path is dir or inside it, once symbolic
+ * links and dot segments are resolved.
+ */
+static bool isUnder(const std::string& path, const std::string& dir)
+{
+    char real[PATH_MAX], realDir[PATH_MAX];
+    if (realpath(path.c_str(), real) == nullptr || realpath(dir.c_str(), realDir) == nullptr)
+        return false;
+
+    std::size_t length = std::strlen(realDir);
+    return std::strncmp(real, realDir, length) == 0 &&
+           (real[length] == '\0' || real[length] == '/' || length == 1);
+}
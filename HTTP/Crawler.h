@@ -0,0 +1,104 @@
+/*
+ * Description:
+ * Crawler.h declares the retriever's crawl mode. Starting from one URL it
+ * fetches pages with a fixed number of worker threads, pulls links out of any
+ * HTML it gets back, and mirrors everything it fetches to disk. Each host is
+ * limited to a number of simultaneous connections and an optional delay
+ * between requests so that a crawl doesn't flatten the server it's reading.
+ *
+ * It is intended to be part of a series on network programming.
+ */
+#ifndef _CRAWLER_H_
+#define _CRAWLER_H_
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <cstdio>
+#include <map>
+#include <pthread.h>
+#include <time.h>
+#include "UrlSet.h"
+
+struct CrawlOptions
+{
+    int concurrency;        //number of worker threads (and connections)
+    int perHost;            //connections allowed to a single host at once
+    int delayMs;            //time between starting requests to the same host
+    long maxPages;          //stop queueing new pages after this many
+    bool sameHost;          //only follow links to the host we started on
+    std::string outputDir;  //where the mirror is written
+
+    CrawlOptions();
+};
+
+class Crawler
+{
+public:
+    Crawler(const CrawlOptions& options);
+    ~Crawler();
+
+    /**
+     * Crawl everything reachable from startUrl, blocking until the crawl is
+     * finished. A summary is printed to stdout once it is.
+     *
+     * Returns false if startUrl could not be understood.
+     */
+    bool run(const std::string& startUrl);
+
+private:
+    struct Url
+    {
+        std::string host;
+        std::string port;
+        std::string path;   //always starts with '/', may include a query
+
+        std::string hostKey() const;
+        std::string key() const;
+    };
+
+    struct Host
+    {
+        std::deque<std::string> pending;
+        int active;
+        timespec nextAllowed;
+
+        Host();
+    };
+
+    static void* worker(void* args);
+    void work();
+
+    bool take(Url& url);
+    void release(const Url& url, const std::vector<Url>& found, bool ok,
+                 long long bytes);
+    bool enqueue(const Url& url);
+
+    bool fetch(int& sd, std::string& connectedTo, const Url& url,
+               std::vector<Url>& found, long long& bytes);
+    bool fetchOnce(int sd, const Url& url, std::vector<Url>& found,
+                   long long& bytes, bool& keepAlive, bool& gotNothing);
+    std::string outputPath(const Url& url) const;
+    FILE* openOutput(std::string& path);
+
+    static bool parseAbsolute(const std::string& link, Url& url);
+    static bool resolve(const Url& base, const std::string& link, Url& url);
+    static std::string removeDotSegments(const std::string& path);
+
+    CrawlOptions options;
+    std::string startHost;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    pthread_mutex_t files;  //held while creating directories and files
+    std::map<std::string, Host> hosts;
+    UrlSet seen;
+    long queued;
+    int active;
+
+    long fetched;
+    long failed;
+    long long totalBytes;
+};
+
+#endif
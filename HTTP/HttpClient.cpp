@@ -0,0 +1,137 @@
+/*
+ * Description:
+ * HttpClient.cpp implements the HTTP fetching helpers declared in
+ * HttpClient.h.
+ *
+ * It is intended to be part of a series on network programming.
+ */
+#include "HttpClient.h"
+#include <sys/socket.h>
+#include <iostream>
+#include <vector>
+#include <netdb.h>
+#include <cstring>
+#include <cerrno>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <cstdio>
+#include <netinet/tcp.h>
+
+enum
+{
+    READ_BUFFER_SIZE = 16384
+};
+
+/**
+ * Parse the URL from the command line to get the server, port, and requested
+ * file.
+ */
+void parseURL(std::string url, std::string& server, std::string& port,
+              std::string& file)
+{
+    std::size_t serverEnd;
+
+    serverEnd = url.find(":");
+    if(serverEnd == std::string::npos)
+    {
+        serverEnd = url.find("/");
+        if(serverEnd == std::string::npos)
+        {
+            server = url;
+            file = "";
+        }
+        else
+        {
+            server = url.substr(0,serverEnd);
+            file = url.substr(serverEnd+1, url.length()-(serverEnd+1));
+        }
+        port = "80";
+    }
+    else
+    {
+        server = url.substr(0,serverEnd);
+
+        std::size_t portEnd = url.find("/");
+        if(portEnd == std::string::npos)
+        {
+            port = url.substr(serverEnd+1, url.length()-serverEnd+1);
+            file = "";
+        }
+        else
+        {
+            port = url.substr(serverEnd+1, portEnd-(serverEnd+1));
+            file = url.substr(portEnd+1, url.length()-portEnd+1);
+        }
+    }
+}
+
+bool sendRequest(int sd, const std::string& request)
+{
+    std::size_t sent = 0;
+    while (sent < request.length())
+    {
+        ssize_t result = send(sd, request.c_str() + sent, request.length() - sent,
+                              MSG_NOSIGNAL);
+        if (result < 0 && errno == EINTR)
+            continue;
+        if (result <= 0)
+            return false;
+
+        sent += result;
+    }
+
+    return true;
+}
+
+long long readResponse(int sd, ResponseParser& parser, const BodySink& sink,
+                       const std::function<void()>& onHeaders)
+{
+    std::vector<ResponseParser::Span> spans;
+    char buffer[READ_BUFFER_SIZE];
+    long long total = 0;
+    bool headersSeen = false;
+    const int on = 1;
+
+    while (!parser.isDone())
+    {
+        ssize_t bufferPos = read(sd, buffer, sizeof(buffer));
+        if (bufferPos < 0 && errno == EINTR)
+            continue;
+        if (bufferPos < 0)
+            return -1;
+
+        if (bufferPos == 0)
+        {
+            if (total == 0)
+                return 0;
+            if (!parser.finish())
+                return -1;
+            break;
+        }
+
+        total += bufferPos;
+
+        //servers commonly write the headers and body separately, and Nagle
+        //on their end holds the body back until the headers are ACKed. The
+        //kernel drops out of quick ACK mode on its own, so it is re-armed
+        //after every read to keep that from costing a delayed ACK timeout.
+        setsockopt(sd, IPPROTO_TCP, TCP_QUICKACK, &on, sizeof(on));
+
+        spans.clear();
+        parser.feed(buffer, bufferPos, spans);
+        if (parser.hasError())
+            return -1;
+
+        if (!headersSeen && parser.headersComplete())
+        {
+            headersSeen = true;
+            if (onHeaders)
+                onHeaders();
+        }
+
+        for (std::size_t i = 0; i < spans.size(); i++)
+            sink(spans[i].data, spans[i].length);
+    }
+
+    return total;
+}
@@ -0,0 +1,50 @@
+/*
+ * Description:
+ * HttpClient.h declares the pieces of the retriever that are shared by every
+ * program that needs to fetch something over HTTP: URL parsing, connecting to
+ * a host, and reading one framed response off of a connection.
+ *
+ * It is intended to be part of a series on network programming.
+ */
+#ifndef _HTTPCLIENT_H_
+#define _HTTPCLIENT_H_
+
+#include <string>
+#include <functional>
+#include <cstddef>
+#include "ResponseParser.h"
+#include "Resolver.h"
+
+/**
+ * Called with each piece of the response body as it comes off the socket. The
+ * data is only valid for the duration of the call.
+ */
+typedef std::function<void(const char* data, std::size_t length)> BodySink;
+
+/**
+ * Parse a URL of the form server:port(optional)/file(optional) to get the
+ * server, port, and requested file.
+ */
+void parseURL(std::string url, std::string& server, std::string& port,
+              std::string& file);
+
+/**
+ * Writes all of request to sd.
+ *
+ * Returns false if the connection failed before the whole request was sent.
+ */
+bool sendRequest(int sd, const std::string& request);
+
+/**
+ * Reads one response from sd using parser to find where it ends. Body bytes
+ * are passed to sink as they arrive, and onHeaders (if given) is called once
+ * the status line and headers have been parsed.
+ *
+ * Returns the number of bytes read from the socket, or -1 if the connection
+ * failed or the response was malformed or cut short. A return of 0 means the
+ * server closed the connection without sending anything.
+ */
+long long readResponse(int sd, ResponseParser& parser, const BodySink& sink,
+                       const std::function<void()>& onHeaders = nullptr);
+
+#endif
@@ -0,0 +1,207 @@
+/*
+ * Description:
+ * LinkScanner.cpp implements the streaming href/src scanner declared in
+ * LinkScanner.h.
+ *
+ * It is intended to be part of a series on network programming.
+ */
+#include "LinkScanner.h"
+#include <cstring>
+#include <cctype>
+
+enum
+{
+    MAX_NAME_LENGTH = 8,
+    MAX_LINK_LENGTH = 4096
+};
+
+static inline bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+}
+
+LinkScanner::LinkScanner()
+{
+    reset();
+}
+
+void LinkScanner::reset()
+{
+    state = TEXT;
+    quote = 0;
+    dashes = 0;
+    wanted = false;
+    name.clear();
+    value.clear();
+}
+
+void LinkScanner::scan(const char* data, std::size_t length, const LinkHandler& handler)
+{
+    const char* end = data + length;
+
+    while (data < end)
+    {
+        //the bulk of a page is text or attribute values, so skip those with
+        //memchr instead of looking at every byte
+        if (state == TEXT)
+        {
+            const char* next = (const char*)std::memchr(data, '<', end - data);
+            if (next == nullptr)
+                return;
+
+            data = next + 1;
+            state = TAG_OPEN;
+            continue;
+        }
+
+        if (state == VALUE_QUOTED)
+        {
+            const char* next = (const char*)std::memchr(data, quote, end - data);
+            const char* stop = (next == nullptr) ? end : next;
+
+            if (wanted && value.length() + (stop - data) <= MAX_LINK_LENGTH)
+                value.append(data, stop - data);
+            else
+                wanted = false;
+
+            if (next == nullptr)
+                return;
+
+            emit(handler);
+            data = next + 1;
+            state = ATTR_SPACE;
+            continue;
+        }
+
+        char c = *data++;
+
+        switch (state)
+        {
+        case TAG_OPEN:
+            if (c == '!')
+                state = BANG;
+            else if (c == '>')
+                state = TEXT;
+            else
+                state = TAG_NAME;
+            break;
+        case BANG:
+            state = (c == '-') ? BANG_DASH : (c == '>' ? TEXT : TAG_NAME);
+            break;
+        case BANG_DASH:
+            dashes = 0;
+            state = (c == '-') ? COMMENT : (c == '>' ? TEXT : TAG_NAME);
+            break;
+        case COMMENT:
+            if (c == '-')
+                dashes++;
+            else if (c == '>' && dashes >= 2)
+                state = TEXT;
+            else
+                dashes = 0;
+            break;
+        case TAG_NAME:
+            if (c == '>')
+                state = TEXT;
+            else if (isSpace(c))
+                state = ATTR_SPACE;
+            break;
+        case ATTR_SPACE:
+            if (c == '>')
+                state = TEXT;
+            else if (!isSpace(c) && c != '/')
+                startName(c);
+            break;
+        case ATTR_NAME:
+            if (c == '>')
+                state = TEXT;
+            else if (c == '=')
+                state = BEFORE_VALUE;
+            else if (isSpace(c))
+                state = AFTER_NAME;
+            else if (c == '/')
+                state = ATTR_SPACE;
+            else if (name.length() < MAX_NAME_LENGTH)
+                name += (char)std::tolower((unsigned char)c);
+            break;
+        case AFTER_NAME:
+            if (c == '>')
+                state = TEXT;
+            else if (c == '=')
+                state = BEFORE_VALUE;
+            else if (!isSpace(c))
+                startName(c);
+            break;
+        case BEFORE_VALUE:
+            if (isSpace(c))
+                break;
+
+            wanted = (name == "href" || name == "src");
+            value.clear();
+
+            if (c == '>')
+            {
+                state = TEXT;
+            }
+            else if (c == '"' || c == '\'')
+            {
+                quote = c;
+                state = VALUE_QUOTED;
+            }
+            else
+            {
+                value += c;
+                state = VALUE_UNQUOTED;
+            }
+            break;
+        case VALUE_UNQUOTED:
+            if (c == '>' || isSpace(c))
+            {
+                emit(handler);
+                state = (c == '>') ? TEXT : ATTR_SPACE;
+            }
+            else if (value.length() < MAX_LINK_LENGTH)
+            {
+                value += c;
+            }
+            else
+            {
+                wanted = false;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+void LinkScanner::startName(char c)
+{
+    name.assign(1, (char)std::tolower((unsigned char)c));
+    state = ATTR_NAME;
+}
+
+/**
+ * Hand a finished attribute value to the handler, undoing the one entity that
+ * shows up in URLs all the time.
+ */
+void LinkScanner::emit(const LinkHandler& handler)
+{
+    if (!wanted)
+        return;
+    wanted = false;
+
+    std::size_t first = value.find_first_not_of(" \t\r\n");
+    if (first == std::string::npos)
+        return;
+    std::size_t last = value.find_last_not_of(" \t\r\n");
+    std::string link = value.substr(first, last-first+1);
+
+    for (std::size_t pos = link.find("&amp;"); pos != std::string::npos;
+         pos = link.find("&amp;", pos+1))
+    {
+        link.erase(pos+1, 4);
+    }
+
+    handler(link);
+}
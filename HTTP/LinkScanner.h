@@ -0,0 +1,63 @@
+/*
+ * Description:
+ * LinkScanner.h declares a streaming scanner that pulls href and src
+ * attribute values out of HTML as it arrives. It keeps only a few bytes of
+ * state between calls, so a page can be scanned straight out of the socket
+ * buffer without being assembled in memory first.
+ *
+ * It is intended to be part of a series on network programming.
+ */
+#ifndef _LINKSCANNER_H_
+#define _LINKSCANNER_H_
+
+#include <string>
+#include <functional>
+#include <cstddef>
+
+class LinkScanner
+{
+public:
+    typedef std::function<void(const std::string& link)> LinkHandler;
+
+    LinkScanner();
+
+    /**
+     * Forget any partially scanned tag so a new document can be scanned.
+     */
+    void reset();
+
+    /**
+     * Scan the next length bytes of the document, calling handler with the
+     * value of every href or src attribute that is completed in them.
+     */
+    void scan(const char* data, std::size_t length, const LinkHandler& handler);
+
+private:
+    enum State
+    {
+        TEXT,
+        TAG_OPEN,
+        BANG,
+        BANG_DASH,
+        COMMENT,
+        TAG_NAME,
+        ATTR_SPACE,
+        ATTR_NAME,
+        AFTER_NAME,
+        BEFORE_VALUE,
+        VALUE_QUOTED,
+        VALUE_UNQUOTED
+    };
+
+    void startName(char c);
+    void emit(const LinkHandler& handler);
+
+    State state;
+    char quote;
+    int dashes;
+    bool wanted;
+    std::string name;
+    std::string value;
+};
+
+#endif
@@ -0,0 +1,335 @@
+/*
+ * Description:
+ * ObjectCache.cpp implements the sharded LRU object store declared in
+ * ObjectCache.h.
+ *
+ * It is intended to be part of a series on network programming.
+ */
+#include "ObjectCache.h"
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <time.h>
+
+enum
+{
+    ENTRY_OVERHEAD = 128    //rough cost of the list node, map node and object
+};
+
+//forward declarations
+static std::string toLower(const std::string& str);
+static bool parseHttpDate(const std::string& value, time_t& result);
+static bool isHopByHop(const std::string& name);
+
+ObjectCache::ObjectCache(std::size_t byteBudget, int shardCount)
+{
+    if (shardCount < 1)
+        shardCount = 1;
+
+    shardBudget = byteBudget / shardCount;
+    for (int i = 0; i < shardCount; i++)
+    {
+        Shard* shard = new Shard;
+        pthread_mutex_init(&shard->mutex, nullptr);
+        shard->bytes = 0;
+        std::memset(&shard->stats, 0, sizeof(shard->stats));
+        shards.push_back(shard);
+    }
+}
+
+ObjectCache::~ObjectCache()
+{
+    for (std::size_t i = 0; i < shards.size(); i++)
+    {
+        pthread_mutex_destroy(&shards[i]->mutex);
+        delete shards[i];
+    }
+}
+
+ObjectPtr ObjectCache::get(const std::string& url, const Fetcher& fetch, bool bypass,
+                           Outcome& outcome)
+{
+    Shard& shard = shardFor(url);
+    pthread_mutex_lock(&shard.mutex);
+
+    while (true)
+    {
+        std::unordered_map<std::string, Entry>::iterator it = shard.entries.find(url);
+        if (it != shard.entries.end() && !bypass)
+        {
+            const ObjectPtr& object = it->second.object;
+            if (nowMs() < object->storedAt + object->lifetime*1000)
+            {
+                shard.lru.splice(shard.lru.begin(), shard.lru, it->second.position);
+                shard.stats.hits++;
+
+                ObjectPtr result = object;
+                pthread_mutex_unlock(&shard.mutex);
+                outcome = HIT;
+                return result;
+            }
+
+            erase(shard, it);
+            shard.stats.expirations++;
+        }
+
+        std::unordered_map<std::string, std::shared_ptr<Flight> >::iterator flightIt =
+            shard.flights.find(url);
+        if (flightIt == shard.flights.end())
+            break;
+
+        //somebody is already fetching this URL, so wait for their result
+        std::shared_ptr<Flight> flight = flightIt->second;
+        while (!flight->finished)
+            pthread_cond_wait(&flight->done, &shard.mutex);
+
+        //a private response can't be handed to another client, so in that
+        //case we go around again and fetch our own copy
+        if (flight->result == nullptr || flight->result->shareable)
+        {
+            shard.stats.coalesced++;
+            pthread_mutex_unlock(&shard.mutex);
+            outcome = COALESCED;
+            return flight->result;
+        }
+    }
+
+    std::shared_ptr<Flight> flight = std::make_shared<Flight>();
+    shard.flights[url] = flight;
+    shard.stats.misses++;
+    pthread_mutex_unlock(&shard.mutex);
+
+    ObjectPtr result = fetch();
+
+    pthread_mutex_lock(&shard.mutex);
+    if (result != nullptr && result->shareable && result->lifetime > 0)
+        insert(shard, url, result);
+
+    flight->result = result;
+    flight->finished = true;
+    pthread_cond_broadcast(&flight->done);
+    shard.flights.erase(url);
+    pthread_mutex_unlock(&shard.mutex);
+
+    outcome = MISS;
+    return result;
+}
+
+CacheStats ObjectCache::stats()
+{
+    CacheStats total;
+    std::memset(&total, 0, sizeof(total));
+
+    for (std::size_t i = 0; i < shards.size(); i++)
+    {
+        Shard& shard = *shards[i];
+        pthread_mutex_lock(&shard.mutex);
+        total.hits += shard.stats.hits;
+        total.misses += shard.stats.misses;
+        total.coalesced += shard.stats.coalesced;
+        total.stores += shard.stats.stores;
+        total.evictions += shard.stats.evictions;
+        total.expirations += shard.stats.expirations;
+        total.objects += shard.entries.size();
+        total.bytes += shard.bytes;
+        pthread_mutex_unlock(&shard.mutex);
+    }
+
+    return total;
+}
+
+/**
+ * Freshness follows RFC 7234 for a shared cache: s-maxage beats max-age,
+ * which beats Expires minus Date. Responses without any of those are not
+ * cached, since we don't do revalidation.
+ */
+std::shared_ptr<CachedObject> ObjectCache::fromResponse(const ResponseParser& parser,
+                                                        std::string& body)
+{
+    std::shared_ptr<CachedObject> object = std::make_shared<CachedObject>();
+    object->status = parser.statusCode();
+    object->reason = parser.reason();
+    object->body.swap(body);
+    object->shareable = true;
+    object->lifetime = -1;
+    object->storedAt = nowMs();
+
+    const std::vector<std::pair<std::string, std::string> >& headers = parser.headers();
+    for (std::size_t i = 0; i < headers.size(); i++)
+    {
+        if (!isHopByHop(headers[i].first))
+            object->headers += headers[i].first + ": " + headers[i].second + "\r\n";
+    }
+
+    long long maxAge = -1, sharedMaxAge = -1;
+    bool noCache = false;
+
+    const std::string* cacheControl = parser.header("Cache-Control");
+    if (cacheControl != nullptr)
+    {
+        std::string directives = toLower(*cacheControl);
+        std::size_t start = 0;
+        while (start < directives.length())
+        {
+            std::size_t end = directives.find(',', start);
+            if (end == std::string::npos)
+                end = directives.length();
+
+            std::string directive = directives.substr(start, end-start);
+            std::size_t first = directive.find_first_not_of(" \t");
+            directive = (first == std::string::npos) ? "" : directive.substr(first);
+
+            if (directive.compare(0, 8, "no-store") == 0 || directive.compare(0, 7, "private") == 0)
+                object->shareable = false;
+            else if (directive.compare(0, 8, "no-cache") == 0)
+                noCache = true;
+            else if (directive.compare(0, 9, "s-maxage=") == 0)
+                sharedMaxAge = std::atoll(directive.c_str() + 9);
+            else if (directive.compare(0, 8, "max-age=") == 0)
+                maxAge = std::atoll(directive.c_str() + 8);
+
+            start = end + 1;
+        }
+    }
+
+    int status = object->status;
+    bool cacheableStatus = (status == 200 || status == 203 || status == 204 ||
+                            status == 300 || status == 301 || status == 404 ||
+                            status == 410);
+    if (!object->shareable || noCache || !cacheableStatus)
+        return object;
+
+    if (sharedMaxAge >= 0)
+    {
+        object->lifetime = sharedMaxAge;
+    }
+    else if (maxAge >= 0)
+    {
+        object->lifetime = maxAge;
+    }
+    else
+    {
+        const std::string* expires = parser.header("Expires");
+        if (expires == nullptr)
+            return object;
+
+        //an Expires we can't read means "already expired"
+        time_t expiresAt, date = time(nullptr);
+        const std::string* dateHeader = parser.header("Date");
+        if (dateHeader != nullptr)
+            parseHttpDate(*dateHeader, date);
+
+        object->lifetime = parseHttpDate(*expires, expiresAt) ? (long long)(expiresAt - date) : 0;
+    }
+
+    const std::string* age = parser.header("Age");
+    if (age != nullptr)
+        object->lifetime -= std::atoll(age->c_str());
+
+    return object;
+}
+
+long long ObjectCache::nowMs()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec*1000LL + now.tv_nsec/1000000;
+}
+
+ObjectCache::Shard& ObjectCache::shardFor(const std::string& url)
+{
+    return *shards[std::hash<std::string>()(url) % shards.size()];
+}
+
+/**
+ * Add object as the most recently used entry, then evict from the cold end of
+ * the LRU until the shard is back within its share of the byte budget.
+ */
+void ObjectCache::insert(Shard& shard, const std::string& url, const ObjectPtr& object)
+{
+    std::unordered_map<std::string, Entry>::iterator it = shard.entries.find(url);
+    if (it != shard.entries.end())
+        erase(shard, it);
+
+    std::size_t size = sizeOf(url, object);
+    if (size > shardBudget)
+        return;
+
+    shard.lru.push_front(url);
+    Entry& entry = shard.entries[url];
+    entry.object = object;
+    entry.position = shard.lru.begin();
+    shard.bytes += size;
+    shard.stats.stores++;
+
+    while (shard.bytes > shardBudget)
+    {
+        erase(shard, shard.entries.find(shard.lru.back()));
+        shard.stats.evictions++;
+    }
+}
+
+void ObjectCache::erase(Shard& shard, std::unordered_map<std::string, Entry>::iterator it)
+{
+    shard.bytes -= sizeOf(it->first, it->second.object);
+    shard.lru.erase(it->second.position);
+    shard.entries.erase(it);
+}
+
+std::size_t ObjectCache::sizeOf(const std::string& url, const ObjectPtr& object)
+{
+    return url.length()*2 + object->reason.length() + object->headers.length() +
+           object->body.length() + ENTRY_OVERHEAD;
+}
+
+ObjectCache::Flight::Flight()
+{
+    pthread_cond_init(&done, nullptr);
+    finished = false;
+}
+
+ObjectCache::Flight::~Flight()
+{
+    pthread_cond_destroy(&done);
+}
+
+static std::string toLower(const std::string& str)
+{
+    std::string lower = str;
+    for (std::size_t i = 0; i < lower.length(); i++)
+        lower[i] = std::tolower((unsigned char)lower[i]);
+    return lower;
+}
+
+static bool parseHttpDate(const std::string& value, time_t& result)
+{
+    tm parsed;
+    std::memset(&parsed, 0, sizeof(parsed));
+    if (strptime(value.c_str(), "%a, %d %b %Y %H:%M:%S", &parsed) == nullptr)
+        return false;
+
+    result = timegm(&parsed);
+    return true;
+}
+
+/**
+ * Headers that describe a single connection rather than the object, which the
+ * proxy has to drop (or regenerate) when it replays a response.
+ */
+static bool isHopByHop(const std::string& name)
+{
+    static const char* names[] = {
+        "connection", "keep-alive", "proxy-authenticate", "proxy-authorization",
+        "proxy-connection", "te", "trailer", "trailers", "transfer-encoding",
+        "upgrade", "content-length", "age"
+    };
+
+    std::string lower = toLower(name);
+    for (std::size_t i = 0; i < sizeof(names)/sizeof(names[0]); i++)
+    {
+        if (lower == names[i])
+            return true;
+    }
+
+    return false;
+}
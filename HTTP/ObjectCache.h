@@ -0,0 +1,125 @@
+/*
+ * Description:
+ * ObjectCache.h declares the in-memory object store used by the server's
+ * caching proxy mode. Responses are kept in an LRU keyed by URL and limited
+ * by a total byte budget. The cache is split into shards, each with its own
+ * lock, so unrelated URLs don't contend with each other.
+ *
+ * Misses are coalesced: when several clients ask for the same URL at once,
+ * only the first one goes to the origin and the rest wait for its result.
+ *
+ * It is intended to be part of a series on network programming.
+ */
+#ifndef _OBJECTCACHE_H_
+#define _OBJECTCACHE_H_
+
+#include <string>
+#include <list>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <cstddef>
+#include <pthread.h>
+#include "ResponseParser.h"
+
+struct CachedObject
+{
+    int status;
+    std::string reason;
+    std::string headers;    //end-to-end header lines, each ending in CRLF
+    std::string body;
+
+    bool shareable;         //false for private or no-store responses
+    long long lifetime;     //seconds it stays fresh, or -1 if it can't be cached
+    long long storedAt;     //CLOCK_MONOTONIC milliseconds
+};
+
+typedef std::shared_ptr<const CachedObject> ObjectPtr;
+
+struct CacheStats
+{
+    long long hits;
+    long long misses;
+    long long coalesced;
+    long long stores;
+    long long evictions;
+    long long expirations;
+    long long objects;
+    long long bytes;
+};
+
+class ObjectCache
+{
+public:
+    enum Outcome
+    {
+        HIT,
+        MISS,
+        COALESCED
+    };
+
+    typedef std::function<ObjectPtr()> Fetcher;
+
+    ObjectCache(std::size_t byteBudget, int shardCount);
+    ~ObjectCache();
+
+    /**
+     * Return the fresh cached object for url, or call fetch to get it from the
+     * origin. If another thread is already fetching url, wait for that fetch
+     * instead of starting a second one. When bypass is true the cached copy is
+     * ignored (but the fetched one still replaces it).
+     *
+     * Returns nullptr only if the fetch failed.
+     */
+    ObjectPtr get(const std::string& url, const Fetcher& fetch, bool bypass,
+                  Outcome& outcome);
+
+    CacheStats stats();
+
+    /**
+     * Build a CachedObject from a parsed origin response, working out from
+     * Cache-Control, Expires, Date and Age how long it may be served.
+     */
+    static std::shared_ptr<CachedObject> fromResponse(const ResponseParser& parser,
+                                                      std::string& body);
+
+    static long long nowMs();
+
+private:
+    struct Entry
+    {
+        ObjectPtr object;
+        std::list<std::string>::iterator position;
+    };
+
+    struct Flight
+    {
+        pthread_cond_t done;
+        bool finished;
+        ObjectPtr result;
+
+        Flight();
+        ~Flight();
+    };
+
+    struct Shard
+    {
+        pthread_mutex_t mutex;
+        std::list<std::string> lru;     //most recently used at the front
+        std::unordered_map<std::string, Entry> entries;
+        std::unordered_map<std::string, std::shared_ptr<Flight> > flights;
+        std::size_t bytes;
+        CacheStats stats;
+    };
+
+    Shard& shardFor(const std::string& url);
+    void insert(Shard& shard, const std::string& url, const ObjectPtr& object);
+    void erase(Shard& shard, std::unordered_map<std::string, Entry>::iterator it);
+    static std::size_t sizeOf(const std::string& url, const ObjectPtr& object);
+
+    std::vector<Shard*> shards;
+    std::size_t shardBudget;
+};
+
+#endif
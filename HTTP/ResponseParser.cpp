@@ -0,0 +1,406 @@
+/*
+ * Description:
+ * ResponseParser.cpp implements the incremental HTTP/1.x response parser
+ * declared in ResponseParser.h.
+ *
+ * It is intended to be part of a series on network programming.
+ */
+#include "ResponseParser.h"
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <cerrno>
+
+enum
+{
+    MAX_LINE_LENGTH = 16384
+};
+
+//forward declarations
+static bool equalsIgnoreCase(const std::string& a, const std::string& b);
+static std::string trim(const std::string& str);
+
+ResponseParser::ResponseParser()
+{
+    headRequest = false;
+    reset();
+}
+
+void ResponseParser::reset()
+{
+    state = STATUS_LINE;
+    chunked = false;
+    closeDelimited = false;
+    code = 0;
+    length = -1;
+    remaining = 0;
+    httpVersion.clear();
+    reasonPhrase.clear();
+    lineBuffer.clear();
+    headerList.clear();
+}
+
+void ResponseParser::setHeadRequest(bool head)
+{
+    headRequest = head;
+}
+
+std::size_t ResponseParser::feed(const char* data, std::size_t size,
+                                 std::vector<Span>& body)
+{
+    const char* start = data;
+    const char* end = data + size;
+    std::string line;
+
+    while (data < end && state != DONE && state != ERROR)
+    {
+        switch (state)
+        {
+        case STATUS_LINE:
+        {
+            if (!takeLine(data, end, line))
+                break;
+
+            //tolerate blank lines before the status line
+            if (line.empty())
+                break;
+
+            parseStatusLine(line);
+            break;
+        }
+        case HEADERS:
+        {
+            if (!takeLine(data, end, line))
+                break;
+
+            if (line.empty())
+                startBody();
+            else
+                parseHeaderLine(line);
+            break;
+        }
+        case BODY_LENGTH:
+        case CHUNK_DATA:
+        {
+            std::size_t available = end - data;
+            std::size_t take = available < remaining ? available : remaining;
+
+            body.push_back({data, take});
+            data += take;
+            remaining -= take;
+
+            if (remaining == 0)
+                state = (state == BODY_LENGTH) ? DONE : CHUNK_DATA_END;
+            break;
+        }
+        case BODY_UNTIL_CLOSE:
+        {
+            body.push_back({data, (std::size_t)(end - data)});
+            data = end;
+            break;
+        }
+        case CHUNK_SIZE:
+        {
+            if (!takeLine(data, end, line))
+                break;
+
+            //hex digits only, then optional whitespace and chunk extensions
+            //after ';', which are ignored; strtoull alone would also take a
+            //sign, a 0x prefix and leading whitespace
+            std::size_t digits = line.find_first_not_of("0123456789abcdefABCDEF");
+            std::size_t rest = (digits == std::string::npos) ? line.length() : line.find_first_not_of(" \t", digits);
+
+            errno = 0;
+            unsigned long long chunkSize = std::strtoull(line.substr(0, digits).c_str(), nullptr, 16);
+            if (digits == 0 || line.empty() || (rest != std::string::npos && rest < line.length() && line[rest] != ';') ||
+                errno == ERANGE)
+            {
+                state = ERROR;
+                break;
+            }
+
+            if (chunkSize == 0)
+            {
+                state = TRAILERS;
+            }
+            else
+            {
+                remaining = chunkSize;
+                state = CHUNK_DATA;
+            }
+            break;
+        }
+        case CHUNK_DATA_END:
+        {
+            if (!takeLine(data, end, line))
+                break;
+
+            state = line.empty() ? CHUNK_SIZE : ERROR;
+            break;
+        }
+        case TRAILERS:
+        {
+            if (!takeLine(data, end, line))
+                break;
+
+            //trailers are read and dropped, a blank line ends the response
+            if (line.empty())
+                state = DONE;
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    return data - start;
+}
+
+bool ResponseParser::finish()
+{
+    if (state == BODY_UNTIL_CLOSE)
+    {
+        state = DONE;
+        return true;
+    }
+
+    if (state != DONE)
+        state = ERROR;
+
+    return state == DONE;
+}
+
+bool ResponseParser::isDone() const
+{
+    return state == DONE;
+}
+
+bool ResponseParser::hasError() const
+{
+    return state == ERROR;
+}
+
+bool ResponseParser::headersComplete() const
+{
+    return state != STATUS_LINE && state != HEADERS && state != ERROR;
+}
+
+int ResponseParser::statusCode() const
+{
+    return code;
+}
+
+const std::string& ResponseParser::reason() const
+{
+    return reasonPhrase;
+}
+
+const std::string& ResponseParser::version() const
+{
+    return httpVersion;
+}
+
+const std::string* ResponseParser::header(const std::string& name) const
+{
+    for (std::size_t i = 0; i < headerList.size(); i++)
+    {
+        if (equalsIgnoreCase(headerList[i].first, name))
+            return &headerList[i].second;
+    }
+
+    return nullptr;
+}
+
+const std::vector<std::pair<std::string, std::string> >& ResponseParser::headers() const
+{
+    return headerList;
+}
+
+long long ResponseParser::contentLength() const
+{
+    return length;
+}
+
+bool ResponseParser::isChunked() const
+{
+    return chunked;
+}
+
+bool ResponseParser::keepAlive() const
+{
+    if (closeDelimited || state == ERROR)
+        return false;
+
+    const std::string* connection = header("Connection");
+    if (httpVersion == "HTTP/1.0")
+        return connection != nullptr && equalsIgnoreCase(*connection, "keep-alive");
+
+    return connection == nullptr || !equalsIgnoreCase(*connection, "close");
+}
+
+/**
+ * Pull the next CRLF (or bare LF) terminated line out of the input.
+ *
+ * Lines that are split across calls to feed() are kept in lineBuffer until the
+ * rest of them arrives, so this is the only place bytes get copied.
+ *
+ * Returns true if a full line was found and stored in line without its
+ * terminator.
+ */
+bool ResponseParser::takeLine(const char*& data, const char* end, std::string& line)
+{
+    const char* newline = (const char*)std::memchr(data, '\n', end - data);
+    if (newline == nullptr)
+    {
+        lineBuffer.append(data, end - data);
+        data = end;
+
+        if (lineBuffer.length() > MAX_LINE_LENGTH)
+            state = ERROR;
+        return false;
+    }
+
+    lineBuffer.append(data, newline - data);
+    data = newline + 1;
+
+    if (!lineBuffer.empty() && lineBuffer[lineBuffer.length()-1] == '\r')
+        lineBuffer.erase(lineBuffer.length()-1);
+
+    line.swap(lineBuffer);
+    lineBuffer.clear();
+    return true;
+}
+
+/**
+ * Parses a line like "HTTP/1.1 200 OK" into the version, code, and reason.
+ */
+void ResponseParser::parseStatusLine(const std::string& line)
+{
+    if (line.compare(0, 7, "HTTP/1.") != 0)
+    {
+        state = ERROR;
+        return;
+    }
+
+    std::size_t codeStart = line.find(' ');
+    if (codeStart == std::string::npos || line.length() < codeStart + 4)
+    {
+        state = ERROR;
+        return;
+    }
+
+    httpVersion = line.substr(0, codeStart);
+
+    code = 0;
+    for (std::size_t i = codeStart+1; i < codeStart+4; i++)
+    {
+        if (!std::isdigit((unsigned char)line[i]))
+        {
+            state = ERROR;
+            return;
+        }
+        code = code*10 + (line[i] - '0');
+    }
+
+    reasonPhrase = (line.length() > codeStart+5) ? line.substr(codeStart+5) : "";
+    state = HEADERS;
+}
+
+void ResponseParser::parseHeaderLine(const std::string& line)
+{
+    std::size_t colon = line.find(':');
+    if (colon == std::string::npos)
+    {
+        state = ERROR;
+        return;
+    }
+
+    std::string name = trim(line.substr(0, colon));
+    std::string value = trim(line.substr(colon+1));
+
+    if (equalsIgnoreCase(name, "Content-Length"))
+    {
+        //nothing but digits, so that "10abc" or "-5" can't frame the body
+        errno = 0;
+        length = std::strtoll(value.c_str(), nullptr, 10);
+        if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos ||
+            errno == ERANGE)
+        {
+            state = ERROR;
+            return;
+        }
+    }
+    else if (equalsIgnoreCase(name, "Transfer-Encoding"))
+    {
+        //chunked is always the last coding when it is present
+        std::size_t pos = value.rfind(',');
+        std::string last = trim(pos == std::string::npos ? value : value.substr(pos+1));
+        chunked = equalsIgnoreCase(last, "chunked");
+    }
+
+    headerList.push_back(std::make_pair(name, value));
+}
+
+/**
+ * Decide how the body is framed once all of the headers have been seen.
+ */
+void ResponseParser::startBody()
+{
+    //the connection no longer speaks HTTP after switching protocols
+    if (code == 101)
+    {
+        closeDelimited = true;
+        state = DONE;
+        return;
+    }
+
+    //other 1xx responses are interim, the real response follows them
+    if (code >= 100 && code < 200)
+    {
+        reset();
+        return;
+    }
+
+    if (headRequest || code == 204 || code == 304)
+    {
+        state = DONE;
+    }
+    else if (chunked)
+    {
+        state = CHUNK_SIZE;
+    }
+    else if (length >= 0)
+    {
+        remaining = length;
+        state = (length == 0) ? DONE : BODY_LENGTH;
+    }
+    else
+    {
+        closeDelimited = true;
+        state = BODY_UNTIL_CLOSE;
+    }
+}
+
+static bool equalsIgnoreCase(const std::string& a, const std::string& b)
+{
+    if (a.length() != b.length())
+        return false;
+
+    for (std::size_t i = 0; i < a.length(); i++)
+    {
+        if (std::tolower((unsigned char)a[i]) != std::tolower((unsigned char)b[i]))
+            return false;
+    }
+
+    return true;
+}
+
+static std::string trim(const std::string& str)
+{
+    std::size_t first = str.find_first_not_of(" \t");
+    if (first == std::string::npos)
+        return "";
+
+    std::size_t last = str.find_last_not_of(" \t");
+    return str.substr(first, last-first+1);
+}
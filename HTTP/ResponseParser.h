@@ -0,0 +1,126 @@
+/*
+ * Description:
+ * ResponseParser.h declares an incremental HTTP/1.x response parser. Bytes are
+ * fed to it as they come off the socket, and it works out where the response
+ * ends from the status code, Content-Length or chunked transfer-encoding, so
+ * callers no longer have to wait for the server to close the connection.
+ *
+ * It is intended to be part of a series on network programming.
+ */
+#ifndef _RESPONSEPARSER_H_
+#define _RESPONSEPARSER_H_
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstddef>
+
+class ResponseParser
+{
+public:
+    /**
+     * A piece of the response body. It points directly into the buffer that
+     * was given to feed(), so it is only valid until that buffer is reused.
+     */
+    struct Span
+    {
+        const char* data;
+        std::size_t length;
+    };
+
+    ResponseParser();
+
+    /**
+     * Prepare the parser for the next response on the same connection.
+     */
+    void reset();
+
+    /**
+     * Tell the parser that the request was a HEAD, so the response has no body
+     * regardless of what the headers say.
+     */
+    void setHeadRequest(bool head);
+
+    /**
+     * Parse the next length bytes of the response. Any body bytes found are
+     * appended to body as spans into data (chunk framing is stripped without
+     * copying anything).
+     *
+     * Returns the number of bytes consumed. This is less than length only when
+     * the response finished early, in which case the remaining bytes belong to
+     * the next response on the connection.
+     */
+    std::size_t feed(const char* data, std::size_t length,
+                     std::vector<Span>& body);
+
+    /**
+     * Tell the parser that the connection was closed by the server.
+     *
+     * Returns true if that was a valid end for the response (it was framed by
+     * the connection closing), or false if the response was cut short.
+     */
+    bool finish();
+
+    bool isDone() const;
+    bool hasError() const;
+    bool headersComplete() const;
+
+    /**
+     * The numeric status code, or 0 if the status line has not been parsed.
+     */
+    int statusCode() const;
+    const std::string& reason() const;
+    const std::string& version() const;
+
+    /**
+     * Case-insensitive header lookup. Returns nullptr if the header is absent.
+     */
+    const std::string* header(const std::string& name) const;
+    const std::vector<std::pair<std::string, std::string> >& headers() const;
+
+    /**
+     * The value of Content-Length, or -1 if there wasn't one.
+     */
+    long long contentLength() const;
+    bool isChunked() const;
+
+    /**
+     * Whether the connection can be used for another request once this
+     * response is done.
+     */
+    bool keepAlive() const;
+
+private:
+    enum State
+    {
+        STATUS_LINE,
+        HEADERS,
+        BODY_LENGTH,
+        BODY_UNTIL_CLOSE,
+        CHUNK_SIZE,
+        CHUNK_DATA,
+        CHUNK_DATA_END,
+        TRAILERS,
+        DONE,
+        ERROR
+    };
+
+    bool takeLine(const char*& data, const char* end, std::string& line);
+    void parseStatusLine(const std::string& line);
+    void parseHeaderLine(const std::string& line);
+    void startBody();
+
+    State state;
+    bool headRequest;
+    bool chunked;
+    bool closeDelimited;
+    int code;
+    long long length;
+    unsigned long long remaining;
+    std::string httpVersion;
+    std::string reasonPhrase;
+    std::string lineBuffer;
+    std::vector<std::pair<std::string, std::string> > headerList;
+};
+
+#endif
@@ -0,0 +1,98 @@
+/*
+ * Description:
+ * UrlSet.cpp implements the hashed URL set declared in UrlSet.h.
+ *
+ * It is intended to be part of a series on network programming.
+ */
+#include "UrlSet.h"
+
+enum
+{
+    INITIAL_SLOTS = 1024
+};
+
+//0 marks an empty slot, so no URL is allowed to hash to it
+static const uint64_t EMPTY = 0;
+
+UrlSet::UrlSet() : slots(INITIAL_SLOTS, EMPTY), count(0)
+{
+}
+
+bool UrlSet::insert(const std::string& url)
+{
+    //keep the table at most 3/4 full so probe sequences stay short
+    if ((count+1)*4 > slots.size()*3)
+        grow();
+
+    return insertHash(hash(url));
+}
+
+bool UrlSet::contains(const std::string& url) const
+{
+    uint64_t value = hash(url);
+    std::size_t mask = slots.size() - 1;
+
+    for (std::size_t i = value & mask; slots[i] != EMPTY; i = (i+1) & mask)
+    {
+        if (slots[i] == value)
+            return true;
+    }
+
+    return false;
+}
+
+std::size_t UrlSet::size() const
+{
+    return count;
+}
+
+/**
+ * FNV-1a over the URL, followed by a finalizer so that the low bits used to
+ * pick a slot depend on every byte.
+ */
+uint64_t UrlSet::hash(const std::string& url)
+{
+    uint64_t value = 14695981039346656037ULL;
+    for (std::size_t i = 0; i < url.length(); i++)
+    {
+        value ^= (unsigned char)url[i];
+        value *= 1099511628211ULL;
+    }
+
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33;
+
+    return value == EMPTY ? 1 : value;
+}
+
+bool UrlSet::insertHash(uint64_t value)
+{
+    std::size_t mask = slots.size() - 1;
+    std::size_t i = value & mask;
+
+    while (slots[i] != EMPTY)
+    {
+        if (slots[i] == value)
+            return false;
+        i = (i+1) & mask;
+    }
+
+    slots[i] = value;
+    count++;
+    return true;
+}
+
+void UrlSet::grow()
+{
+    std::vector<uint64_t> old;
+    old.swap(slots);
+    slots.assign(old.size()*2, EMPTY);
+    count = 0;
+
+    for (std::size_t i = 0; i < old.size(); i++)
+    {
+        if (old[i] != EMPTY)
+            insertHash(old[i]);
+    }
+}
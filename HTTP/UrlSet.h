@@ -0,0 +1,43 @@
+/*
+ * Description:
+ * UrlSet.h declares a compact set used to remember which URLs have already
+ * been seen. Only a 64 bit hash of each URL is stored, in an open addressing
+ * table, so remembering a URL costs 8 to 16 bytes no matter how long it is.
+ * A hash collision would make a new URL look like one we've seen, but with 64
+ * bits that needs billions of URLs before it becomes likely.
+ *
+ * It is intended to be part of a series on network programming.
+ */
+#ifndef _URLSET_H_
+#define _URLSET_H_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+class UrlSet
+{
+public:
+    UrlSet();
+
+    /**
+     * Adds url to the set.
+     *
+     * Returns true if it was not already in the set.
+     */
+    bool insert(const std::string& url);
+
+    bool contains(const std::string& url) const;
+    std::size_t size() const;
+
+private:
+    static uint64_t hash(const std::string& url);
+    bool insertHash(uint64_t value);
+    void grow();
+
+    std::vector<uint64_t> slots;
+    std::size_t count;
+};
+
+#endif
@@ -1,2 +1,2 @@
-g++ client.cpp -oclient -std=c++11
-g++ server.cpp -oserver -lpthread -std=c++11
+g++ retriever.cpp HttpClient.cpp ResponseParser.cpp LinkScanner.cpp UrlSet.cpp Crawler.cpp ../Common/Resolver.cpp -I../Common -oretriever -lpthread -std=c++11
+g++ server.cpp HttpClient.cpp ResponseParser.cpp ObjectCache.cpp ../Common/Resolver.cpp ../Common/TcpInfo.cpp -I../Common -oserver -lpthread -std=c++11
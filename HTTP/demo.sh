@@ -1,7 +1,7 @@
 #! /bin/sh
 
-g++ -oserver server.cpp -std=c++11 -lpthread
-g++ -oretriever retriever.cpp -std=c++11
+g++ -oserver server.cpp HttpClient.cpp ResponseParser.cpp ObjectCache.cpp ../Common/Resolver.cpp ../Common/TcpInfo.cpp -I../Common -std=c++11 -lpthread
+g++ -oretriever retriever.cpp HttpClient.cpp ResponseParser.cpp LinkScanner.cpp UrlSet.cpp Crawler.cpp ../Common/Resolver.cpp -I../Common -lpthread -std=c++11
 
 ./server 8080 &
 
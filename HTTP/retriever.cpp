@@ -3,9 +3,12 @@
  * Date: 1/26/2017
  *
  * Description:
- * client.cpp is a that can connect to web servers using HTTP 1.0. If the client
+ * client.cpp is a that can connect to web servers using HTTP 1.1. If the client
  * receives a 200 OK code, then it will save the body of the response as the
- * requested file.
+ * requested file. Responses are framed by Content-Length or chunked encoding
+ * when the server provides them.
+ *
+ * With --crawl it instead mirrors every page reachable from the given URL.
  *
  * It is intended to be part of a series on network programming.
  */
@@ -21,21 +24,24 @@
 #include <unistd.h>
 #include <sys/uio.h>
 #include <sys/time.h>
-#include <sstream>
 #include <cstdio>
+#include <stdexcept>
+#include "HttpClient.h"
+#include "Crawler.h"
 
 //forward declaration
-void parseURL(std::string url, std::string& server, std::string& port,
-              std::string& file);
-int connectToHost(std::string host, std::string port);
-std::string getResponseCode(std::string headers);
+int crawl(int argc, char *argv[]);
 
 int main(int argc, char *argv[])
 {
     std::string serverName, file, port;
     bool badrequest = false;
 
-    if (argc == 2)
+    if (argc >= 3 && std::string(argv[1]) == "--crawl")
+    {
+        return crawl(argc, argv);
+    }
+    else if (argc == 2)
     {
         parseURL(argv[1], serverName, port, file);
     }
@@ -48,6 +54,8 @@ int main(int argc, char *argv[])
     {
         std::cerr << "Error: Incorrect number of arguments." << std::endl;
         std::cerr << "Arguments: serverIp:port(optional)/file(optional) badrequest(optional)" << std::endl;
+        std::cerr << "       or: --crawl serverIp:port(optional)/file(optional) [--concurrency n]" << std::endl;
+        std::cerr << "           [--per-host n] [--delay-ms n] [--max-pages n] [--out dir] [--any-host]" << std::endl;
         return -1;
     }
 
@@ -55,55 +63,46 @@ int main(int argc, char *argv[])
     if(badrequest)
         request = "\r\n\r\n";
     else
-        request = "GET /" + file + " HTTP/1.0\r\n";
+        request = "GET /" + file + " HTTP/1.1\r\n";
 
     request += "Host: " + serverName + "\r\n";
+    request += "Connection: close\r\n";
     request += "\r\n";
 
     int clientSd = connectToHost(serverName, port);
     if(clientSd < 0)
         return -1;
 
-    write(clientSd, request.c_str(), request.length());
-
+    sendRequest(clientSd, request);
 
-    std::string response = "";
-    std::string headers = "";
+    //the parser knows where the response ends from its framing, so we only
+    //rely on the server closing the connection when it sends neither a
+    //Content-Length nor a chunked body
+    ResponseParser parser;
     std::string body = "";
-    int bufferSize = 512;
-    char buffer[bufferSize];
-    int bufferPos;
-
-    while (response.find("\r\n\r\n") == std::string::npos)
+    if(readResponse(clientSd, parser, [&](const char* data, std::size_t length)
+                                      {
+                                          body.append(data, length);
+                                      }) < 0)
     {
-        bufferPos = read(clientSd, buffer, bufferSize);
-        response += std::string(buffer, bufferPos);
+        perror("read error");
     }
 
-    std::size_t headerEndPos = response.find("\r\n\r\n");
-
-    headers = response.substr(0, headerEndPos);
-
-    std::string responseCode = getResponseCode(headers);
-    std::cout << "Response Code: " << responseCode << std::endl;
-
-    std::size_t bodyStartPos = headerEndPos+4;
-
-    //put the remainder of the read response into the body
-    body = response.substr(bodyStartPos, response.length());
-
-    while (true)
+    if(!parser.isDone())
     {
-        bufferPos = read(clientSd, buffer, bufferSize);
-        //std::cout << "bytes read: " << bufferPos << std:: endl;
-        if(bufferPos > 0)
-            body += std::string(buffer, bufferPos);
-        if(bufferPos == 0)
-            break;
+        std::cerr << "Error: the response was malformed or incomplete." << std::endl;
+        if(!parser.headersComplete())
+        {
+            close(clientSd);
+            return -1;
+        }
     }
 
+    std::cout << "Response Code: " << parser.statusCode() << " "
+              << parser.reason() << std::endl;
+
     std::cout << body << std::endl;
-    if(responseCode.find("200") != std::string::npos)
+    if(parser.statusCode() == 200 && parser.isDone())
     {
         if(file == "")
             file = "index.html";
@@ -127,115 +126,48 @@ int main(int argc, char *argv[])
 }
 
 /**
- * Parse the URL from the command line to get the server, port, and requested
- * file.
+ * Runs the retriever in crawl mode, parsing the options that follow the start
+ * URL.
  */
-void parseURL(std::string url, std::string& server, std::string& port,
-              std::string& file)
+int crawl(int argc, char *argv[])
 {
-    std::size_t serverEnd;
+    CrawlOptions options;
 
-    serverEnd = url.find(":");
-    if(serverEnd == std::string::npos)
+    try
     {
-        serverEnd = url.find("/");
-        if(serverEnd == std::string::npos)
-        {
-            server = url;
-            file = "";
-        }
-        else
-        {
-            server = url.substr(0,serverEnd);
-            file = url.substr(serverEnd+1, url.length()-(serverEnd+1));
-        }
-        port = "80";
-    }
-    else
-    {
-        server = url.substr(0,serverEnd);
-
-        std::size_t portEnd = url.find("/");
-        if(portEnd == std::string::npos)
-        {
-            port = url.substr(serverEnd+1, url.length()-serverEnd+1);
-            file = "";
-        }
-        else
+        for (int i = 3; i < argc; i++)
         {
-            port = url.substr(serverEnd+1, portEnd-(serverEnd+1));
-            file = url.substr(portEnd+1, url.length()-portEnd+1);
+            std::string option = argv[i];
+            if (option == "--any-host")
+                options.sameHost = false;
+            else if (i+1 >= argc)
+                throw std::invalid_argument(option);
+            else if (option == "--concurrency")
+                options.concurrency = std::stoi(argv[++i]);
+            else if (option == "--per-host")
+                options.perHost = std::stoi(argv[++i]);
+            else if (option == "--delay-ms")
+                options.delayMs = std::stoi(argv[++i]);
+            else if (option == "--max-pages")
+                options.maxPages = std::stol(argv[++i]);
+            else if (option == "--out")
+                options.outputDir = argv[++i];
+            else
+                throw std::invalid_argument(option);
         }
     }
-}
-
-/**
- * Attempts to create connection to a given host using the specified port.
- *
- * Any encountered errors will be printed to stderr.
- *
- * Returns a socket descriptor if successful, or -1 on failure.
- */
-int connectToHost(std::string host, std::string port)
-{
-    addrinfo* serverAddress;
-    addrinfo hints;
-    std::memset(&hints, 0, sizeof(hints));
-    hints.ai_family = AF_INET;
-    hints.ai_socktype = SOCK_STREAM;
-
-    //attempt to resolve the IP address
-    int result = getaddrinfo(host.c_str(), port.c_str(), &hints, &serverAddress);
-    if (result != 0)
+    catch (...)
     {
-        std::cerr << "getaddrinfo: " << gai_strerror(result) << std::endl;
+        std::cerr << "Error: Something is wrong with your crawl options." << std::endl;
         return -1;
     }
 
-    //check to see if we got anything that allows us to make a connection
-    int sd;
-    for (addrinfo* addr = serverAddress; addr != NULL; addr = addr->ai_next)
+    if (options.concurrency < 1 || options.perHost < 1 || options.delayMs < 0)
     {
-        sd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
-        if (sd < 0)
-            continue;
-
-        if (connect(sd, addr->ai_addr, addr->ai_addrlen) < 0)
-        {
-            close(sd);
-            sd = -1;
-            continue;
-        }
-
-        break;
-    }
-
-    freeaddrinfo(serverAddress);
-
-    if (sd < 0)
-    {
-        perror("socket error");
+        std::cerr << "Error: concurrency and per-host must be at least 1." << std::endl;
         return -1;
     }
 
-    return sd;
-}
-
-/**
- * Parses the headers of a response to get the response code.
- *
- * If one can not be found for some reason, this returns an empty string.
- */
-std::string getResponseCode(std::string headers)
-{
-    std::istringstream instream(headers);
-
-    for(std::string line; std::getline(instream, line);)
-    {
-        std::size_t pos = line.find("HTTP/1.");
-        if(pos != std::string::npos)
-            return line;
-    }
-
-    return "";
+    Crawler crawler(options);
+    return crawler.run(argv[2]) ? 0 : -1;
 }
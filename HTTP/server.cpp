@@ -5,6 +5,14 @@
  * Description:
  * server.cpp is a simple HTTP 1.0 server. It only understands the GET command.
  *
+ * With --proxy it also acts as a caching forward proxy: a GET for an absolute
+ * http:// URI is fetched from the origin and kept in an in-memory LRU so that
+ * later requests for it can be served without going back to the origin.
+ * Statistics are available from the /stats page, including what TCP_INFO
+ * said about the client connections as they closed, which tells a slow
+ * network (RTT, retransmits) from slow clients (time limited by their receive
+ * window) and from the server itself (send buffer or application limited).
+ *
  * It is intended to be part of a series on network programming.
  */
 
@@ -18,11 +26,19 @@
 #include <pthread.h>
 #include <signal.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 #include <sstream>
+#include <atomic>
+#include <cerrno>
+#include "HttpClient.h"
+#include "ObjectCache.h"
+#include "TcpInfo.h"
 
 enum
 {
-    ALLOWED_CONNECTIONS = 16
+    ALLOWED_CONNECTIONS = 16,
+    DEFAULT_CACHE_MB = 64,
+    DEFAULT_CACHE_SHARDS = 16
 };
 
 //forward declarations
@@ -30,6 +46,12 @@ void interruptHandler(int signal);
 int createSocketListener(int port);
 void *handleClient(void *args);
 bool checkRequest(std::string request, std::string& outfile);
+void serveProxied(int sd, const std::string& request, const std::string& url);
+ObjectPtr fetchFromOrigin(const std::string& url);
+bool wantsFreshCopy(const std::string& request);
+std::string statsPage();
+bool writeAll(int sd, const std::string& head, const std::string& body);
+void closeClient(int sd);
 
 //global to allow cleanup if we receive SIGINT
 int serverSd;
@@ -37,19 +59,69 @@ int serverSd;
 //because console output is not reentrant
 pthread_mutex_t mut = PTHREAD_MUTEX_INITIALIZER;
 
+//only created when running as a proxy
+ObjectCache* proxyCache = nullptr;
+
+std::atomic<long long> requestsServed(0);
+
+//TCP_INFO of the client connections, added up as each one closes
+struct TcpTotals
+{
+    long long connections;
+    long long rttUs;            //summed, for the average
+    uint32_t maxRttUs;
+    long long retransmits;
+    long long busyUs;
+    long long rwndLimitedUs;
+    long long sndbufLimitedUs;
+    long long limits[TCP_LIMITS];   //connections by what held them back
+};
+TcpTotals tcpTotals;
+pthread_mutex_t tcpMut = PTHREAD_MUTEX_INITIALIZER;
+
 int main(int argc, char *argv[])
 {
     int port = 80;
-    if (argc == 2)
+    bool proxy = false;
+    long cacheMB = DEFAULT_CACHE_MB;
+    int shards = DEFAULT_CACHE_SHARDS;
+
+    if (argc < 2)
+    {
+        std::cerr << "Error: Argument for port number required." << std::endl;
+        std::cerr << "Arguments: port [--proxy] [--cache-mb n] [--shards n]" << std::endl;
+        return -1;
+    }
+
+    try
     {
         port = std::stoi(argv[1]);
+        for (int i = 2; i < argc; i++)
+        {
+            std::string option = argv[i];
+            if (option == "--proxy")
+                proxy = true;
+            else if (option == "--cache-mb" && i+1 < argc)
+                cacheMB = std::stol(argv[++i]);
+            else if (option == "--shards" && i+1 < argc)
+                shards = std::stoi(argv[++i]);
+            else
+                throw std::invalid_argument(option);
+        }
     }
-    else
+    catch (...)
     {
-        std::cerr << "Error: Argument for port number required." << std::endl;
+        std::cerr << "Error: Something is wrong with your arguments." << std::endl;
+        std::cerr << "Arguments: port [--proxy] [--cache-mb n] [--shards n]" << std::endl;
         return -1;
     }
 
+    if (proxy)
+        proxyCache = new ObjectCache(cacheMB*1024*1024, shards);
+
+    //a client going away mid-response should not take the server with it
+    signal(SIGPIPE, SIG_IGN);
+
     //start handling SIGINT (closes the server socket before termination)
     signal(SIGINT, interruptHandler);
 
@@ -146,6 +218,12 @@ void* handleClient(void* args)
     while (request.find("\r\n\r\n") == std::string::npos)
     {
         bufferPos = read(sd, buffer, bufferSize);
+        if(bufferPos <= 0)
+        {
+            closeClient(sd);
+            delete ((int*)args);
+            return nullptr;
+        }
         request += std::string(buffer, bufferPos);
     }
 
@@ -153,10 +231,22 @@ void* handleClient(void* args)
     std::cout << request;
     pthread_mutex_unlock(&mut);
 
+    requestsServed++;
+
     std::string requestedFile;
     std::string response;
+    bool requestOK = checkRequest(request, requestedFile);
+
+    if(requestOK && proxyCache != nullptr && requestedFile.compare(0, 7, "http://") == 0)
+    {
+        serveProxied(sd, request, requestedFile.substr(7));
+
+        closeClient(sd);
+        delete ((int*)args);
+        return nullptr;
+    }
 
-    if(!checkRequest(request, requestedFile))
+    if(!requestOK)
     {
         response = "HTTP/1.0 400 Bad Request\r\n\r\n";
         response += "<html><body><center><h1>Bad Request</h1></center>";
@@ -170,6 +260,11 @@ void* handleClient(void* args)
         response += "<center><p>Welcome to the website. It's a cool place to be.</p></center>";
         response +="</body></html>";
     }
+    else if (requestedFile == "/stats")
+    {
+        response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain\r\n\r\n";
+        response += statsPage();
+    }
     else if (requestedFile == "/admin.html")
     {
         response = "HTTP/1.0 401 UNAUTHORIZED\r\n\r\n";
@@ -226,8 +321,9 @@ void* handleClient(void* args)
 
     write(sd, response.c_str(), response.length());
 
-    close(sd);
+    closeClient(sd);
     delete ((int*)args);
+    return nullptr;
 }
 
 bool checkRequest(std::string request, std::string& outfile)
@@ -248,4 +344,198 @@ bool checkRequest(std::string request, std::string& outfile)
         return false;
 
     return true;
-}
\ No newline at end of file
+}
+
+/**
+ * Answer a proxy request for url (an absolute URI with the "http://" removed)
+ * from the cache, fetching it from the origin on a miss.
+ */
+void serveProxied(int sd, const std::string& request, const std::string& url)
+{
+    ObjectCache::Outcome outcome;
+    ObjectPtr object = proxyCache->get(url, [&]() { return fetchFromOrigin(url); },
+                                       wantsFreshCopy(request), outcome);
+
+    if(object == nullptr)
+    {
+        std::string body = "<html><body><center><h1>Bad Gateway</h1></center>";
+        body += "<center><p>The origin server could not be reached.</p></center>";
+        body += "</body></html>";
+
+        writeAll(sd, "HTTP/1.0 502 Bad Gateway\r\nContent-Length: " +
+                     std::to_string(body.length()) + "\r\n\r\n", body);
+        return;
+    }
+
+    static const char* outcomes[] = {"HIT", "MISS", "COALESCED"};
+    long long age = (ObjectCache::nowMs() - object->storedAt) / 1000;
+
+    std::string head = "HTTP/1.0 " + std::to_string(object->status) + " " + object->reason + "\r\n";
+    head += object->headers;
+    head += "Content-Length: " + std::to_string(object->body.length()) + "\r\n";
+    head += "Age: " + std::to_string(age) + "\r\n";
+    head += "X-Cache: " + std::string(outcomes[outcome]) + "\r\n";
+    head += "\r\n";
+
+    writeAll(sd, head, object->body);
+}
+
+/**
+ * Fetch url from its origin server using the same code as the retriever.
+ *
+ * Returns nullptr if no complete response could be had.
+ */
+ObjectPtr fetchFromOrigin(const std::string& url)
+{
+    std::string server, port, file;
+    parseURL(url, server, port, file);
+
+    int originSd = connectToHost(server, port);
+    if(originSd < 0)
+        return nullptr;
+
+    std::string request = "GET /" + file + " HTTP/1.1\r\n";
+    request += "Host: " + server + (port == "80" ? "" : ":" + port) + "\r\n";
+    request += "Connection: close\r\n";
+    request += "\r\n";
+
+    ResponseParser parser;
+    std::string body;
+    long long result = -1;
+    if(sendRequest(originSd, request))
+    {
+        result = readResponse(originSd, parser, [&](const char* data, std::size_t length)
+                                                {
+                                                    body.append(data, length);
+                                                });
+    }
+    close(originSd);
+
+    if(result <= 0 || !parser.isDone())
+        return nullptr;
+
+    return ObjectCache::fromResponse(parser, body);
+}
+
+/**
+ * A client can ask us to skip the cache with Cache-Control: no-cache or the
+ * older Pragma: no-cache.
+ */
+bool wantsFreshCopy(const std::string& request)
+{
+    std::string lower = request;
+    for(std::size_t i = 0; i < lower.length(); i++)
+        lower[i] = std::tolower((unsigned char)lower[i]);
+
+    std::istringstream instream(lower);
+    for(std::string line; std::getline(instream, line);)
+    {
+        if((line.compare(0, 14, "cache-control:") == 0 || line.compare(0, 7, "pragma:") == 0) &&
+           line.find("no-cache") != std::string::npos)
+            return true;
+    }
+
+    return false;
+}
+
+std::string statsPage()
+{
+    std::ostringstream page;
+    page << "requests: " << requestsServed << "\n";
+
+    if(proxyCache != nullptr)
+    {
+        CacheStats stats = proxyCache->stats();
+        page << "cache hits: " << stats.hits << "\n";
+        page << "cache misses: " << stats.misses << "\n";
+        page << "cache coalesced: " << stats.coalesced << "\n";
+        page << "cache stores: " << stats.stores << "\n";
+        page << "cache evictions: " << stats.evictions << "\n";
+        page << "cache expirations: " << stats.expirations << "\n";
+        page << "cache objects: " << stats.objects << "\n";
+        page << "cache bytes: " << stats.bytes << "\n";
+    }
+
+    pthread_mutex_lock(&tcpMut);
+    TcpTotals tcp = tcpTotals;
+    pthread_mutex_unlock(&tcpMut);
+
+    page << "tcp connections: " << tcp.connections << "\n";
+    if(tcp.connections > 0)
+    {
+        page << "tcp rtt avg (us): " << tcp.rttUs / tcp.connections << "\n";
+        page << "tcp rtt max (us): " << tcp.maxRttUs << "\n";
+        page << "tcp retransmits: " << tcp.retransmits << "\n";
+        page << "tcp busy (us): " << tcp.busyUs << "\n";
+        page << "tcp rwnd limited (us): " << tcp.rwndLimitedUs << "\n";
+        page << "tcp sndbuf limited (us): " << tcp.sndbufLimitedUs << "\n";
+        for(int i = 0; i < TCP_LIMITS; i++)
+            page << "tcp limit " << tcpLimitName((TcpLimit)i) << ": " << tcp.limits[i] << "\n";
+    }
+
+    return page.str();
+}
+
+/**
+ * Writes head followed by body with as few system calls as possible.
+ *
+ * Returns false if the client went away first.
+ */
+bool writeAll(int sd, const std::string& head, const std::string& body)
+{
+    iovec vect[2];
+    vect[0].iov_base = (void*)head.data();
+    vect[0].iov_len = head.length();
+    vect[1].iov_base = (void*)body.data();
+    vect[1].iov_len = body.length();
+
+    iovec* next = vect;
+    int count = 2;
+    while(count > 0)
+    {
+        ssize_t written = writev(sd, next, count);
+        if(written < 0 && errno == EINTR)
+            continue;
+        if(written < 0)
+            return false;
+
+        while(count > 0 && (std::size_t)written >= next->iov_len)
+        {
+            written -= next->iov_len;
+            next++;
+            count--;
+        }
+        if(count > 0)
+        {
+            next->iov_base = (char*)next->iov_base + written;
+            next->iov_len -= written;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Closes a client connection, adding what TCP_INFO says about it to the
+ * totals on the stats page first.
+ */
+void closeClient(int sd)
+{
+    TcpSample sample;
+    if(sampleTcpInfo(sd, sample))
+    {
+        pthread_mutex_lock(&tcpMut);
+        tcpTotals.connections++;
+        tcpTotals.rttUs += sample.rttUs;
+        if(sample.rttUs > tcpTotals.maxRttUs)
+            tcpTotals.maxRttUs = sample.rttUs;
+        tcpTotals.retransmits += sample.retransmits;
+        tcpTotals.busyUs += sample.busyUs;
+        tcpTotals.rwndLimitedUs += sample.rwndLimitedUs;
+        tcpTotals.sndbufLimitedUs += sample.sndbufLimitedUs;
+        tcpTotals.limits[tcpLimit(sample)]++;
+        pthread_mutex_unlock(&tcpMut);
+    }
+
+    close(sd);
+}
@@ -0,0 +1,215 @@
+/*
+ * Description:
+ * Affinity.cpp implements CPU pinning and the sysfs and procfs lookups behind
+ * "irq:<interface>".
+ *
+ * It is intended to be part of an introduction in network programming.
+ */
+#include "Affinity.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+#include <dirent.h>
+
+//forward declarations
+static bool parseCpuList(const std::string& list, std::vector<int>& cpus);
+static std::string readLine(const std::string& path);
+static std::vector<int> interfaceIrqs(const std::string& interface);
+static int interfaceNode(const std::string& interface);
+static std::vector<int> nodeCpus(int node);
+
+bool resolveCpus(const std::string& spec, std::vector<int>& cpus)
+{
+    cpus.clear();
+
+    if (spec.compare(0, 4, "irq:") != 0)
+    {
+        if (!parseCpuList(spec, cpus) || cpus.empty())
+        {
+            std::cerr << "Error: " << spec << " isn't a list of CPUs." << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    std::string interface = spec.substr(4);
+    std::vector<int> irqs = interfaceIrqs(interface);
+    if (irqs.empty())
+    {
+        std::cerr << "Error: Could not find the interrupts of " << interface << "." << std::endl;
+        return false;
+    }
+
+    //where the kernel currently steers those interrupts
+    std::vector<int> irqCpus;
+    for (std::size_t i = 0; i < irqs.size(); i++)
+    {
+        std::ostringstream path;
+        path << "/proc/irq/" << irqs[i] << "/smp_affinity_list";
+        std::vector<int> affinity;
+        if (parseCpuList(readLine(path.str()), affinity))
+            irqCpus.insert(irqCpus.end(), affinity.begin(), affinity.end());
+    }
+    std::sort(irqCpus.begin(), irqCpus.end());
+    irqCpus.erase(std::unique(irqCpus.begin(), irqCpus.end()), irqCpus.end());
+
+    //a device with no node of its own is treated as being on node 0
+    int node = interfaceNode(interface);
+    std::vector<int> candidates = nodeCpus(node < 0 ? 0 : node);
+
+    for (std::size_t i = 0; i < candidates.size(); i++)
+    {
+        if (!std::binary_search(irqCpus.begin(), irqCpus.end(), candidates[i]))
+            cpus.push_back(candidates[i]);
+    }
+    if (cpus.empty())
+        cpus = irqCpus;
+    if (cpus.empty())
+        cpus = candidates;
+
+    std::cout << "irq cpus of " << interface << " = " << formatCpus(irqCpus);
+    std::cout << ", node = " << node << ", using cpus = " << formatCpus(cpus) << std::endl;
+    return !cpus.empty();
+}
+
+bool pinThread(int cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+
+    int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (error != 0)
+    {
+        std::cerr << "Error: Could not pin to cpu " << cpu << ": " << strerror(error) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int cpuNode(int cpu)
+{
+    //cpuN has a nodeM link in it for the node it belongs to
+    std::ostringstream path;
+    path << "/sys/devices/system/cpu/cpu" << cpu;
+
+    DIR* dir = opendir(path.str().c_str());
+    if (dir == nullptr)
+        return -1;
+
+    int node = -1;
+    while (dirent* entry = readdir(dir))
+    {
+        if (std::strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9')
+            node = std::atoi(entry->d_name + 4);
+    }
+    closedir(dir);
+    return node;
+}
+
+std::string formatCpus(const std::vector<int>& cpus)
+{
+    std::ostringstream out;
+    for (std::size_t i = 0; i < cpus.size(); i++)
+        out << (i > 0 ? "," : "") << cpus[i];
+    return out.str();
+}
+
+/*
+ * Parses the kernel's list format, "0-3,8,10-11".
+ */
+static bool parseCpuList(const std::string& list, std::vector<int>& cpus)
+{
+    std::istringstream in(list);
+    std::string range;
+    while (std::getline(in, range, ','))
+    {
+        int first, last;
+        char dash;
+        std::istringstream parts(range);
+        if (!(parts >> first))
+            return false;
+        last = first;
+        if (parts >> dash && (dash != '-' || !(parts >> last)))
+            return false;
+        if (first < 0 || last < first)
+            return false;
+
+        for (int cpu = first; cpu <= last; cpu++)
+            cpus.push_back(cpu);
+    }
+    return true;
+}
+
+static std::string readLine(const std::string& path)
+{
+    std::ifstream file(path.c_str());
+    std::string line;
+    std::getline(file, line);
+    return line;
+}
+
+/*
+ * PCI network cards list their MSI interrupts in msi_irqs. Virtual ones sit
+ * below the PCI device that owns the interrupts, so its parent is tried too,
+ * and failing both, /proc/interrupts is searched for the interface's name.
+ */
+static std::vector<int> interfaceIrqs(const std::string& interface)
+{
+    std::vector<int> irqs;
+    std::string device = "/sys/class/net/" + interface + "/device";
+    const char* places[] = {"/msi_irqs", "/../msi_irqs"};
+
+    for (int i = 0; i < 2 && irqs.empty(); i++)
+    {
+        DIR* dir = opendir((device + places[i]).c_str());
+        if (dir == nullptr)
+            continue;
+
+        while (dirent* entry = readdir(dir))
+        {
+            if (entry->d_name[0] >= '0' && entry->d_name[0] <= '9')
+                irqs.push_back(std::atoi(entry->d_name));
+        }
+        closedir(dir);
+    }
+
+    if (irqs.empty())
+    {
+        std::ifstream interrupts("/proc/interrupts");
+        std::string line;
+        while (std::getline(interrupts, line))
+        {
+            if (line.find(interface) != std::string::npos)
+                irqs.push_back(std::atoi(line.c_str()));
+        }
+    }
+
+    std::sort(irqs.begin(), irqs.end());
+    return irqs;
+}
+
+static int interfaceNode(const std::string& interface)
+{
+    std::string device = "/sys/class/net/" + interface + "/device";
+    std::string node = readLine(device + "/numa_node");
+    if (node.empty())
+        node = readLine(device + "/../numa_node");
+    return node.empty() ? -1 : std::atoi(node.c_str());
+}
+
+static std::vector<int> nodeCpus(int node)
+{
+    std::ostringstream path;
+    path << "/sys/devices/system/node/node" << node << "/cpulist";
+
+    std::vector<int> cpus;
+    std::string list = readLine(path.str());
+    if (list.empty() || !parseCpuList(list, cpus))
+        parseCpuList(readLine("/sys/devices/system/cpu/online"), cpus);
+    return cpus;
+}
@@ -0,0 +1,48 @@
+/*
+ * Description:
+ * Affinity.h declares helpers for pinning the benchmark's threads to CPUs.
+ * Left alone, the scheduler moves threads between cores (and the data they
+ * touch between caches) from one run to the next, which shows up as noise in
+ * the results.
+ *
+ * CPUs are given as a list like "2,4-7", or as "irq:eth0" to pick the CPUs
+ * next to the ones that handle eth0's interrupts: those on the same NUMA
+ * node, but not the interrupt CPUs themselves, so the benchmark and the
+ * network stack share a memory controller and last level cache without
+ * fighting over a core. If that leaves nothing (a single core machine), the
+ * interrupt CPUs are used.
+ *
+ * It is intended to be part of an introduction in network programming.
+ */
+#ifndef _AFFINITY_H_
+#define _AFFINITY_H_
+
+#include <string>
+#include <vector>
+
+/**
+ * Turns a CPU list or "irq:<interface>" into CPU numbers, printing what it
+ * picked for the irq form.
+ *
+ * Returns false, after printing why, if the spec can't be used.
+ */
+bool resolveCpus(const std::string& spec, std::vector<int>& cpus);
+
+/**
+ * Pins the calling thread to one CPU.
+ *
+ * Returns false, after printing why, if the CPU isn't available.
+ */
+bool pinThread(int cpu);
+
+/**
+ * The NUMA node a CPU belongs to, or -1 if the machine doesn't say.
+ */
+int cpuNode(int cpu);
+
+/**
+ * Formats CPU numbers as a comma separated list, for printing.
+ */
+std::string formatCpus(const std::vector<int>& cpus);
+
+#endif
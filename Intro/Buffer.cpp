@@ -0,0 +1,115 @@
+/*
+ * Description:
+ * Buffer.cpp implements the huge page backed send buffer.
+ *
+ * It is intended to be part of an introduction in network programming.
+ */
+#include "Buffer.h"
+#include <iostream>
+#include <cstdio>
+#include <vector>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+//libnuma isn't needed for a single mbind()
+static bool bindToNode(void* memory, size_t size, int node);
+
+Buffer::Buffer(size_t size, int node)
+{
+    mapping = start = nullptr;
+    mappedSize = length = size;
+    kind = "4k";
+    boundNode = -1;
+
+    if (size >= HUGE_PAGE_SIZE)
+    {
+        mappedSize = (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+        void* memory = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (memory != MAP_FAILED)
+        {
+            mapping = start = (uint8_t*)memory;
+            kind = "hugetlb";
+        }
+        else
+        {
+            //map an extra huge page so the start can be moved onto a boundary
+            mappedSize += HUGE_PAGE_SIZE;
+            memory = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (memory != MAP_FAILED)
+            {
+                mapping = (uint8_t*)memory;
+                uintptr_t aligned = ((uintptr_t)mapping + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1);
+                start = (uint8_t*)aligned;
+                if (madvise(start, mappedSize - HUGE_PAGE_SIZE, MADV_HUGEPAGE) == 0)
+                    kind = "thp";
+            }
+        }
+    }
+    else
+    {
+        void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory != MAP_FAILED)
+            mapping = start = (uint8_t*)memory;
+    }
+
+    if (start == nullptr)
+    {
+        mapping = nullptr;
+        return;
+    }
+
+    //the policy has to be in place before the first touch allocates the pages
+    if (node >= 0 && bindToNode(mapping, mappedSize, node))
+        boundNode = node;
+
+    //fault every page in now, rather than during the test
+    for (size_t i = 0; i < length; i++)
+        start[i] = (uint8_t)i;
+}
+
+Buffer::~Buffer()
+{
+    if (mapping != nullptr)
+        munmap(mapping, mappedSize);
+}
+
+uint8_t* Buffer::data() const
+{
+    return start;
+}
+
+size_t Buffer::size() const
+{
+    return length;
+}
+
+const char* Buffer::backing() const
+{
+    return kind;
+}
+
+int Buffer::node() const
+{
+    return boundNode;
+}
+
+static bool bindToNode(void* memory, size_t size, int node)
+{
+    const int bits = 8 * sizeof(unsigned long);
+    std::vector<unsigned long> mask(node / bits + 1, 0);
+    mask[node / bits] = 1UL << (node % bits);
+
+    //maxnode counts one past the highest node the kernel should look at
+    if (syscall(SYS_mbind, memory, size, MPOL_BIND, mask.data(), node + 2, 0) < 0)
+    {
+        perror("mbind error");
+        std::cerr << "Warning: the buffer isn't bound to node " << node << "." << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,70 @@
+/*
+ * Description:
+ * Buffer.h declares the memory the benchmark sends from. Large buffers are
+ * backed by huge pages when the machine has them, which saves the kernel from
+ * walking (and the TLB from caching) hundreds of thousands of 4KB pages when
+ * a message is gigabytes long.
+ *
+ * Explicit huge pages (MAP_HUGETLB) are tried first. They have to be
+ * reserved ahead of time in /proc/sys/vm/nr_hugepages, so if there are none
+ * the buffer is aligned to a huge page and transparent huge pages are asked
+ * for with madvise() instead. Small buffers just get ordinary pages.
+ *
+ * On a machine with several NUMA nodes, the buffer can be bound to the node
+ * of the CPU that sends from it, so every byte isn't fetched across the
+ * interconnect.
+ *
+ * It is intended to be part of an introduction in network programming.
+ */
+#ifndef _BUFFER_H_
+#define _BUFFER_H_
+
+#include <cstddef>
+#include <cstdint>
+
+class Buffer
+{
+public:
+    enum
+    {
+        HUGE_PAGE_SIZE = 2 * 1024 * 1024
+    };
+
+    /**
+     * Maps size bytes, page aligned, and touches every page so that page
+     * faults aren't timed later. The contents are a repeating byte pattern.
+     * If node isn't -1, the pages are bound to that NUMA node before they are
+     * touched.
+     *
+     * data() is null if the memory couldn't be mapped.
+     */
+    explicit Buffer(size_t size, int node = -1);
+    ~Buffer();
+
+    uint8_t* data() const;
+    size_t size() const;
+
+    /**
+     * How the buffer is backed: "hugetlb", "thp" or "4k".
+     */
+    const char* backing() const;
+
+    /**
+     * The NUMA node the buffer is bound to, or -1 if it isn't.
+     */
+    int node() const;
+
+private:
+    //not copyable, it owns the mapping
+    Buffer(const Buffer&);
+    Buffer& operator=(const Buffer&);
+
+    uint8_t* mapping;
+    size_t mappedSize;
+    uint8_t* start;
+    size_t length;
+    const char* kind;
+    int boundNode;
+};
+
+#endif
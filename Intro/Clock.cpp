@@ -0,0 +1,71 @@
+/*
+ * Description:
+ * Clock.cpp implements the benchmark clock declared in Clock.h.
+ *
+ * It is intended to be part of an introduction in network programming.
+ */
+#include "Clock.h"
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#include <cpuid.h>
+#define HAVE_TSC 1
+#endif
+
+enum
+{
+    CALIBRATION_NS = 50000000
+};
+
+static bool tscEnabled = false;
+static uint64_t baseTicks = 0;
+static uint64_t baseNs = 0;
+static double nsPerTick = 0;
+
+uint64_t Clock::now()
+{
+#ifdef HAVE_TSC
+    if (tscEnabled)
+        return baseNs + (uint64_t)((__rdtsc() - baseTicks) * nsPerTick);
+#endif
+    return monotonicNow();
+}
+
+bool Clock::useTsc()
+{
+#ifdef HAVE_TSC
+    //CPUID 0x80000007 EDX bit 8 says the TSC ticks at a constant rate in every
+    //power state, which is what makes it usable as a clock
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) || !(edx & (1 << 8)))
+        return false;
+
+    uint64_t startNs = monotonicNow();
+    uint64_t startTicks = __rdtsc();
+    while (monotonicNow() - startNs < CALIBRATION_NS)
+        ;
+    uint64_t endNs = monotonicNow();
+    uint64_t endTicks = __rdtsc();
+
+    nsPerTick = (double)(endNs - startNs) / (double)(endTicks - startTicks);
+    baseNs = endNs;
+    baseTicks = endTicks;
+    tscEnabled = true;
+    return true;
+#else
+    return false;
+#endif
+}
+
+const char* Clock::source()
+{
+    return tscEnabled ? "tsc" : "monotonic";
+}
+
+uint64_t Clock::monotonicNow()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec*1000000000ULL + now.tv_nsec;
+}
@@ -0,0 +1,41 @@
+/*
+ * Description:
+ * Clock.h declares the clock used to time the Intro benchmark. It reads
+ * CLOCK_MONOTONIC in nanoseconds, which unlike gettimeofday() never jumps
+ * when NTP adjusts the wall clock. On x86 machines with an invariant TSC it
+ * can optionally read the TSC instead, after calibrating it against
+ * CLOCK_MONOTONIC, which makes timing a single system call cheaper still.
+ *
+ * It is intended to be part of an introduction in network programming.
+ */
+#ifndef _CLOCK_H_
+#define _CLOCK_H_
+
+#include <cstdint>
+
+class Clock
+{
+public:
+    /**
+     * Nanoseconds since an arbitrary fixed point in the past.
+     */
+    static uint64_t now();
+
+    /**
+     * Switch to reading the TSC. Takes about 50ms to calibrate.
+     *
+     * Returns false (and keeps using CLOCK_MONOTONIC) if this machine doesn't
+     * have an invariant TSC.
+     */
+    static bool useTsc();
+
+    /**
+     * Names the clock in use, for printing alongside results.
+     */
+    static const char* source();
+
+private:
+    static uint64_t monotonicNow();
+};
+
+#endif
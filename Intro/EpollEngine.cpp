@@ -0,0 +1,239 @@
+/*
+ * Description:
+ * EpollEngine.cpp implements the epoll server engine. A single thread waits
+ * on every client with edge-triggered epoll and reads each readable socket
+ * until it would block, so the number of read calls it makes can be compared
+ * with the blocking thread-per-client engine. Ping-pong replies are written
+ * the same way, and a client isn't read from while its reply is stuck.
+ *
+ * It is intended to be part of an introduction in network programming.
+ */
+#include "ServerEngine.h"
+#include "Clock.h"
+#include <iostream>
+#include <cerrno>
+#include <cstdio>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+
+enum
+{
+    MAX_EVENTS = 64
+};
+
+/*
+ * A client being served by the event loop.
+ */
+struct EpollClient
+{
+    int sd;
+    int headerRead;     //bytes of the TestHeader read so far
+    bool started;       //whether the whole header has arrived
+    uint64_t replyLeft; //ping-pong reply bytes still to write
+    ReceiveStats stats;
+    uint8_t databuf[ENGINE_BUFSIZE];
+};
+
+//forward declarations
+static void acceptClients(int epollFd, int serverSd);
+static bool readHeader(EpollClient* client);
+static bool readClient(EpollClient* client);
+static int flushReply(EpollClient* client);
+static void finishClient(int epollFd, EpollClient* client);
+
+void runEpollEngine(int serverSd)
+{
+    int epollFd = epoll_create1(0);
+    if (epollFd < 0)
+    {
+        perror("epoll error");
+        return;
+    }
+
+    fcntl(serverSd, F_SETFL, fcntl(serverSd, F_GETFL, 0) | O_NONBLOCK);
+
+    //the listening socket is the only one registered without a client
+    epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = nullptr;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, serverSd, &event);
+
+    epoll_event events[MAX_EVENTS];
+    while (true)
+    {
+        int ready = epoll_wait(epollFd, events, MAX_EVENTS, -1);
+        if (ready < 0 && errno == EINTR)
+            continue;
+        if (ready < 0)
+        {
+            perror("epoll error");
+            return;
+        }
+
+        for (int i = 0; i < ready; i++)
+        {
+            EpollClient* client = (EpollClient*)events[i].data.ptr;
+            if (client == nullptr)
+            {
+                acceptClients(epollFd, serverSd);
+                continue;
+            }
+
+            client->stats.wakeups++;
+            if (readClient(client) || (events[i].events & (EPOLLHUP | EPOLLERR)))
+                finishClient(epollFd, client);
+        }
+    }
+}
+
+static void acceptClients(int epollFd, int serverSd)
+{
+    while (true)
+    {
+        int newSd = accept4(serverSd, nullptr, nullptr, SOCK_NONBLOCK);
+        if (newSd < 0)
+            return;
+
+        std::cout << "New client connected." << std::endl;
+
+        EpollClient* client = new EpollClient;
+        client->sd = newSd;
+        client->headerRead = 0;
+        client->started = false;
+        client->replyLeft = 0;
+
+        //edge-triggered, so each wakeup has to drain the socket (or fill it)
+        epoll_event event;
+        event.events = EPOLLIN | EPOLLOUT | EPOLLET | EPOLLRDHUP;
+        event.data.ptr = client;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, newSd, &event);
+    }
+}
+
+/*
+ * Read as much of the client's TestHeader as has arrived, into the start of
+ * its buffer.
+ *
+ * Returns true once the header is complete. The client is started then, or
+ * left unstarted if the header was bad or the client went away.
+ */
+static bool readHeader(EpollClient* client)
+{
+    while (client->headerRead < HEADER_SIZE)
+    {
+        int bytes = read(client->sd, &client->databuf[client->headerRead], HEADER_SIZE - client->headerRead);
+        if (bytes < 0 && errno == EINTR)
+            continue;
+        if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return false;
+        if (bytes <= 0)
+            return true;
+
+        client->headerRead += bytes;
+    }
+
+    TestHeader header;
+    if (decodeHeader(client->databuf, header))
+    {
+        startReceive(client->stats, header, client->sd);
+        client->started = true;
+    }
+    return true;
+}
+
+/*
+ * Read everything that is available from the client.
+ *
+ * Returns true once the client has sent all of its messages (or gone away).
+ */
+static bool readClient(EpollClient* client)
+{
+    ReceiveStats& stats = client->stats;
+
+    if (!client->started)
+    {
+        if (!readHeader(client))
+            return false;
+        if (!client->started)
+            return true;
+    }
+
+    size_t position, size;
+    while (true)
+    {
+        int flushed = flushReply(client);
+        if (flushed < 0)
+            return true;
+        if (flushed == 0)
+            return false;
+
+        size = nextRead(stats, ENGINE_BUFSIZE, position);
+        if (size == 0)
+            return true;
+
+        uint64_t before = Clock::now();
+        int bytes = read(client->sd, &client->databuf[position], size);
+        stats.readLatency.record(Clock::now() - before);
+        stats.reads++;
+
+        if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            stats.wouldBlock++;
+            return false;
+        }
+        if (bytes < 0 && errno == EINTR)
+            continue;
+        //the end of a duration run, or the client went away early
+        if (bytes <= 0)
+            return true;
+
+        recordRead(stats, bytes);
+        client->replyLeft += replyOwed(stats, bytes);
+    }
+}
+
+/*
+ * Writes as much of the pending ping-pong reply as the socket will take.
+ *
+ * Returns 1 once nothing is pending, 0 if the socket is full and -1 if the
+ * connection failed.
+ */
+static int flushReply(EpollClient* client)
+{
+    while (client->replyLeft > 0)
+    {
+        size_t size = client->replyLeft < ENGINE_BUFSIZE ? client->replyLeft : ENGINE_BUFSIZE;
+        int bytes = write(client->sd, client->databuf, size);
+        client->stats.writes++;
+
+        if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return 0;
+        if (bytes < 0 && errno == EINTR)
+            continue;
+        if (bytes <= 0)
+            return -1;
+
+        client->replyLeft -= bytes;
+    }
+
+    return 1;
+}
+
+static void finishClient(int epollFd, EpollClient* client)
+{
+    ReceiveStats& stats = client->stats;
+    endReceive(stats);
+
+    //four bytes always fit in an empty send buffer, so this won't block
+    if (client->started)
+    {
+        write(client->sd, &stats.reads, sizeof(stats.reads));
+        reportReceive("epoll", stats);
+    }
+
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, client->sd, nullptr);
+    close(client->sd);
+    delete client;
+}
@@ -0,0 +1,167 @@
+/*
+ * Description:
+ * Histogram.cpp implements the log-linear histogram declared in Histogram.h.
+ *
+ * It is intended to be part of an introduction in network programming.
+ */
+#include "Histogram.h"
+#include <iomanip>
+
+enum
+{
+    //values below SUB_BUCKETS get a bucket each, then every power of two from
+    //2^SUB_BUCKET_BITS up to 2^63 gets SUB_BUCKETS more
+    BUCKET_COUNT = (64 - Histogram::SUB_BUCKET_BITS + 1) * Histogram::SUB_BUCKETS
+};
+
+Histogram::Histogram() : counts(BUCKET_COUNT, 0)
+{
+    clear();
+}
+
+void Histogram::record(uint64_t value)
+{
+    counts[bucketFor(value)]++;
+    total++;
+    sum += value;
+    if (value < smallest)
+        smallest = value;
+    if (value > largest)
+        largest = value;
+}
+
+void Histogram::merge(const Histogram& other)
+{
+    for (std::size_t i = 0; i < counts.size(); i++)
+        counts[i] += other.counts[i];
+
+    total += other.total;
+    sum += other.sum;
+    if (other.smallest < smallest)
+        smallest = other.smallest;
+    if (other.largest > largest)
+        largest = other.largest;
+}
+
+void Histogram::clear()
+{
+    counts.assign(BUCKET_COUNT, 0);
+    total = 0;
+    smallest = UINT64_MAX;
+    largest = 0;
+    sum = 0;
+}
+
+uint64_t Histogram::count() const
+{
+    return total;
+}
+
+uint64_t Histogram::min() const
+{
+    return total == 0 ? 0 : smallest;
+}
+
+uint64_t Histogram::max() const
+{
+    return largest;
+}
+
+double Histogram::mean() const
+{
+    return total == 0 ? 0 : sum / total;
+}
+
+uint64_t Histogram::percentile(double percent) const
+{
+    if (total == 0)
+        return 0;
+
+    uint64_t target = (uint64_t)(percent / 100.0 * total + 0.5);
+    if (target < 1)
+        target = 1;
+
+    uint64_t seen = 0;
+    for (std::size_t i = 0; i < counts.size(); i++)
+    {
+        seen += counts[i];
+        if (seen >= target)
+        {
+            //report the top of the bucket, but never more than we really saw
+            uint64_t value = highestIn(i);
+            if (value > largest)
+                value = largest;
+            if (value < smallest)
+                value = smallest;
+            return value;
+        }
+    }
+
+    return largest;
+}
+
+void Histogram::printPercentiles(std::ostream& out, const std::string& label) const
+{
+    out << label << ": n=" << total;
+    out << " min=" << min();
+    out << " mean=" << (uint64_t)mean();
+    out << " p50=" << percentile(50);
+    out << " p90=" << percentile(90);
+    out << " p99=" << percentile(99);
+    out << " p99.9=" << percentile(99.9);
+    out << " max=" << max() << std::endl;
+}
+
+void Histogram::printDistribution(std::ostream& out, const std::string& label) const
+{
+    std::ios_base::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+
+    out << label << ":" << std::endl;
+    for (std::size_t i = 0; i < counts.size(); i++)
+    {
+        if (counts[i] == 0)
+            continue;
+
+        uint64_t low = lowestIn(i), high = highestIn(i);
+        out << "  ";
+        if (low == high)
+            out << low;
+        else
+            out << low << "-" << high;
+        out << ": " << counts[i] << " (" << std::fixed << std::setprecision(1)
+            << 100.0 * counts[i] / total << "%)" << std::endl;
+    }
+
+    out.flags(flags);
+    out.precision(precision);
+}
+
+std::size_t Histogram::bucketFor(uint64_t value)
+{
+    if (value < SUB_BUCKETS)
+        return value;
+
+    int exponent = 63 - __builtin_clzll(value);
+    std::size_t sub = (value >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+    return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub;
+}
+
+uint64_t Histogram::lowestIn(std::size_t bucket)
+{
+    if (bucket < SUB_BUCKETS)
+        return bucket;
+
+    int exponent = bucket / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+    uint64_t sub = bucket % SUB_BUCKETS;
+    return (1ULL << exponent) + (sub << (exponent - SUB_BUCKET_BITS));
+}
+
+uint64_t Histogram::highestIn(std::size_t bucket)
+{
+    if (bucket < SUB_BUCKETS)
+        return bucket;
+
+    int exponent = bucket / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+    return lowestIn(bucket) + (1ULL << (exponent - SUB_BUCKET_BITS)) - 1;
+}
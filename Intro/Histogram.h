@@ -0,0 +1,69 @@
+/*
+ * Description:
+ * Histogram.h declares a log-linear histogram for recording latencies and
+ * sizes. Every power of two is split into SUB_BUCKETS linear buckets, so any
+ * recorded value is known to within about 3% while the whole range of a
+ * uint64_t fits in a couple thousand counters. Recording is a couple of bit
+ * operations and an increment, cheap enough to do around every system call.
+ *
+ * It is intended to be part of an introduction in network programming.
+ */
+#ifndef _HISTOGRAM_H_
+#define _HISTOGRAM_H_
+
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <ostream>
+
+class Histogram
+{
+public:
+    enum
+    {
+        SUB_BUCKET_BITS = 5,
+        SUB_BUCKETS = 1 << SUB_BUCKET_BITS
+    };
+
+    Histogram();
+
+    void record(uint64_t value);
+    void merge(const Histogram& other);
+    void clear();
+
+    uint64_t count() const;
+    uint64_t min() const;
+    uint64_t max() const;
+    double mean() const;
+
+    /**
+     * The value below which the given percentage (0 to 100) of recorded values
+     * fall, to within the resolution of the bucket it lands in.
+     */
+    uint64_t percentile(double percent) const;
+
+    /**
+     * Print count, min, mean, the usual percentiles and max on one line,
+     * e.g. "write latency (ns): n=100 min=... p50=... p99=... max=...".
+     */
+    void printPercentiles(std::ostream& out, const std::string& label) const;
+
+    /**
+     * Print every non-empty bucket with its count and share of the total, one
+     * per line. Meant for things like read sizes that only take a few values.
+     */
+    void printDistribution(std::ostream& out, const std::string& label) const;
+
+private:
+    static std::size_t bucketFor(uint64_t value);
+    static uint64_t lowestIn(std::size_t bucket);
+    static uint64_t highestIn(std::size_t bucket);
+
+    std::vector<uint64_t> counts;
+    uint64_t total;
+    uint64_t smallest;
+    uint64_t largest;
+    double sum;
+};
+
+#endif
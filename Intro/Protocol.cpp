@@ -0,0 +1,102 @@
+/*
+ * Description:
+ * Protocol.cpp implements the test header shared by client.cpp and the
+ * server engines.
+ *
+ * It is intended to be part of an introduction in network programming.
+ */
+#include "Protocol.h"
+#include <iostream>
+#include <cstring>
+#include <endian.h>
+
+//fields in the order they are sent, with no padding
+static void put32(uint8_t*& out, uint32_t value)
+{
+    value = htobe32(value);
+    std::memcpy(out, &value, sizeof(value));
+    out += sizeof(value);
+}
+
+static void put64(uint8_t*& out, uint64_t value)
+{
+    value = htobe64(value);
+    std::memcpy(out, &value, sizeof(value));
+    out += sizeof(value);
+}
+
+static uint32_t get32(const uint8_t*& in)
+{
+    uint32_t value;
+    std::memcpy(&value, in, sizeof(value));
+    in += sizeof(value);
+    return be32toh(value);
+}
+
+static uint64_t get64(const uint8_t*& in)
+{
+    uint64_t value;
+    std::memcpy(&value, in, sizeof(value));
+    in += sizeof(value);
+    return be64toh(value);
+}
+
+bool writeHeader(Transport& transport, const TestHeader& header)
+{
+    uint8_t data[HEADER_SIZE];
+    uint8_t* out = data;
+    put32(out, header.magic);
+    put32(out, header.mode);
+    put64(out, header.messageSize);
+    put32(out, header.repetition);
+    put32(out, header.durationMs);
+    put32(out, header.intervalMs);
+    put64(out, header.replySize);
+
+    return sendAll(transport, data, HEADER_SIZE);
+}
+
+bool decodeHeader(const uint8_t* data, TestHeader& header)
+{
+    const uint8_t* in = data;
+    header.magic = get32(in);
+    header.mode = get32(in);
+    header.messageSize = get64(in);
+    header.repetition = get32(in);
+    header.durationMs = get32(in);
+    header.intervalMs = get32(in);
+    header.replySize = get64(in);
+
+    if (header.magic != PROTOCOL_MAGIC)
+    {
+        std::cerr << "Error: The client didn't send a test header." << std::endl;
+        return false;
+    }
+
+    if ((header.mode != MODE_REPETITION && header.mode != MODE_DURATION) || header.messageSize == 0)
+    {
+        std::cerr << "Error: The client sent a bad test header." << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool readHeader(Transport& transport, TestHeader& header)
+{
+    uint8_t data[HEADER_SIZE];
+    if (!receiveAll(transport, data, HEADER_SIZE))
+    {
+        std::cerr << "Error: The client closed before sending a test header." << std::endl;
+        return false;
+    }
+
+    return decodeHeader(data, header);
+}
+
+long long expectedBytes(const TestHeader& header)
+{
+    if (header.mode == MODE_DURATION)
+        return -1;
+    return (long long)header.messageSize * header.repetition;
+}
@@ -0,0 +1,67 @@
+/*
+ * Description:
+ * Protocol.h declares the header client.cpp sends on every connection before
+ * any data, so that the server knows what the test looks like instead of
+ * having to be started with matching arguments.
+ *
+ * In MODE_REPETITION the client sends repetition messages of messageSize
+ * bytes. In MODE_DURATION it keeps sending messages for durationMs and then
+ * shuts down its side of the connection. Either way the server replies with
+ * the number of read calls it made, as a 4 byte int.
+ *
+ * If replySize isn't 0 the test is a ping-pong: the server answers every
+ * message with replySize bytes as soon as the whole message has arrived.
+ *
+ * It is intended to be part of an introduction in network programming.
+ */
+#ifndef _PROTOCOL_H_
+#define _PROTOCOL_H_
+
+#include <cstdint>
+#include "Transport.h"
+
+enum
+{
+    PROTOCOL_MAGIC = 0x494e5452,    //"INTR"
+    MODE_REPETITION = 1,
+    MODE_DURATION = 2,
+    HEADER_SIZE = 36                //bytes on the wire
+};
+
+struct TestHeader
+{
+    uint32_t magic;
+    uint32_t mode;
+    uint64_t messageSize;
+    uint32_t repetition;
+    uint32_t durationMs;
+    uint32_t intervalMs;            //for the throughput time series
+    uint64_t replySize;             //echoed after every message, or 0
+};
+
+/**
+ * Sends the header in network byte order.
+ *
+ * Returns false if the connection failed.
+ */
+bool writeHeader(Transport& transport, const TestHeader& header);
+
+/**
+ * Decodes a header received in network byte order.
+ *
+ * Returns false, after printing why, if it isn't a header from client.cpp.
+ */
+bool decodeHeader(const uint8_t* data, TestHeader& header);
+
+/**
+ * Reads and decodes the header from a blocking transport.
+ */
+bool readHeader(Transport& transport, TestHeader& header);
+
+/**
+ * The number of bytes the client will send after the header, or -1 if it
+ * sends until it shuts down its side of the connection.
+ */
+long long expectedBytes(const TestHeader& header);
+
+#endif
@@ -0,0 +1,133 @@
+/*
+ * Description:
+ * ServerEngine.cpp holds the reporting shared by every server engine.
+ *
+ * It is intended to be part of an introduction in network programming.
+ */
+#include "ServerEngine.h"
+#include "Clock.h"
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <pthread.h>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+//because console output is not reentrant
+static pthread_mutex_t mut = PTHREAD_MUTEX_INITIALIZER;
+
+ReceiveStats::ReceiveStats()
+{
+    start = end = 0;
+    cpuStart = cpuEnd = 0;
+    reads = wouldBlock = wakeups = writes = 0;
+    bytes = 0;
+    std::memset(&header, 0, sizeof(header));
+}
+
+void startReceive(ReceiveStats& stats, const TestHeader& header, int sd)
+{
+    stats.header = header;
+    stats.start = Clock::now();
+    stats.cpuStart = threadCpuUsec();
+    stats.throughput.start(stats.start, header.intervalMs);
+    stats.threadStart = ThreadStats::sample();
+    stats.tcp.start(sd, stats.start, header.intervalMs);
+}
+
+void endReceive(ReceiveStats& stats)
+{
+    stats.end = Clock::now();
+    stats.cpuEnd = threadCpuUsec();
+    stats.threadEnd = ThreadStats::sample();
+    stats.tcp.finish();
+}
+
+void recordRead(ReceiveStats& stats, int bytes)
+{
+    stats.readSizes.record(bytes);
+    stats.bytes += bytes;
+    if (stats.header.mode == MODE_DURATION)
+    {
+        uint64_t now = Clock::now();
+        stats.throughput.record(now, bytes);
+        stats.tcp.poll(now);
+    }
+}
+
+size_t nextRead(const ReceiveStats& stats, size_t bufferSize, size_t& position)
+{
+    uint64_t messageSize = stats.header.messageSize;
+    uint64_t offset = stats.bytes % messageSize;
+    position = offset % bufferSize;
+
+    uint64_t size = messageSize - offset;
+    if (size > bufferSize - position)
+        size = bufferSize - position;
+
+    long long expected = expectedBytes(stats.header);
+    if (expected >= 0 && (uint64_t)(expected - stats.bytes) < size)
+        size = expected - stats.bytes;
+
+    return size;
+}
+
+uint64_t replyOwed(const ReceiveStats& stats, int bytes)
+{
+    uint64_t messageSize = stats.header.messageSize;
+    uint64_t completed = stats.bytes / messageSize - (stats.bytes - bytes) / messageSize;
+    return completed * stats.header.replySize;
+}
+
+bool writeReply(Transport& transport, const uint8_t* buffer, size_t bufferSize, uint64_t length,
+                ReceiveStats& stats)
+{
+    while (length > 0)
+    {
+        ssize_t bytes = transport.send(buffer, length < bufferSize ? length : bufferSize);
+        stats.writes++;
+        if (bytes < 0 && errno == EINTR)
+            continue;
+        if (bytes <= 0)
+            return false;
+        length -= bytes;
+    }
+    return true;
+}
+
+void reportReceive(const char* engine, const ReceiveStats& stats)
+{
+    long receiveTime = (stats.end - stats.start) / 1000;
+    long cpuTime = stats.cpuEnd - stats.cpuStart;
+
+    pthread_mutex_lock(&mut);
+    std::cout << "data-receiving time = "<< receiveTime <<"usec" << std::endl;
+    std::cout << "engine = " << engine << ", message size = " << stats.header.messageSize;
+    std::cout << ", bytes = " << stats.bytes << ", #reads = " << stats.reads;
+    std::cout << ", would-block reads = " << stats.wouldBlock;
+    std::cout << ", wakeups = " << stats.wakeups;
+    if (stats.header.replySize > 0)
+        std::cout << ", reply size = " << stats.header.replySize << ", #writes = " << stats.writes;
+    std::cout << ", cpu time = " << cpuTime << "usec";
+    if (stats.bytes > 0)
+        std::cout << " (" << cpuTime * 1000.0 / stats.bytes << " ns/byte)";
+    std::cout << std::endl;
+    if (ThreadStats::enabled())
+        ThreadStats::print(std::cout, "server thread", stats.threadStart, stats.threadEnd);
+    stats.readLatency.printPercentiles(std::cout, std::string("read latency (ns, ") + Clock::source() + ")");
+    stats.readSizes.printDistribution(std::cout, "read sizes (bytes)");
+    if (stats.header.mode == MODE_DURATION)
+        stats.throughput.print(std::cout, "receive throughput");
+    stats.tcp.print(std::cout, "server tcp", stats.header.mode == MODE_DURATION);
+    pthread_mutex_unlock(&mut);
+}
+
+long threadCpuUsec()
+{
+    rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000L +
+           usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
@@ -0,0 +1,116 @@
+/*
+ * Description:
+ * ServerEngine.h declares the different ways server.cpp can receive data.
+ * Every engine runs the same protocol (read the client's TestHeader, then its
+ * messages, echoing each one in a ping-pong test, then reply with the number
+ * of read calls it took; see Protocol.h)
+ * and reports through reportReceive(), so their results can be compared
+ * directly.
+ *
+ *   threads - a blocking thread per client (the original server)
+ *   epoll   - one thread, non-blocking sockets, edge-triggered epoll
+ *   uring   - one thread, io_uring reads into registered buffers
+ *
+ * It is intended to be part of an introduction in network programming.
+ */
+#ifndef _SERVERENGINE_H_
+#define _SERVERENGINE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include "Histogram.h"
+#include "TimeSeries.h"
+#include "Protocol.h"
+#include "ThreadStats.h"
+#include "TcpTrace.h"
+
+enum
+{
+    ENGINE_BUFSIZE = 64 * 1024,     //most a single read asks for
+    ALLOWED_CONNECTIONS = 16
+};
+
+/*
+ * What happened while receiving from one client.
+ */
+struct ReceiveStats
+{
+    uint64_t start;         //Clock::now() when the header was read
+    uint64_t end;           //Clock::now() when the last byte was read
+    long cpuStart;          //thread CPU time in usec at start
+    long cpuEnd;            //thread CPU time in usec at the end
+    int reads;              //read calls made, the number sent back as #reads
+    int wouldBlock;         //reads that found no data (non-blocking engines)
+    int wakeups;            //times the engine was woken up for this client
+    int writes;             //write calls made for ping-pong replies
+    long long bytes;
+    Histogram readLatency;
+    Histogram readSizes;
+    TestHeader header;      //what the client said it would send
+    TimeSeries throughput;  //only printed for MODE_DURATION
+    ThreadSample threadStart;   //the serving thread's counters at start
+    ThreadSample threadEnd;     //and at the end
+    TcpTrace tcp;           //the connection as TCP saw it, if it is TCP
+
+    ReceiveStats();
+};
+
+/*
+ * Starts the clocks once the client's header has been read from sd, the
+ * client's socket, or -1 if there isn't one.
+ */
+void startReceive(ReceiveStats& stats, const TestHeader& header, int sd);
+
+/*
+ * Stops the clocks once the client has sent everything, or gone away.
+ */
+void endReceive(ReceiveStats& stats);
+
+/*
+ * Counts a successful read. It's up to the caller to time it and to count
+ * every read call, successful or not, in stats.reads.
+ */
+void recordRead(ReceiveStats& stats, int bytes);
+
+/*
+ * Works out the next read for a client: where it goes in a buffer of
+ * bufferSize bytes, and how much to ask for, which is the rest of the current
+ * message or as much of it as fits.
+ *
+ * Returns 0 once the client has sent every byte it said it would.
+ */
+size_t nextRead(const ReceiveStats& stats, size_t bufferSize, size_t& position);
+
+/*
+ * The reply owed in a ping-pong test once a read of bytes has been recorded:
+ * replySize for every message the read completed.
+ */
+uint64_t replyOwed(const ReceiveStats& stats, int bytes);
+
+/*
+ * Writes a whole ping-pong reply over a blocking transport, reusing a buffer
+ * of bufferSize bytes as often as it takes. Counts the writes in stats.
+ *
+ * Returns false if the connection failed.
+ */
+bool writeReply(Transport& transport, const uint8_t* buffer, size_t bufferSize, uint64_t length,
+                ReceiveStats& stats);
+
+/*
+ * Print the results for one client. Safe to call from any thread.
+ */
+void reportReceive(const char* engine, const ReceiveStats& stats);
+
+/*
+ * CPU time used by the calling thread so far, in microseconds.
+ */
+long threadCpuUsec();
+
+/*
+ * Run an engine on an already listening socket. These only return if the
+ * engine could not be started.
+ */
+void runEpollEngine(int serverSd);
+void runUringEngine(int serverSd);
+
+#endif
@@ -0,0 +1,111 @@
+/*
+ * Description:
+ * SocketTuning.cpp implements the socket profiles shared by the client and
+ * the server.
+ *
+ * It is intended to be part of an introduction in network programming.
+ */
+#include "SocketTuning.h"
+#include <cstdio>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+SocketProfile::SocketProfile()
+{
+    name = "default";
+    rcvbuf = sndbuf = 0;
+    nodelay = quickack = false;
+}
+
+bool parseTuningOption(int& i, int argc, char* argv[], SocketProfile& profile)
+{
+    std::string option = argv[i];
+    bool hasValue = i+1 < argc;
+
+    if (option == "--profile" && hasValue)
+    {
+        std::string name = argv[++i];
+        profile = SocketProfile();
+        profile.name = name;
+
+        if (name == "latency")
+            profile.nodelay = profile.quickack = true;
+        else if (name == "throughput")
+            profile.rcvbuf = profile.sndbuf = 4 * 1024 * 1024;
+        else if (name == "small")
+            profile.rcvbuf = profile.sndbuf = 16 * 1024;
+        else if (name != "default")
+            throw std::invalid_argument(name);
+    }
+    else if (option == "--rcvbuf" && hasValue)
+        profile.rcvbuf = std::stoi(argv[++i]);
+    else if (option == "--sndbuf" && hasValue)
+        profile.sndbuf = std::stoi(argv[++i]);
+    else if (option == "--nodelay")
+        profile.nodelay = true;
+    else if (option == "--quickack")
+        profile.quickack = true;
+    else
+        return false;
+
+    return true;
+}
+
+/*
+ * The TCP options don't apply to Unix domain sockets.
+ */
+static bool isTcp(int sd)
+{
+    int protocol = 0;
+    socklen_t length = sizeof(protocol);
+    return getsockopt(sd, SOL_SOCKET, SO_PROTOCOL, &protocol, &length) == 0 && protocol == IPPROTO_TCP;
+}
+
+bool applyProfile(int sd, const SocketProfile& profile)
+{
+    const int on = 1;
+    bool ok = true;
+
+    if (profile.rcvbuf > 0 && setsockopt(sd, SOL_SOCKET, SO_RCVBUF, &profile.rcvbuf, sizeof(int)) < 0)
+    {
+        perror("SO_RCVBUF error");
+        ok = false;
+    }
+    if (profile.sndbuf > 0 && setsockopt(sd, SOL_SOCKET, SO_SNDBUF, &profile.sndbuf, sizeof(int)) < 0)
+    {
+        perror("SO_SNDBUF error");
+        ok = false;
+    }
+    if (profile.nodelay && isTcp(sd) && setsockopt(sd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)) < 0)
+    {
+        perror("TCP_NODELAY error");
+        ok = false;
+    }
+
+    rearmQuickAck(sd, profile);
+    return ok;
+}
+
+void rearmQuickAck(int sd, const SocketProfile& profile)
+{
+    const int on = 1;
+    if (profile.quickack && isTcp(sd))
+        setsockopt(sd, IPPROTO_TCP, TCP_QUICKACK, &on, sizeof(on));
+}
+
+void printProfile(std::ostream& out, int sd, const SocketProfile& profile)
+{
+    int rcvbuf = 0, sndbuf = 0;
+    socklen_t length = sizeof(int);
+    getsockopt(sd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, &length);
+    length = sizeof(int);
+    getsockopt(sd, SOL_SOCKET, SO_SNDBUF, &sndbuf, &length);
+
+    out << "socket profile = " << profile.name;
+    out << ", rcvbuf = " << rcvbuf << (profile.rcvbuf > 0 ? "" : " (auto)");
+    out << ", sndbuf = " << sndbuf << (profile.sndbuf > 0 ? "" : " (auto)");
+    out << ", nodelay = " << profile.nodelay;
+    out << ", quickack = " << profile.quickack << std::endl;
+}
@@ -0,0 +1,64 @@
+/*
+ * Description:
+ * SocketTuning.h declares the socket profiles that client.cpp and server.cpp
+ * can both apply to their connections, so a test can be repeated with the
+ * same buffer sizes and TCP options on each end.
+ *
+ *   default    - leave everything to the kernel (buffers are autotuned)
+ *   latency    - TCP_NODELAY, and TCP_QUICKACK re-armed after every read
+ *   throughput - 4MB send and receive buffers
+ *   small      - 16KB send and receive buffers, to see a window limit
+ *
+ * A profile can be picked with --profile and then changed with --rcvbuf,
+ * --sndbuf, --nodelay and --quickack.
+ *
+ * It is intended to be part of an introduction in network programming.
+ */
+#ifndef _SOCKETTUNING_H_
+#define _SOCKETTUNING_H_
+
+#include <string>
+#include <ostream>
+
+struct SocketProfile
+{
+    std::string name;
+    int rcvbuf;         //SO_RCVBUF in bytes, 0 leaves it autotuned
+    int sndbuf;         //SO_SNDBUF in bytes, 0 leaves it autotuned
+    bool nodelay;       //TCP_NODELAY
+    bool quickack;      //TCP_QUICKACK, which the kernel clears as it goes
+
+    SocketProfile();
+};
+
+/**
+ * Handles one of the tuning options at argv[i], moving i past its value.
+ *
+ * Returns false if argv[i] isn't a tuning option. Throws
+ * std::invalid_argument for an unknown profile, like std::stoi does for a bad
+ * number.
+ */
+bool parseTuningOption(int& i, int argc, char* argv[], SocketProfile& profile);
+
+/**
+ * Applies the profile to a socket. Buffer sizes only affect the TCP window
+ * scale if they are set before the connection is made, so a listening socket
+ * should be tuned before listen() (accepted sockets inherit it).
+ *
+ * Returns false, after printing why, if the kernel refused an option.
+ */
+bool applyProfile(int sd, const SocketProfile& profile);
+
+/**
+ * Sets TCP_QUICKACK again if the profile asks for it. The kernel drops back
+ * to delayed ACKs on its own, so this belongs after every read.
+ */
+void rearmQuickAck(int sd, const SocketProfile& profile);
+
+/**
+ * Prints the profile along with the buffer sizes the kernel actually chose
+ * for the socket (it doubles what it is asked for).
+ */
+void printProfile(std::ostream& out, int sd, const SocketProfile& profile);
+
+#endif
@@ -0,0 +1,80 @@
+/*
+ * Description:
+ * TcpTrace.cpp implements the TCP_INFO trace declared in TcpTrace.h.
+ *
+ * It is intended to be part of an introduction in network programming.
+ */
+#include "TcpTrace.h"
+#include "TimeSeries.h"
+#include <cstring>
+
+TcpTrace::TcpTrace()
+{
+    sd = -1;
+    traced = false;
+    origin = 0;
+    interval = TimeSeries::DEFAULT_INTERVAL_MS * 1000000ULL;
+    next = UINT64_MAX;
+    std::memset(&final, 0, sizeof(final));
+}
+
+void TcpTrace::start(int sd, uint64_t now, uint32_t intervalMs)
+{
+    this->sd = sd;
+    origin = now;
+    interval = (intervalMs > 0 ? intervalMs : TimeSeries::DEFAULT_INTERVAL_MS) * 1000000ULL;
+    times.clear();
+    samples.clear();
+
+    //a Unix socket or shared memory has nothing to report
+    traced = sampleTcpInfo(sd, final);
+    next = traced ? now + interval : UINT64_MAX;
+}
+
+void TcpTrace::finish()
+{
+    if (traced)
+        sampleTcpInfo(sd, final);
+}
+
+bool TcpTrace::active() const
+{
+    return traced;
+}
+
+const TcpSample& TcpTrace::last() const
+{
+    return final;
+}
+
+void TcpTrace::print(std::ostream& out, const std::string& label, bool series) const
+{
+    if (!traced)
+        return;
+
+    out << label << ": ";
+    printTcpSample(out, final);
+    out << std::endl;
+
+    if (!series)
+        return;
+    for (std::size_t i = 0; i < samples.size(); i++)
+    {
+        out << "  t = " << times[i] / 1e9 << "s, ";
+        printTcpSample(out, samples[i]);
+        out << std::endl;
+    }
+}
+
+void TcpTrace::sampleInterval(uint64_t now)
+{
+    TcpSample sample;
+    if (sampleTcpInfo(sd, sample))
+    {
+        times.push_back(now - origin);
+        samples.push_back(sample);
+    }
+
+    //after a stall, skip the intervals that were missed
+    next += ((now - next) / interval + 1) * interval;
+}
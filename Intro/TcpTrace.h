@@ -0,0 +1,69 @@
+/*
+ * Description:
+ * TcpTrace.h declares a trace of TCP_INFO samples for one connection: one
+ * every interval, like TimeSeries, and a last one before the connection
+ * closes. Next to the throughput series it shows whether a slow stretch came
+ * with a smaller congestion window, a growing RTT or retransmissions, or with
+ * the receiver's window or the send buffer holding the sender back.
+ *
+ * It is intended to be part of an introduction in network programming.
+ */
+#ifndef _TCPTRACE_H_
+#define _TCPTRACE_H_
+
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <ostream>
+#include "TcpInfo.h"
+
+class TcpTrace
+{
+public:
+    TcpTrace();
+
+    /**
+     * Starts tracing sd at the given Clock::now(), with a sample due every
+     * intervalMs. Nothing is traced if sd isn't a TCP socket.
+     */
+    void start(int sd, uint64_t now, uint32_t intervalMs);
+
+    /**
+     * Takes a sample if one is due. Otherwise it's a single comparison, so it
+     * can be called on every send or read.
+     */
+    void poll(uint64_t now)
+    {
+        if (now >= next)
+            sampleInterval(now);
+    }
+
+    /**
+     * Takes the last sample, which has to happen before the socket is closed.
+     */
+    void finish();
+
+    bool active() const;
+
+    const TcpSample& last() const;
+
+    /**
+     * Prints "label: rtt = ..., limit = network" for the last sample and,
+     * with series, a line per interval, "  t = 1s, rtt = ...".
+     */
+    void print(std::ostream& out, const std::string& label, bool series) const;
+
+private:
+    void sampleInterval(uint64_t now);
+
+    int sd;
+    bool traced;
+    uint64_t origin;
+    uint64_t interval;
+    uint64_t next;                  //when the next sample is due
+    std::vector<uint64_t> times;    //since origin, for each of samples
+    std::vector<TcpSample> samples;
+    TcpSample final;
+};
+
+#endif
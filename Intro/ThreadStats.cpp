@@ -0,0 +1,157 @@
+/*
+ * Description:
+ * ThreadStats.cpp implements the per-thread counters with getrusage() and
+ * perf_event_open.
+ *
+ * It is intended to be part of an introduction in network programming.
+ */
+#include "ThreadStats.h"
+#include <cstring>
+#include <cerrno>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+enum
+{
+    COUNTER_TASK_CLOCK,
+    COUNTER_MIGRATIONS,
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_CACHE_MISSES,
+    COUNTERS
+};
+
+//forward declarations
+static int openCounter(uint32_t type, uint64_t config);
+static int64_t readCounter(int fd);
+
+static bool sampling = false;
+
+//each thread counts for itself, so each has its own counters
+static thread_local bool opened = false;
+static thread_local int counters[COUNTERS];
+
+void ThreadStats::enable()
+{
+    sampling = true;
+}
+
+bool ThreadStats::enabled()
+{
+    return sampling;
+}
+
+ThreadSample ThreadStats::sample()
+{
+    ThreadSample sample;
+    sample.cpu = sched_getcpu();
+
+    rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    sample.cpuUsec = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000L +
+                     usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+    sample.voluntarySwitches = usage.ru_nvcsw;
+    sample.involuntarySwitches = usage.ru_nivcsw;
+
+    if (sampling && !opened)
+    {
+        counters[COUNTER_TASK_CLOCK] = openCounter(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK);
+        counters[COUNTER_MIGRATIONS] = openCounter(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS);
+        counters[COUNTER_CYCLES] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+        counters[COUNTER_INSTRUCTIONS] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+        counters[COUNTER_CACHE_MISSES] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+        opened = true;
+    }
+
+    sample.taskClock = opened ? readCounter(counters[COUNTER_TASK_CLOCK]) : -1;
+    sample.migrations = opened ? readCounter(counters[COUNTER_MIGRATIONS]) : -1;
+    sample.cycles = opened ? readCounter(counters[COUNTER_CYCLES]) : -1;
+    sample.instructions = opened ? readCounter(counters[COUNTER_INSTRUCTIONS]) : -1;
+    sample.cacheMisses = opened ? readCounter(counters[COUNTER_CACHE_MISSES]) : -1;
+    return sample;
+}
+
+void ThreadStats::release()
+{
+    if (!opened)
+        return;
+
+    for (int i = 0; i < COUNTERS; i++)
+    {
+        if (counters[i] >= 0)
+            close(counters[i]);
+    }
+    opened = false;
+}
+
+/*
+ * Prints end - start for a counter, or n/a if it wasn't counted.
+ */
+static void printCounter(std::ostream& out, const char* name, int64_t start, int64_t end)
+{
+    out << ", " << name << " = ";
+    if (start < 0 || end < 0)
+        out << "n/a";
+    else
+        out << end - start;
+}
+
+void ThreadStats::print(std::ostream& out, const std::string& label,
+                        const ThreadSample& start, const ThreadSample& end)
+{
+    out << label << ": cpu = " << end.cpu;
+    out << ", cpu time = " << end.cpuUsec - start.cpuUsec << "usec";
+    out << ", context switches = " << end.voluntarySwitches - start.voluntarySwitches;
+    out << " voluntary/" << end.involuntarySwitches - start.involuntarySwitches << " involuntary";
+
+    if (sampling)
+    {
+        int64_t taskClock = (start.taskClock < 0 || end.taskClock < 0) ? -1 : (end.taskClock - start.taskClock) / 1000;
+        printCounter(out, "task clock (usec)", 0, taskClock);
+        printCounter(out, "migrations", start.migrations, end.migrations);
+        printCounter(out, "cycles", start.cycles, end.cycles);
+        printCounter(out, "instructions", start.instructions, end.instructions);
+        printCounter(out, "cache misses", start.cacheMisses, end.cacheMisses);
+
+        if (start.cycles >= 0 && end.cycles > start.cycles && start.instructions >= 0)
+            out << ", ipc = " << (double)(end.instructions - start.instructions) / (end.cycles - start.cycles);
+    }
+    out << std::endl;
+}
+
+/*
+ * Count one event for the calling thread, on whichever CPU it runs. Unless
+ * perf_event_paranoid allows it, the kernel's share can't be counted, so
+ * that is tried again with only user space counted.
+ *
+ * Returns -1 if the event can't be counted at all.
+ */
+static int openCounter(uint32_t type, uint64_t config)
+{
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.exclude_hv = 1;
+
+    int fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (fd < 0 && (errno == EACCES || errno == EPERM))
+    {
+        attr.exclude_kernel = 1;
+        fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+    return fd;
+}
+
+static int64_t readCounter(int fd)
+{
+    uint64_t value;
+    if (fd < 0 || read(fd, &value, sizeof(value)) != sizeof(value))
+        return -1;
+    return (int64_t)value;
+}
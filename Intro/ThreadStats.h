@@ -0,0 +1,71 @@
+/*
+ * Description:
+ * ThreadStats.h declares per-thread counters for the benchmark: CPU time and
+ * context switches from getrusage(), and task clock, migrations, cycles,
+ * instructions and cache misses from the kernel's performance counters
+ * (perf_event_open). Throughput alone doesn't say whether a run was limited
+ * by the network, by being scheduled off the CPU, or by memory; these do.
+ *
+ * The hardware counters are often missing in virtual machines and can be
+ * restricted by /proc/sys/kernel/perf_event_paranoid; whatever can't be
+ * counted is printed as n/a.
+ *
+ * It is intended to be part of an introduction in network programming.
+ */
+#ifndef _THREADSTATS_H_
+#define _THREADSTATS_H_
+
+#include <cstdint>
+#include <string>
+#include <ostream>
+
+/*
+ * The calling thread's counters at one point in time. Counters that aren't
+ * available are -1.
+ */
+struct ThreadSample
+{
+    int cpu;                    //the CPU the thread was on when sampled
+    long cpuUsec;               //user plus system time
+    long voluntarySwitches;     //gave up the CPU, e.g. to block in read()
+    long involuntarySwitches;   //was preempted
+    int64_t taskClock;          //ns on a CPU, as perf measures it
+    int64_t migrations;
+    int64_t cycles;
+    int64_t instructions;
+    int64_t cacheMisses;
+};
+
+class ThreadStats
+{
+public:
+    /**
+     * Turns sampling on. Until then sample() only reads getrusage(), so the
+     * counters cost nothing unless they were asked for.
+     */
+    static void enable();
+    static bool enabled();
+
+    /**
+     * Samples the calling thread. The performance counters are opened the
+     * first time a thread calls this, so take a sample before the part that
+     * should be measured.
+     */
+    static ThreadSample sample();
+
+    /**
+     * Closes the calling thread's performance counters, if it opened any.
+     * A thread that sampled should call this before it exits, since the
+     * descriptors otherwise stay open for the life of the process.
+     */
+    static void release();
+
+    /**
+     * Prints what changed between two samples of the same thread, as
+     * "label: cpu = 2, cpu time = ..., context switches = ...".
+     */
+    static void print(std::ostream& out, const std::string& label,
+                      const ThreadSample& start, const ThreadSample& end);
+};
+
+#endif
@@ -0,0 +1,83 @@
+/*
+ * Description:
+ * TimeSeries.cpp implements the throughput time series.
+ *
+ * It is intended to be part of an introduction in network programming.
+ */
+#include "TimeSeries.h"
+
+TimeSeries::TimeSeries()
+{
+    origin = last = 0;
+    interval = DEFAULT_INTERVAL_MS * 1000000ULL;
+}
+
+void TimeSeries::start(uint64_t now, uint32_t intervalMs)
+{
+    origin = last = now;
+    interval = (intervalMs > 0 ? intervalMs : DEFAULT_INTERVAL_MS) * 1000000ULL;
+    bytes.clear();
+}
+
+void TimeSeries::record(uint64_t now, uint64_t count)
+{
+    if (now < origin)
+        now = origin;
+
+    std::size_t index = (now - origin) / interval;
+    if (index >= bytes.size())
+        bytes.resize(index + 1, 0);
+
+    bytes[index] += count;
+    if (now > last)
+        last = now;
+}
+
+void TimeSeries::merge(const TimeSeries& other)
+{
+    if (bytes.empty())
+    {
+        origin = other.origin;
+        interval = other.interval;
+    }
+
+    if (other.bytes.size() > bytes.size())
+        bytes.resize(other.bytes.size(), 0);
+
+    for (std::size_t i = 0; i < other.bytes.size(); i++)
+        bytes[i] += other.bytes[i];
+
+    if (other.last > last)
+        last = other.last;
+}
+
+bool TimeSeries::empty() const
+{
+    return bytes.empty();
+}
+
+void TimeSeries::print(std::ostream& out, const std::string& label) const
+{
+    out << label << ":" << std::endl;
+
+    uint64_t elapsed = last - origin;
+    for (std::size_t i = 0; i < bytes.size(); i++)
+    {
+        uint64_t begin = i * interval;
+        uint64_t end = begin + interval;
+        uint64_t count = bytes[i];
+
+        //a sliver of an interval at the end says little on its own
+        if (i + 2 == bytes.size() && elapsed < end + interval / 10)
+        {
+            count += bytes[++i];
+            end = elapsed;
+        }
+        else if (i + 1 == bytes.size() && elapsed < end)
+            end = elapsed;
+
+        uint64_t length = end > begin ? end - begin : 1;
+        out << "  t = " << end / 1e9 << "s, ";
+        out << "throughput = " << count * 8.0 / (length / 1000.0) << "Mbps" << std::endl;
+    }
+}
@@ -0,0 +1,61 @@
+/*
+ * Description:
+ * TimeSeries.h declares a throughput time series: the bytes moved in each
+ * fixed interval since a starting point. A total only says how fast a run was
+ * on average, while the series shows slow start, stalls and whether the
+ * connection ever settled into a steady state.
+ *
+ * It is intended to be part of an introduction in network programming.
+ */
+#ifndef _TIMESERIES_H_
+#define _TIMESERIES_H_
+
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <ostream>
+
+class TimeSeries
+{
+public:
+    enum
+    {
+        DEFAULT_INTERVAL_MS = 1000
+    };
+
+    TimeSeries();
+
+    /**
+     * Starts the series at the given Clock::now() with intervals of
+     * intervalMs. Anything recorded before is thrown away.
+     */
+    void start(uint64_t now, uint32_t intervalMs);
+
+    /**
+     * Adds bytes to the interval that now falls in.
+     */
+    void record(uint64_t now, uint64_t bytes);
+
+    /**
+     * Adds another series to this one, interval by interval. Both should have
+     * been started at about the same time with the same interval.
+     */
+    void merge(const TimeSeries& other);
+
+    bool empty() const;
+
+    /**
+     * Prints one line per interval, "t = 1s, throughput = 941.2Mbps". The
+     * last interval is usually cut short, and is averaged over the part of
+     * it that was used, or folded into the one before if it is tiny.
+     */
+    void print(std::ostream& out, const std::string& label) const;
+
+private:
+    uint64_t origin;
+    uint64_t last;
+    uint64_t interval;
+    std::vector<uint64_t> bytes;
+};
+
+#endif
@@ -0,0 +1,547 @@
+/*
+ * Description:
+ * Transport.cpp implements the socket and shared memory transports.
+ *
+ * It is intended to be part of an introduction in network programming.
+ */
+#include "Transport.h"
+#include <iostream>
+#include <stdexcept>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <ctime>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <linux/futex.h>
+
+enum
+{
+    DEFAULT_RING_SIZE = 1024 * 1024,
+    SPIN_LIMIT = 100,           //polls of the ring (a few usec) before sleeping or yielding
+    WAIT_TIMEOUT_MS = 100       //how often a sleeping side checks the socket
+};
+
+/*
+ * A stream socket, TCP or Unix domain.
+ */
+class SocketTransport : public Transport
+{
+public:
+    explicit SocketTransport(int sd);
+    ~SocketTransport();
+
+    ssize_t send(const uint8_t* data, size_t length);
+    ssize_t sendv(const iovec* vect, int count);
+    ssize_t receive(uint8_t* buffer, size_t length);
+    void shutdownSend();
+    int socket() const;
+
+private:
+    int sd;
+};
+
+/*
+ * The shared part of one direction's ring. head and tail count every byte
+ * ever sent and consumed, so the ring is empty when they are equal and full
+ * when they are ringSize apart. They are on separate cache lines so the two
+ * sides don't keep taking the line from each other.
+ */
+struct RingControl
+{
+    alignas(64) uint64_t head;  //written by the producer
+    uint32_t dataFutex;         //bumped when the producer wakes the consumer
+    uint32_t consumerWaiting;
+    alignas(64) uint64_t tail;  //written by the consumer
+    uint32_t spaceFutex;        //bumped when the consumer wakes the producer
+    uint32_t producerWaiting;
+    alignas(64) uint32_t closed;    //the producer has shut down sending
+};
+
+/*
+ * The client to server ring followed by the server to client ring, each a
+ * RingControl and then ringSize bytes of data.
+ */
+class ShmTransport : public Transport
+{
+public:
+    ShmTransport(int sd, uint8_t* mapping, size_t ringSize, bool connected, bool spin);
+    ~ShmTransport();
+
+    ssize_t send(const uint8_t* data, size_t length);
+    ssize_t sendv(const iovec* vect, int count);
+    ssize_t receive(uint8_t* buffer, size_t length);
+    void shutdownSend();
+    int socket() const;
+
+private:
+    bool wait(uint32_t* futexWord, uint32_t* waiting, const uint64_t* position, uint64_t unchanged);
+    void wake(uint32_t* futexWord, const uint32_t* waiting);
+    bool peerAlive(const uint64_t* position, uint64_t unchanged);
+
+    int sd;
+    uint8_t* mapping;
+    size_t ringSize;
+    bool spin;
+    RingControl* out;
+    uint8_t* outData;
+    RingControl* in;
+    uint8_t* inData;
+};
+
+//forward declarations
+static size_t mappingSize(size_t ringSize);
+static Transport* sendRings(const TransportConfig& config, int sd);
+static Transport* receiveRings(const TransportConfig& config, int sd);
+
+TransportConfig::TransportConfig()
+{
+    kind = TRANSPORT_TCP;
+    ringSize = DEFAULT_RING_SIZE;
+    spin = false;
+}
+
+Transport::~Transport()
+{
+}
+
+bool parseTransportOption(int& i, int argc, char* argv[], TransportConfig& config)
+{
+    std::string option = argv[i];
+    bool hasValue = i+1 < argc;
+
+    if (option == "--transport" && hasValue)
+    {
+        std::string name = argv[++i];
+        if (name == "tcp")
+            config.kind = TRANSPORT_TCP;
+        else if (name == "unix")
+            config.kind = TRANSPORT_UNIX;
+        else if (name == "shm")
+            config.kind = TRANSPORT_SHM;
+        else
+            throw std::invalid_argument(name);
+    }
+    else if (option == "--ring" && hasValue)
+    {
+        //a power of two, so positions wrap with a mask
+        size_t size = std::stoll(argv[++i]);
+        config.ringSize = 4096;
+        while (config.ringSize < size)
+            config.ringSize *= 2;
+    }
+    else if (option == "--spin")
+        config.spin = true;
+    else
+        return false;
+
+    return true;
+}
+
+void printTransport(std::ostream& out, const TransportConfig& config)
+{
+    const char* names[] = {"tcp", "unix", "shm"};
+    out << "transport = " << names[config.kind];
+    if (config.kind == TRANSPORT_SHM)
+    {
+        out << ", ring = " << config.ringSize << " bytes";
+        out << ", wait = " << (config.spin ? "spin" : "futex");
+    }
+    out << std::endl;
+}
+
+std::string unixPath(int port)
+{
+    return "/tmp/intro-" + std::to_string(port) + ".sock";
+}
+
+int connectUnix(int port)
+{
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, unixPath(port).c_str(), sizeof(address.sun_path) - 1);
+
+    int sd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connect(sd, (sockaddr*)&address, sizeof(address)) < 0)
+    {
+        perror("Could not connect to the server's Unix domain socket");
+        close(sd);
+        return -1;
+    }
+    return sd;
+}
+
+Transport* createTransport(const TransportConfig& config, int sd, bool connected)
+{
+    if (config.kind != TRANSPORT_SHM)
+        return new SocketTransport(sd);
+    if (connected)
+        return sendRings(config, sd);
+    return receiveRings(config, sd);
+}
+
+bool sendAll(Transport& transport, const uint8_t* data, size_t length)
+{
+    size_t sent = 0;
+    while (sent < length)
+    {
+        ssize_t bytes = transport.send(data + sent, length - sent);
+        if (bytes < 0 && errno == EINTR)
+            continue;
+        if (bytes <= 0)
+            return false;
+        sent += bytes;
+    }
+    return true;
+}
+
+bool receiveAll(Transport& transport, uint8_t* buffer, size_t length)
+{
+    size_t received = 0;
+    while (received < length)
+    {
+        ssize_t bytes = transport.receive(buffer + received, length - received);
+        if (bytes < 0 && errno == EINTR)
+            continue;
+        if (bytes <= 0)
+            return false;
+        received += bytes;
+    }
+    return true;
+}
+
+SocketTransport::SocketTransport(int sd)
+{
+    this->sd = sd;
+}
+
+SocketTransport::~SocketTransport()
+{
+    close(sd);
+}
+
+ssize_t SocketTransport::send(const uint8_t* data, size_t length)
+{
+    //a server that went away is an error here, not a SIGPIPE
+    return ::send(sd, data, length, MSG_NOSIGNAL);
+}
+
+ssize_t SocketTransport::sendv(const iovec* vect, int count)
+{
+    return writev(sd, vect, count);
+}
+
+ssize_t SocketTransport::receive(uint8_t* buffer, size_t length)
+{
+    return read(sd, buffer, length);
+}
+
+void SocketTransport::shutdownSend()
+{
+    shutdown(sd, SHUT_WR);
+}
+
+int SocketTransport::socket() const
+{
+    return sd;
+}
+
+ShmTransport::ShmTransport(int sd, uint8_t* mapping, size_t ringSize, bool connected, bool spin)
+{
+    this->sd = sd;
+    this->mapping = mapping;
+    this->ringSize = ringSize;
+    this->spin = spin;
+
+    //the client sends on the first ring and the server on the second
+    RingControl* first = (RingControl*)mapping;
+    RingControl* second = (RingControl*)(mapping + sizeof(RingControl) + ringSize);
+    out = connected ? first : second;
+    in = connected ? second : first;
+    outData = (uint8_t*)(out + 1);
+    inData = (uint8_t*)(in + 1);
+}
+
+ShmTransport::~ShmTransport()
+{
+    munmap(mapping, mappingSize(ringSize));
+    close(sd);
+}
+
+ssize_t ShmTransport::send(const uint8_t* data, size_t length)
+{
+    uint64_t head = out->head;
+    uint64_t tail = __atomic_load_n(&out->tail, __ATOMIC_ACQUIRE);
+    while (head - tail == ringSize)
+    {
+        if (!wait(&out->spaceFutex, &out->producerWaiting, &out->tail, tail))
+        {
+            errno = EPIPE;
+            return -1;
+        }
+        tail = __atomic_load_n(&out->tail, __ATOMIC_ACQUIRE);
+    }
+
+    size_t free = ringSize - (head - tail);
+    if (length > free)
+        length = free;
+
+    //copied in two parts if it wraps around the end of the ring
+    size_t offset = head & (ringSize - 1);
+    size_t first = ringSize - offset < length ? ringSize - offset : length;
+    std::memcpy(outData + offset, data, first);
+    std::memcpy(outData, data + first, length - first);
+
+    __atomic_store_n(&out->head, head + length, __ATOMIC_SEQ_CST);
+    wake(&out->dataFutex, &out->consumerWaiting);
+    return length;
+}
+
+ssize_t ShmTransport::sendv(const iovec* vect, int count)
+{
+    //each buffer is copied in turn, stopping like writev() at a full ring
+    ssize_t total = 0;
+    for (int i = 0; i < count; i++)
+    {
+        ssize_t bytes = send((const uint8_t*)vect[i].iov_base, vect[i].iov_len);
+        if (bytes < 0)
+            return total > 0 ? total : -1;
+        total += bytes;
+        if ((size_t)bytes < vect[i].iov_len)
+            break;
+    }
+    return total;
+}
+
+ssize_t ShmTransport::receive(uint8_t* buffer, size_t length)
+{
+    uint64_t tail = in->tail;
+    uint64_t head = __atomic_load_n(&in->head, __ATOMIC_ACQUIRE);
+    while (head == tail)
+    {
+        if (__atomic_load_n(&in->closed, __ATOMIC_ACQUIRE))
+        {
+            //anything sent before the close was published first
+            head = __atomic_load_n(&in->head, __ATOMIC_ACQUIRE);
+            if (head == tail)
+                return 0;
+            break;
+        }
+        if (!wait(&in->dataFutex, &in->consumerWaiting, &in->head, tail))
+            return 0;
+        head = __atomic_load_n(&in->head, __ATOMIC_ACQUIRE);
+    }
+
+    if (length > head - tail)
+        length = head - tail;
+
+    size_t offset = tail & (ringSize - 1);
+    size_t first = ringSize - offset < length ? ringSize - offset : length;
+    std::memcpy(buffer, inData + offset, first);
+    std::memcpy(buffer + first, inData, length - first);
+
+    __atomic_store_n(&in->tail, tail + length, __ATOMIC_SEQ_CST);
+    wake(&in->spaceFutex, &in->producerWaiting);
+    return length;
+}
+
+void ShmTransport::shutdownSend()
+{
+    __atomic_store_n(&out->closed, 1, __ATOMIC_SEQ_CST);
+    wake(&out->dataFutex, &out->consumerWaiting);
+}
+
+int ShmTransport::socket() const
+{
+    return -1;
+}
+
+/*
+ * Waits for *position to move from unchanged. It is polled for a while
+ * first, since the other side is usually about to move it, and then the side
+ * either yields the CPU (--spin) or says it's waiting and sleeps on the futex.
+ * The sleep is timed, so a peer that went away without closing is noticed.
+ *
+ * Returns once it moved, or maybe did; the caller checks again. Returns false
+ * if the other side has gone away.
+ */
+bool ShmTransport::wait(uint32_t* futexWord, uint32_t* waiting, const uint64_t* position, uint64_t unchanged)
+{
+    for (int i = 0; i < SPIN_LIMIT; i++)
+    {
+        if (__atomic_load_n(position, __ATOMIC_ACQUIRE) != unchanged)
+            return true;
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+
+    if (spin)
+    {
+        sched_yield();
+        return peerAlive(position, unchanged);
+    }
+
+    //the futex value is read before saying we wait, so a wake in between is
+    //seen as a changed value and FUTEX_WAIT returns at once
+    uint32_t value = __atomic_load_n(futexWord, __ATOMIC_SEQ_CST);
+    __atomic_store_n(waiting, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(position, __ATOMIC_SEQ_CST) != unchanged)
+    {
+        __atomic_store_n(waiting, 0, __ATOMIC_SEQ_CST);
+        return true;
+    }
+
+    timespec timeout;
+    timeout.tv_sec = 0;
+    timeout.tv_nsec = WAIT_TIMEOUT_MS * 1000000L;
+    long result = syscall(SYS_futex, futexWord, FUTEX_WAIT, value, &timeout, nullptr, 0);
+    __atomic_store_n(waiting, 0, __ATOMIC_SEQ_CST);
+
+    if (result < 0 && errno == ETIMEDOUT)
+        return peerAlive(position, unchanged);
+    return true;
+}
+
+/*
+ * Wakes the other side if it's asleep. A side that is polling sees the
+ * change by itself, so the system call is only made when one is needed.
+ */
+void ShmTransport::wake(uint32_t* futexWord, const uint32_t* waiting)
+{
+    if (__atomic_load_n(waiting, __ATOMIC_SEQ_CST))
+    {
+        __atomic_fetch_add(futexWord, 1, __ATOMIC_SEQ_CST);
+        syscall(SYS_futex, futexWord, FUTEX_WAKE, 1, nullptr, nullptr, 0);
+    }
+}
+
+/*
+ * Nothing is sent on the socket once the rings are set up, so it only reads
+ * as closed if the other side closed it or exited. The other side may have
+ * moved the ring just before it went, so that is checked again after.
+ */
+bool ShmTransport::peerAlive(const uint64_t* position, uint64_t unchanged)
+{
+    char byte;
+    ssize_t result = recv(sd, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (result > 0 || (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)))
+        return true;
+    return __atomic_load_n(position, __ATOMIC_ACQUIRE) != unchanged;
+}
+
+static size_t mappingSize(size_t ringSize)
+{
+    return 2 * (sizeof(RingControl) + ringSize);
+}
+
+/*
+ * Creates the shared memory with memfd_create(), which starts out zeroed
+ * (empty rings), and sends it with the ring size.
+ */
+static Transport* sendRings(const TransportConfig& config, int sd)
+{
+    size_t size = mappingSize(config.ringSize);
+    int fd = memfd_create("intro-shm", 0);
+    if (fd < 0 || ftruncate(fd, size) < 0)
+    {
+        perror("Could not create the shared memory");
+        if (fd >= 0)
+            close(fd);
+        close(sd);
+        return nullptr;
+    }
+
+    void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+
+    uint64_t ringSize = config.ringSize;
+    iovec vect;
+    vect.iov_base = &ringSize;
+    vect.iov_len = sizeof(ringSize);
+
+    char control[CMSG_SPACE(sizeof(int))];
+    std::memset(control, 0, sizeof(control));
+    msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &vect;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    std::memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+    bool sent = mapping != MAP_FAILED && sendmsg(sd, &msg, MSG_NOSIGNAL) == sizeof(ringSize);
+    close(fd);
+    if (!sent)
+    {
+        perror("Could not send the shared memory");
+        if (mapping != MAP_FAILED)
+            munmap(mapping, size);
+        close(sd);
+        return nullptr;
+    }
+
+    return new ShmTransport(sd, (uint8_t*)mapping, config.ringSize, true, config.spin);
+}
+
+/*
+ * Receives the shared memory the client created and maps it.
+ */
+static Transport* receiveRings(const TransportConfig& config, int sd)
+{
+    uint64_t ringSize = 0;
+    iovec vect;
+    vect.iov_base = &ringSize;
+    vect.iov_len = sizeof(ringSize);
+
+    char control[CMSG_SPACE(sizeof(int))];
+    msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &vect;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    int fd = -1;
+    if (recvmsg(sd, &msg, MSG_WAITALL) == sizeof(ringSize))
+    {
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        if (cmsg != nullptr && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+            std::memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+    }
+
+    //a power of two of at least a page, as parseTransportOption() makes it,
+    //and no bigger than the memory that backs it
+    struct stat status;
+    if (fd < 0 || ringSize < 4096 || (ringSize & (ringSize - 1)) != 0 ||
+        fstat(fd, &status) < 0 || (size_t)status.st_size < mappingSize(ringSize))
+    {
+        std::cerr << "Error: The client didn't send its shared memory." << std::endl;
+        if (fd >= 0)
+            close(fd);
+        close(sd);
+        return nullptr;
+    }
+
+    size_t size = mappingSize(ringSize);
+    void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        perror("Could not map the shared memory");
+        close(sd);
+        return nullptr;
+    }
+
+    return new ShmTransport(sd, (uint8_t*)mapping, ringSize, false, config.spin);
+}
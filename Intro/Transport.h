@@ -0,0 +1,141 @@
+/*
+ * Description:
+ * Transport.h declares the data path client.cpp and server.cpp share, so the
+ * same test can be run over different transports and compared:
+ *
+ *   tcp  - TCP, over loopback or a real network (the default)
+ *   unix - a Unix domain stream socket, for a client and server on the same
+ *          host; no TCP/IP stack, checksums or ACKs
+ *   shm  - a ring buffer in shared memory in each direction, so sending is a
+ *          memcpy() into memory the server can see and no system call is
+ *          made unless a side has to wait
+ *
+ * The unix and shm transports both use a socket named after the port in
+ * /tmp. For shm it only carries the shared memory (passed as a file
+ * descriptor with SCM_RIGHTS) and tells each side when the other has gone.
+ * A side waiting on an empty or full ring sleeps on a futex in the ring, or
+ * with --spin keeps polling it, which is faster if both sides have a CPU to
+ * themselves.
+ *
+ * It is intended to be part of an introduction in network programming.
+ */
+#ifndef _TRANSPORT_H_
+#define _TRANSPORT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <ostream>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+enum TransportKind
+{
+    TRANSPORT_TCP,
+    TRANSPORT_UNIX,
+    TRANSPORT_SHM
+};
+
+struct TransportConfig
+{
+    TransportKind kind;
+    size_t ringSize;    //bytes in each direction, picked by the client (shm)
+    bool spin;          //poll a ring instead of sleeping on it (shm)
+
+    TransportConfig();
+};
+
+/*
+ * A connection, used like a blocking stream socket.
+ */
+class Transport
+{
+public:
+    virtual ~Transport();
+
+    /**
+     * Like write(): sends as much of data as can go without waiting, once at
+     * least one byte can.
+     *
+     * Returns the number of bytes sent, or -1 if the connection failed.
+     */
+    virtual ssize_t send(const uint8_t* data, size_t length) = 0;
+
+    /**
+     * Like writev(), a gather of several buffers in one call.
+     */
+    virtual ssize_t sendv(const iovec* vect, int count) = 0;
+
+    /**
+     * Like read(): waits for data, then receives up to length bytes.
+     *
+     * Returns the number of bytes received, 0 once the other side has shut
+     * down sending (or gone away), or -1 if the connection failed.
+     */
+    virtual ssize_t receive(uint8_t* buffer, size_t length) = 0;
+
+    /**
+     * Like shutdown(SHUT_WR): the other side receives 0 once it has read
+     * everything sent so far.
+     */
+    virtual void shutdownSend() = 0;
+
+    /**
+     * The socket the data goes through, for socket options and the send and
+     * receive calls only sockets have, or -1 if the data doesn't use one.
+     */
+    virtual int socket() const = 0;
+};
+
+/**
+ * Handles one of the transport options at argv[i] (--transport, --ring and
+ * --spin), moving i past its value.
+ *
+ * Returns false if argv[i] isn't a transport option. Throws
+ * std::invalid_argument for an unknown transport.
+ */
+bool parseTransportOption(int& i, int argc, char* argv[], TransportConfig& config);
+
+/**
+ * Prints the transport, and for shm the ring size and how it waits.
+ */
+void printTransport(std::ostream& out, const TransportConfig& config);
+
+/**
+ * The path of the Unix domain socket a server on port listens on.
+ */
+std::string unixPath(int port);
+
+/**
+ * Connects to the Unix domain socket of a server on port.
+ *
+ * Returns the socket, or -1 after printing why.
+ */
+int connectUnix(int port);
+
+/**
+ * Wraps a connected socket in the configured transport. For shm, the side
+ * that connected creates the rings and sends them over the socket, and the
+ * side that accepted waits for them, so this blocks until both sides have
+ * called it.
+ *
+ * Returns null, after printing why, if the transport couldn't be set up.
+ * Deleting the transport closes the socket.
+ */
+Transport* createTransport(const TransportConfig& config, int sd, bool connected);
+
+/**
+ * Sends all of data, which a single send() won't do for a large enough length.
+ *
+ * Returns false if the connection failed.
+ */
+bool sendAll(Transport& transport, const uint8_t* data, size_t length);
+
+/**
+ * Receives exactly length bytes into buffer.
+ *
+ * Returns false if the connection failed or closed first.
+ */
+bool receiveAll(Transport& transport, uint8_t* buffer, size_t length);
+
+#endif
@@ -0,0 +1,420 @@
+/*
+ * Description:
+ * UringEngine.cpp implements the io_uring server engine. A single thread
+ * queues accepts and reads on an io_uring and only enters the kernel to
+ * submit new requests and collect the ones that finished. Reads go straight
+ * into buffers that were registered with the ring up front, one slot per
+ * client, so the kernel doesn't have to map the destination on every read.
+ * Ping-pong replies are written from the same slot.
+ *
+ * liburing isn't needed; the ring is set up with the raw system calls.
+ *
+ * It is intended to be part of an introduction in network programming.
+ */
+#include "ServerEngine.h"
+#include "Clock.h"
+#include <iostream>
+#include <vector>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+enum
+{
+    RING_ENTRIES = 256,
+    BUFFER_SLOTS = 64,      //clients that can be served at the same time
+    SLOT_SIZE = ENGINE_BUFSIZE
+};
+
+/*
+ * A client being served by the ring. Its reads land in its buffer slot.
+ */
+struct UringClient
+{
+    int sd;
+    int slot;
+    int headerRead;     //bytes of the TestHeader read so far
+    bool started;       //whether the whole header has arrived
+    bool writing;       //whether the request in flight is a reply
+    uint64_t replyLeft; //ping-pong reply bytes still to write
+    uint64_t submitted; //Clock::now() when the pending read was queued
+    ReceiveStats stats;
+};
+
+/*
+ * The parts of an io_uring that are shared with the kernel.
+ */
+struct Ring
+{
+    int fd;
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+    io_uring_sqe* sqes;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    io_uring_cqe* cqes;
+    unsigned toSubmit;  //queued since the last io_uring_enter
+
+    //the mappings themselves, to undo them
+    uint8_t* sq;
+    size_t sqSize;
+    uint8_t* cq;        //the same as sq with a single mapping
+    size_t cqSize;
+    size_t sqesSize;
+};
+
+//forward declarations
+static bool setupRing(Ring& ring);
+static void closeRing(Ring& ring);
+static io_uring_sqe* nextSqe(Ring& ring);
+static void queueAccept(Ring& ring, int serverSd);
+static bool queueRead(Ring& ring, UringClient* client);
+static void queueReply(Ring& ring, UringClient* client);
+static void finishClient(UringClient* client);
+
+//every slot is SLOT_SIZE bytes of one registered block
+static uint8_t* buffers;
+
+void runUringEngine(int serverSd)
+{
+    Ring ring;
+    if (!setupRing(ring))
+    {
+        std::cerr << "Warning: io_uring isn't available, using epoll." << std::endl;
+        runEpollEngine(serverSd);
+        return;
+    }
+
+    buffers = new uint8_t[BUFFER_SLOTS * SLOT_SIZE];
+    iovec slots[BUFFER_SLOTS];
+    for (int i = 0; i < BUFFER_SLOTS; i++)
+    {
+        slots[i].iov_base = buffers + i * SLOT_SIZE;
+        slots[i].iov_len = SLOT_SIZE;
+    }
+
+    if (syscall(__NR_io_uring_register, ring.fd, IORING_REGISTER_BUFFERS, slots, BUFFER_SLOTS) < 0)
+    {
+        perror("io_uring error");
+        std::cerr << "Warning: could not register buffers, using epoll." << std::endl;
+        delete[] buffers;
+        buffers = nullptr;
+        closeRing(ring);
+        runEpollEngine(serverSd);
+        return;
+    }
+
+    std::vector<int> freeSlots;
+    for (int i = BUFFER_SLOTS - 1; i >= 0; i--)
+        freeSlots.push_back(i);
+
+    queueAccept(ring, serverSd);
+
+    while (true)
+    {
+        //submit whatever is queued and sleep until at least one finishes
+        int submitted = syscall(__NR_io_uring_enter, ring.fd, ring.toSubmit, 1,
+                                IORING_ENTER_GETEVENTS, nullptr, 0);
+        if (submitted < 0 && errno == EINTR)
+            continue;
+        if (submitted < 0)
+        {
+            perror("io_uring error");
+            closeRing(ring);
+            delete[] buffers;
+            return;
+        }
+        ring.toSubmit -= submitted;
+
+        unsigned head = *ring.cqHead;
+        unsigned tail = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++)
+        {
+            io_uring_cqe* cqe = &ring.cqes[head & *ring.cqMask];
+            UringClient* client = (UringClient*)cqe->user_data;
+            int result = cqe->res;
+
+            //user_data is only empty for the accept
+            if (client == nullptr)
+            {
+                if (result == -EINVAL || result == -EOPNOTSUPP)
+                {
+                    std::cerr << "Warning: io_uring can't accept here, using epoll." << std::endl;
+                    delete[] buffers;
+                    buffers = nullptr;
+                    closeRing(ring);
+                    runEpollEngine(serverSd);
+                    return;
+                }
+
+                queueAccept(ring, serverSd);
+                if (result < 0)
+                    continue;
+
+                std::cout << "New client connected." << std::endl;
+                if (freeSlots.empty())
+                {
+                    std::cerr << "Error: no buffer slot left for the client." << std::endl;
+                    close(result);
+                    continue;
+                }
+
+                client = new UringClient;
+                client->sd = result;
+                client->slot = freeSlots.back();
+                client->headerRead = 0;
+                client->started = false;
+                client->writing = false;
+                client->replyLeft = 0;
+                freeSlots.pop_back();
+
+                queueRead(ring, client);
+                continue;
+            }
+
+            if ((result == -EINTR || result == -EAGAIN) && client->writing)
+            {
+                queueReply(ring, client);
+                continue;
+            }
+            if (result == -EINTR || result == -EAGAIN)
+            {
+                queueRead(ring, client);
+                continue;
+            }
+
+            ReceiveStats& stats = client->stats;
+            if (client->writing)
+            {
+                stats.writes++;
+                if (result > 0)
+                    client->replyLeft -= result;
+            }
+            else if (client->started)
+            {
+                stats.readLatency.record(Clock::now() - client->submitted);
+                stats.reads++;
+                stats.wakeups++;
+                if (result > 0)
+                {
+                    recordRead(stats, result);
+                    client->replyLeft += replyOwed(stats, result);
+                }
+            }
+            else if (result > 0)
+            {
+                //the header is read into the start of the slot
+                client->headerRead += result;
+                TestHeader header;
+                if (client->headerRead == HEADER_SIZE && decodeHeader(buffers + client->slot * SLOT_SIZE, header))
+                {
+                    startReceive(stats, header, client->sd);
+                    client->started = true;
+                }
+                else if (client->headerRead == HEADER_SIZE)
+                    result = 0;
+            }
+
+            //the reply has to go out before the next message is read
+            if (result > 0 && client->replyLeft > 0)
+            {
+                queueReply(ring, client);
+                continue;
+            }
+
+            //done, at the end of a duration run, or the client went away early
+            if (result <= 0 || !queueRead(ring, client))
+            {
+                freeSlots.push_back(client->slot);
+                finishClient(client);
+            }
+        }
+        __atomic_store_n(ring.cqHead, head, __ATOMIC_RELEASE);
+    }
+}
+
+/*
+ * Create the ring and map the submission queue, completion queue and
+ * submission entries into this process.
+ *
+ * Returns false if the kernel doesn't support io_uring (or it's disabled).
+ */
+static bool setupRing(Ring& ring)
+{
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+
+    ring.fd = syscall(__NR_io_uring_setup, RING_ENTRIES, &params);
+    if (ring.fd < 0)
+        return false;
+
+    size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+    //newer kernels put both queues in one mapping
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (cqSize > sqSize)
+            sqSize = cqSize;
+        cqSize = sqSize;
+    }
+
+    //whatever has been mapped so far is undone by closeRing if a later step fails
+    ring.sq = nullptr;
+    ring.cq = nullptr;
+    ring.sqes = nullptr;
+    ring.sqSize = sqSize;
+    ring.cqSize = cqSize;
+    ring.sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+
+    uint8_t* sq = (uint8_t*)mmap(nullptr, sqSize, PROT_READ | PROT_WRITE,
+                                 MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQ_RING);
+    if (sq == MAP_FAILED)
+    {
+        closeRing(ring);
+        return false;
+    }
+    ring.sq = sq;
+
+    uint8_t* cq = sq;
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP))
+    {
+        cq = (uint8_t*)mmap(nullptr, cqSize, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_CQ_RING);
+        if (cq == MAP_FAILED)
+        {
+            closeRing(ring);
+            return false;
+        }
+    }
+    ring.cq = cq;
+
+    void* sqes = mmap(nullptr, ring.sqesSize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+    {
+        closeRing(ring);
+        return false;
+    }
+
+    ring.sqHead = (unsigned*)(sq + params.sq_off.head);
+    ring.sqTail = (unsigned*)(sq + params.sq_off.tail);
+    ring.sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+    ring.sqArray = (unsigned*)(sq + params.sq_off.array);
+    ring.sqes = (io_uring_sqe*)sqes;
+    ring.cqHead = (unsigned*)(cq + params.cq_off.head);
+    ring.cqTail = (unsigned*)(cq + params.cq_off.tail);
+    ring.cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+    ring.cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+    ring.toSubmit = 0;
+    return true;
+}
+
+/*
+ * Unmap whatever setupRing mapped and close the ring.
+ */
+static void closeRing(Ring& ring)
+{
+    if (ring.sqes != nullptr)
+        munmap(ring.sqes, ring.sqesSize);
+    if (ring.cq != nullptr && ring.cq != ring.sq)
+        munmap(ring.cq, ring.cqSize);
+    if (ring.sq != nullptr)
+        munmap(ring.sq, ring.sqSize);
+    close(ring.fd);
+}
+
+/*
+ * Claim the next submission entry and publish it to the kernel. The caller
+ * fills it in before the next io_uring_enter.
+ *
+ * There is at most one accept and one read per slot in flight, which is far
+ * less than RING_ENTRIES, so the queue can't fill up.
+ */
+static io_uring_sqe* nextSqe(Ring& ring)
+{
+    unsigned tail = *ring.sqTail;
+    unsigned index = tail & *ring.sqMask;
+
+    io_uring_sqe* sqe = &ring.sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    ring.sqArray[index] = index;
+
+    __atomic_store_n(ring.sqTail, tail + 1, __ATOMIC_RELEASE);
+    ring.toSubmit++;
+    return sqe;
+}
+
+static void queueAccept(Ring& ring, int serverSd)
+{
+    io_uring_sqe* sqe = nextSqe(ring);
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = serverSd;
+    sqe->user_data = 0;
+}
+
+/*
+ * Read the rest of the header, or else the rest of the current message, into
+ * the client's registered slot.
+ *
+ * Returns false if the client has nothing left to send.
+ */
+static bool queueRead(Ring& ring, UringClient* client)
+{
+    size_t position = client->headerRead;
+    size_t size = HEADER_SIZE - client->headerRead;
+    if (client->started)
+        size = nextRead(client->stats, SLOT_SIZE, position);
+    if (size == 0)
+        return false;
+
+    io_uring_sqe* sqe = nextSqe(ring);
+    sqe->opcode = IORING_OP_READ_FIXED;
+    sqe->fd = client->sd;
+    sqe->addr = (uint64_t)(buffers + client->slot * SLOT_SIZE + position);
+    sqe->len = size;
+    sqe->buf_index = client->slot;
+    sqe->user_data = (uint64_t)client;
+    client->writing = false;
+    client->submitted = Clock::now();
+    return true;
+}
+
+/*
+ * Write as much of the pending ping-pong reply as fits in the client's slot.
+ */
+static void queueReply(Ring& ring, UringClient* client)
+{
+    io_uring_sqe* sqe = nextSqe(ring);
+    sqe->opcode = IORING_OP_WRITE_FIXED;
+    sqe->fd = client->sd;
+    sqe->addr = (uint64_t)(buffers + client->slot * SLOT_SIZE);
+    sqe->len = client->replyLeft < SLOT_SIZE ? client->replyLeft : SLOT_SIZE;
+    sqe->buf_index = client->slot;
+    sqe->user_data = (uint64_t)client;
+    client->writing = true;
+}
+
+static void finishClient(UringClient* client)
+{
+    ReceiveStats& stats = client->stats;
+    endReceive(stats);
+
+    if (client->started)
+    {
+        write(client->sd, &stats.reads, sizeof(stats.reads));
+        reportReceive("uring", stats);
+    }
+
+    close(client->sd);
+    delete client;
+}
@@ -1,3 +1 @@
-./client 3458 5 15 100 192.168.0.109 3 > output1.txt &
-./client 3458 5 15 100 192.168.0.109 3 > output2.txt &
-./client 3458 5 15 100 192.168.0.109 3 > output3.txt &
+./client 3458 5 15 100 192.168.0.109 3 --streams 3 --threads 3
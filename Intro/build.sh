@@ -1,2 +1,3 @@
-g++ client.cpp -oclient -std=c++11
-g++ server.cpp -oserver -lpthread -std=c++11
+g++ client.cpp SocketTuning.cpp Protocol.cpp Transport.cpp Buffer.cpp TimeSeries.cpp Clock.cpp Histogram.cpp Affinity.cpp ThreadStats.cpp TcpTrace.cpp ../Common/Resolver.cpp ../Common/TcpInfo.cpp -I../Common -oclient -lpthread -std=c++11
+g++ server.cpp SocketTuning.cpp Protocol.cpp Transport.cpp TimeSeries.cpp ServerEngine.cpp EpollEngine.cpp UringEngine.cpp Clock.cpp Histogram.cpp Affinity.cpp ThreadStats.cpp TcpTrace.cpp ../Common/TcpInfo.cpp -I../Common -oserver -lpthread -std=c++11
+g++ harness.cpp -oharness -std=c++11
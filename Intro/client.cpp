@@ -6,7 +6,48 @@
  * client.cpp is a application that connects to a server and sends it data. It
  * then prints how long it spent sending the data, how long it took to get a
  * reply from the server after sending the data, and how many times the server
- * called read().
+ * called read(). The latency of every write is recorded too, and printed as
+ * percentiles so that the tail is visible and not just the total.
+ *
+ * With --streams it opens several connections and drives them all at once from
+ * --threads threads, then reports each stream's throughput along with the
+ * aggregate throughput, how fairly it was shared, and the tail latency.
+ *
+ * Types 1 to 3 copy the data into the kernel (several write() calls, one
+ * writev() and one write()). Types 4 to 6 try not to: MSG_ZEROCOPY sends
+ * that are completed through the socket's error queue, vmsplice() into a
+ * pipe that is then splice()d to the socket, and sendfile() from a file in
+ * tmpfs. The CPU time of the whole run is printed next to the throughput so
+ * that the paths can be compared by cost and not just speed.
+ *
+ * The socket options can be set with the same profiles as the server (see
+ * SocketTuning.h).
+ *
+ * A message is nbufs*bufsize bytes, anything from a byte to gigabytes, sent
+ * from a buffer backed by huge pages where possible (see Buffer.h). With
+ * --duration the client sends messages for that many seconds instead of
+ * repetition times, and prints the throughput of every --interval so the
+ * steady state can be told apart from the ramp up.
+ *
+ * --pingpong R turns each message into a request that the server answers with
+ * R bytes, the pattern of an RPC. --depth keeps that many requests in flight
+ * on each stream (they all have to fit in the socket buffers at once), and
+ * the round-trip time of every request is printed as percentiles.
+ *
+ * --cpus pins worker thread i to the i'th CPU of a list, or of the CPUs next
+ * to a network card's interrupts (see Affinity.h), and binds the message
+ * buffer to the first CPU's NUMA node. --perf prints each thread's CPU time,
+ * context switches and hardware counters (see ThreadStats.h).
+ *
+ * --transport unix and shm run the same tests over a Unix domain socket or
+ * shared memory rings (see Transport.h), to a server on the same host that
+ * was started with the same --transport. Types 4 to 6 need a socket, and
+ * MSG_ZEROCOPY (type 4) only works with TCP.
+ *
+ * Over TCP, every stream ends with a line of TCP_INFO (RTT, cwnd,
+ * retransmits, delivery rate and the time the sender was held back by the
+ * receiver's window or the send buffer, see TcpTrace.h), and a timed run adds
+ * one per interval, the same as the server does for its side.
  *
  * It is intended to be part of an introduction in network programming.
  */
@@ -14,6 +55,7 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <deque>
 #include <cstdint>
 
 #include <netdb.h>
@@ -22,17 +64,111 @@
 #include <arpa/inet.h>
 
 #include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <cerrno>
+#include <cstdlib>
 #include <sys/uio.h>
-
+#include <sys/sendfile.h>
 #include <sys/time.h>
+#include <sys/resource.h>
+#include <linux/errqueue.h>
+#include <stdexcept>
+#include <cmath>
+#include <climits>
+#include <pthread.h>
+
+#include "Resolver.h"
+#include "Clock.h"
+#include "Histogram.h"
+#include "SocketTuning.h"
+#include "Protocol.h"
+#include "Buffer.h"
+#include "TimeSeries.h"
+#include "Affinity.h"
+#include "ThreadStats.h"
+#include "Transport.h"
+#include "TcpTrace.h"
 
 enum
 {
-    BUFSIZE = 1500
+    ZEROCOPY_WAIT_MS = 100  //the longest one wait for zero-copy completions lasts
 };
 
-//forward declaration
-int connectToHost(char* host, char* port);
+/*
+ * The parts of the test that are the same for every stream.
+ */
+struct TestConfig
+{
+    int repetition;
+    int nbufs;
+    int bufsize;
+    int type;
+    size_t messageSize;     //nbufs * bufsize
+    uint32_t durationMs;    //0 to send repetition messages instead
+    uint32_t intervalMs;
+    uint64_t replySize;     //0 unless it's a ping-pong test
+    int depth;              //ping-pong requests in flight per stream
+    uint8_t* databuf;
+    int fileFd;         //tmpfs copy of databuf for sendfile (type 6)
+    pthread_barrier_t startLine;
+};
+
+/*
+ * One connection to the server and what happened on it.
+ */
+struct Stream
+{
+    Transport* transport;
+    int sd;                 //the transport's socket, or -1 for shm
+    uint64_t bytes;
+    uint64_t start;
+    uint64_t sendDone;
+    uint64_t replyDone;
+    int nReads;
+    Histogram writeLatency;
+    int pipe[2];            //for vmsplice and splice (type 5)
+    uint32_t zcSent;        //MSG_ZEROCOPY sends made (type 4)
+    uint32_t zcDone;        //and the ones the kernel reported finished
+    uint32_t zcCopied;      //finished sends that were copied after all
+    TimeSeries throughput;
+    std::deque<uint64_t> inFlight;  //when each unanswered request was sent
+    uint64_t requests;
+    Histogram roundTrip;
+    std::vector<uint8_t> replyBuf;
+    TcpTrace tcp;
+};
+
+/*
+ * The streams driven by one thread.
+ */
+struct Worker
+{
+    TestConfig* config;
+    std::vector<Stream*> streams;
+    int cpu;                    //-1 if the thread isn't pinned
+    ThreadSample threadStart;
+    ThreadSample threadEnd;
+};
+
+//forward declarations
+void* runWorker(void* args);
+void runPingPong(Worker& worker, uint64_t deadline);
+bool wantsMore(const Stream& stream, const TestConfig& config, uint64_t deadline);
+void sendRepetition(Stream& stream, const TestConfig& config);
+bool writeAll(int sd, const uint8_t* data, size_t length);
+bool readAll(Transport& transport, uint8_t* buffer, size_t bufferSize, uint64_t length);
+size_t sendZerocopy(Stream& stream, const uint8_t* data, size_t length);
+void reapZerocopy(Stream& stream, bool wait);
+size_t sendSplice(Stream& stream, uint8_t* data, size_t length);
+int createTmpfsCopy(const uint8_t* data, size_t length);
+long processCpuUsec(long& user, long& system);
+void printResults(const TestConfig& config, std::vector<Stream>& streams, long cpuUser, long cpuSystem);
+void printCpuTime(const TestConfig& config, std::vector<Stream>& streams, double mbps,
+                  long cpuUser, long cpuSystem);
+void printPingPong(const TestConfig& config, std::vector<Stream>& streams);
+void printThreadStats(const std::vector<Worker>& workers);
+void printTcp(const TestConfig& config, std::vector<Stream>& streams);
 
 int main(int argc, char *argv[])
 {
@@ -40,25 +176,68 @@ int main(int argc, char *argv[])
     if (argc < 7)
     {
         std::cerr << "Error: Incorrect number of arguments." << std::endl;
-        std::cerr << "Correct usage: serverIp port repetition nbufs bufsize type" << std::endl;
+        std::cerr << "Correct usage: port repetition nbufs bufsize serverIp type(1-6) [--tsc]" << std::endl;
+        std::cerr << "               [--streams n] [--threads n] [--duration sec] [--interval ms]" << std::endl;
+        std::cerr << "               [--pingpong replySize] [--depth n]" << std::endl;
+        std::cerr << "               [--profile default|latency|throughput|small]" << std::endl;
+        std::cerr << "               [--rcvbuf n] [--sndbuf n] [--nodelay] [--quickack]" << std::endl;
+        std::cerr << "               [--cpus list|irq:interface] [--perf]" << std::endl;
+        std::cerr << "               [--transport tcp|unix|shm] [--ring bytes] [--spin]" << std::endl;
         return -1;
     }
 
     char* serverIp;
     char* port;
-    int repetition;
-    int nbufs;
-    int bufsize;
-    int type;
+    TestConfig config;
+    bool useTsc = false;
+    int nStreams = 1;
+    int nThreads = 1;
+    SocketProfile profile;
+    TransportConfig transportConfig;
+    std::string cpuSpec;
+    std::vector<int> cpus;
 
     try
     {
         port = argv[1];
-        repetition = std::stoi(argv[2]);
-        nbufs = std::stoi(argv[3]);
-        bufsize = std::stoi(argv[4]);
+        config.repetition = std::stoi(argv[2]);
+        config.nbufs = std::stoi(argv[3]);
+        config.bufsize = std::stoi(argv[4]);
         serverIp = argv[5];
-        type = std::stoi(argv[6]);
+        config.type = std::stoi(argv[6]);
+        config.durationMs = 0;
+        config.intervalMs = TimeSeries::DEFAULT_INTERVAL_MS;
+        config.replySize = 0;
+        config.depth = 1;
+
+        for (int i = 7; i < argc; i++)
+        {
+            std::string option = argv[i];
+            if (option == "--tsc")
+                useTsc = true;
+            else if (option == "--streams" && i+1 < argc)
+                nStreams = std::stoi(argv[++i]);
+            else if (option == "--threads" && i+1 < argc)
+                nThreads = std::stoi(argv[++i]);
+            else if (option == "--duration" && i+1 < argc)
+                config.durationMs = std::stod(argv[++i]) * 1000;
+            else if (option == "--interval" && i+1 < argc)
+                config.intervalMs = std::stoi(argv[++i]);
+            else if (option == "--pingpong" && i+1 < argc)
+                config.replySize = std::stoll(argv[++i]);
+            else if (option == "--depth" && i+1 < argc)
+                config.depth = std::stoi(argv[++i]);
+            else if (option == "--cpus" && i+1 < argc)
+                cpuSpec = argv[++i];
+            else if (option == "--perf")
+                ThreadStats::enable();
+            else if (parseTuningOption(i, argc, argv, profile))
+                continue;
+            else if (parseTransportOption(i, argc, argv, transportConfig))
+                continue;
+            else
+                throw std::invalid_argument(option);
+        }
     }
     catch (...)
     {
@@ -68,128 +247,756 @@ int main(int argc, char *argv[])
         return -1;
     }
 
-    if (nbufs * bufsize != BUFSIZE)
+    if (config.nbufs < 1 || config.bufsize < 1 || config.repetition < 0 || config.intervalMs < 1 ||
+        config.depth < 1)
     {
-        std::cerr << "Error: nfufs*bufsize must be " << BUFSIZE << " bytes." << std::endl;
+        std::cerr << "Error: nbufs, bufsize, the interval and the depth must be positive." << std::endl;
         return -1;
     }
+    config.messageSize = (size_t)config.nbufs * config.bufsize;
 
-    if (type < 1 || type > 3)
+    if (config.type < 1 || config.type > 6)
     {
-        std::cerr << "Error: The 'type' must be a value of 1, 2, or 3." << std::endl;
+        std::cerr << "Error: The 'type' must be a value from 1 to 6." << std::endl;
         return -1;
     }
 
-    uint8_t databuf[nbufs][bufsize];
+    if ((config.type == 4 && transportConfig.kind != TRANSPORT_TCP) ||
+        (config.type >= 5 && transportConfig.kind == TRANSPORT_SHM))
+    {
+        std::cerr << "Error: Type 4 needs TCP, and types 5 and 6 need a socket." << std::endl;
+        return -1;
+    }
 
-    int clientSd = connectToHost(serverIp, port);
-    if(clientSd < 0)
+    if (nStreams < 1 || nThreads < 1)
+    {
+        std::cerr << "Error: There must be at least one stream and one thread." << std::endl;
         return -1;
+    }
 
-    timeval start, lap1, lap2;
-    int nReads;
+    //no point in threads that would have no streams to drive
+    if (nThreads > nStreams)
+        nThreads = nStreams;
+
+    if (!cpuSpec.empty() && !resolveCpus(cpuSpec, cpus))
+        return -1;
+
+    //this thread is worker 0, and is pinned before the buffer it sends from is touched
+    if (!cpus.empty() && !pinThread(cpus[0]))
+        return -1;
+
+    Buffer databuf(config.messageSize, cpus.empty() ? -1 : cpuNode(cpus[0]));
+    if (databuf.data() == nullptr)
+    {
+        perror("Could not allocate the message");
+        return -1;
+    }
+    config.databuf = databuf.data();
+    config.fileFd = -1;
+
+    if (config.type == 6)
+    {
+        config.fileFd = createTmpfsCopy(config.databuf, config.messageSize);
+        if (config.fileFd < 0)
+            return -1;
+    }
+
+    if (useTsc && !Clock::useTsc())
+        std::cerr << "Warning: no invariant TSC, using CLOCK_MONOTONIC." << std::endl;
+
+    TestHeader header;
+    header.magic = PROTOCOL_MAGIC;
+    header.mode = config.durationMs > 0 ? MODE_DURATION : MODE_REPETITION;
+    header.messageSize = config.messageSize;
+    header.repetition = config.repetition;
+    header.durationMs = config.durationMs;
+    header.intervalMs = config.intervalMs;
+    header.replySize = config.replySize;
+
+    //connect everything up front so that connection setup isn't timed
+    std::vector<Stream> streams(nStreams);
+    for (int i = 0; i < nStreams; i++)
+    {
+        int sd;
+        if (transportConfig.kind == TRANSPORT_TCP)
+            sd = connectToHost(serverIp, port);
+        else
+            sd = connectUnix(std::atoi(port));
+        if(sd < 0)
+            return -1;
+
+        applyProfile(sd, profile);
+        streams[i].transport = createTransport(transportConfig, sd, true);
+        if (streams[i].transport == nullptr)
+            return -1;
+        streams[i].sd = streams[i].transport->socket();
+
+        if (!writeHeader(*streams[i].transport, header))
+        {
+            perror("Could not send the test header");
+            return -1;
+        }
+
+        streams[i].bytes = 0;
+        streams[i].nReads = 0;
+        streams[i].pipe[0] = streams[i].pipe[1] = -1;
+        streams[i].zcSent = streams[i].zcDone = streams[i].zcCopied = 0;
+        streams[i].requests = 0;
+        streams[i].replyBuf.resize(config.replySize < 65536 ? config.replySize : 65536);
+
+        const int on = 1;
+        if (config.type == 4 && setsockopt(streams[i].sd, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) < 0)
+        {
+            perror("MSG_ZEROCOPY isn't supported");
+            return -1;
+        }
+
+        if (config.type == 5 && pipe(streams[i].pipe) < 0)
+        {
+            perror("pipe error");
+            return -1;
+        }
+    }
+
+    printTransport(std::cout, transportConfig);
+    if (streams[0].sd >= 0)
+        printProfile(std::cout, streams[0].sd, profile);
+    std::cout << "message size = " << config.messageSize << " bytes, ";
+    std::cout << "buffer = " << databuf.backing();
+    if (databuf.node() >= 0)
+        std::cout << ", node = " << databuf.node();
+    std::cout << std::endl;
+
+    //streams are dealt out to the threads round robin
+    std::vector<Worker> workers(nThreads);
+    for (int i = 0; i < nStreams; i++)
+        workers[i % nThreads].streams.push_back(&streams[i]);
+    for (int i = 0; i < nThreads; i++)
+        workers[i].cpu = cpus.empty() ? -1 : cpus[i % cpus.size()];
+
+    pthread_barrier_init(&config.startLine, nullptr, nThreads);
+
+    long userBefore, systemBefore, userAfter, systemAfter;
+    processCpuUsec(userBefore, systemBefore);
+
+    std::vector<pthread_t> threads(nThreads);
+    for (int i = 0; i < nThreads; i++)
+    {
+        workers[i].config = &config;
+        if (i > 0)
+            pthread_create(&threads[i], nullptr, runWorker, &workers[i]);
+    }
+    runWorker(&workers[0]);
+
+    for (int i = 1; i < nThreads; i++)
+        pthread_join(threads[i], nullptr);
 
+    processCpuUsec(userAfter, systemAfter);
+    pthread_barrier_destroy(&config.startLine);
 
-    gettimeofday(&start, 0);
-    for (int i = 0, current = 0; i < repetition; i++, current++)
+    printResults(config, streams, userAfter - userBefore, systemAfter - systemBefore);
+    printTcp(config, streams);
+    if (ThreadStats::enabled())
+        printThreadStats(workers);
+
+    for (int i = 0; i < nStreams; i++)
     {
-        switch (type)
+        delete streams[i].transport;
+        if (streams[i].pipe[0] >= 0)
         {
-        case 1:
+            close(streams[i].pipe[0]);
+            close(streams[i].pipe[1]);
+        }
+    }
+    if (config.fileFd >= 0)
+        close(config.fileFd);
+    return 0;
+}
+
+/*
+ * Runs the test on each of a worker's streams. A thread with several streams
+ * takes turns, sending one repetition on each of them in order, so that they
+ * all make progress together.
+ *
+ * A timed run then shuts down the sending side of every stream, which is how
+ * the server knows it has everything.
+ *
+ * This function is intended to be run in a separate thread using pthreads.
+ */
+void* runWorker(void* args)
+{
+    Worker* worker = (Worker*)args;
+    const TestConfig& config = *worker->config;
+
+    if (worker->cpu >= 0)
+        pinThread(worker->cpu);
+
+    //opens the performance counters, which shouldn't happen on the clock
+    worker->threadStart = ThreadStats::sample();
+
+    //every thread starts sending at the same moment
+    pthread_barrier_wait(&worker->config->startLine);
+    uint64_t start = Clock::now();
+    for (std::size_t s = 0; s < worker->streams.size(); s++)
+    {
+        worker->streams[s]->start = start;
+        worker->streams[s]->throughput.start(start, config.intervalMs);
+        worker->streams[s]->tcp.start(worker->streams[s]->sd, start, config.intervalMs);
+    }
+
+    uint64_t deadline = start + config.durationMs * 1000000ULL;
+    if (config.replySize > 0)
+        runPingPong(*worker, deadline);
+    else
+    {
+        for (int i = 0; config.durationMs > 0 ? Clock::now() < deadline : i < config.repetition; i++)
         {
-            for (int j = 0; j < nbufs; j++)
+            for (std::size_t s = 0; s < worker->streams.size(); s++)
+                sendRepetition(*worker->streams[s], config);
+        }
+    }
+
+    //zero-copy sends aren't done until the kernel lets go of the buffer
+    for (std::size_t s = 0; s < worker->streams.size(); s++)
+    {
+        Stream& stream = *worker->streams[s];
+        while (stream.zcDone < stream.zcSent)
+            reapZerocopy(stream, true);
+        stream.sendDone = Clock::now();
+        if (config.durationMs > 0)
+            stream.transport->shutdownSend();
+    }
+
+    for (std::size_t s = 0; s < worker->streams.size(); s++)
+    {
+        Stream& stream = *worker->streams[s];
+        receiveAll(*stream.transport, (uint8_t*)&stream.nReads, sizeof(stream.nReads));
+        stream.replyDone = Clock::now();
+
+        //everything has been acknowledged by now
+        stream.tcp.finish();
+    }
+
+    worker->threadEnd = ThreadStats::sample();
+    ThreadStats::release();
+    return nullptr;
+}
+
+/*
+ * Runs a ping-pong test on each of a worker's streams. Every stream starts
+ * with depth requests in flight, and then sends a new one each time a reply
+ * comes back, until it has sent enough (or the time is up) and every request
+ * has been answered. The streams are served round robin, one reply at a time.
+ */
+void runPingPong(Worker& worker, uint64_t deadline)
+{
+    const TestConfig& config = *worker.config;
+    std::vector<Stream*>& streams = worker.streams;
+
+    for (int d = 0; d < config.depth; d++)
+    {
+        for (std::size_t s = 0; s < streams.size(); s++)
+        {
+            Stream& stream = *streams[s];
+            if (wantsMore(stream, config, deadline))
             {
-                write(clientSd, databuf[j], bufsize);
+                stream.inFlight.push_back(Clock::now());
+                sendRepetition(stream, config);
+                stream.requests++;
             }
-            break;
         }
-        case 2:
+    }
+
+    bool waiting = true;
+    while (waiting)
+    {
+        waiting = false;
+        for (std::size_t s = 0; s < streams.size(); s++)
         {
-            struct iovec vect[nbufs];
-            for (int j = 0; j < nbufs; j++)
+            Stream& stream = *streams[s];
+            if (stream.inFlight.empty())
+                continue;
+
+            waiting = true;
+            if (!readAll(*stream.transport, stream.replyBuf.data(), stream.replyBuf.size(), config.replySize))
+            {
+                //the server went away, so no more replies are coming
+                stream.inFlight.clear();
+                continue;
+            }
+
+            stream.roundTrip.record(Clock::now() - stream.inFlight.front());
+            stream.inFlight.pop_front();
+
+            if (wantsMore(stream, config, deadline))
             {
-                vect[j].iov_base = databuf[j];
-                vect[j].iov_len = bufsize;
+                stream.inFlight.push_back(Clock::now());
+                sendRepetition(stream, config);
+                stream.requests++;
             }
-            writev(clientSd, vect, nbufs);
-            break;
         }
-        case 3:
+    }
+}
+
+/*
+ * Whether the stream has more messages to send, by count or by time.
+ */
+bool wantsMore(const Stream& stream, const TestConfig& config, uint64_t deadline)
+{
+    if (config.durationMs > 0)
+        return Clock::now() < deadline;
+    return stream.requests < (uint64_t)config.repetition;
+}
+
+/*
+ * Sends one message on the stream using the configured type of write.
+ */
+void sendRepetition(Stream& stream, const TestConfig& config)
+{
+    int nbufs = config.nbufs;
+    size_t bufsize = config.bufsize;
+    size_t length = config.messageSize;
+    uint8_t* databuf = config.databuf;
+    uint64_t before;
+    size_t sent = length;   //what types 4 to 6 got through before an error
+
+    switch (config.type)
+    {
+    case 1:
+    {
+        for (int j = 0; j < nbufs; j++)
         {
-            write(clientSd, databuf, nbufs * bufsize);
-            break;
-        }
+            before = Clock::now();
+            sendAll(*stream.transport, databuf + j * bufsize, bufsize);
+            stream.writeLatency.record(Clock::now() - before);
         }
+        break;
     }
-    gettimeofday(&lap1, 0);
-
-    read(clientSd, &nReads, sizeof(nReads));
+    case 2:
+    {
+        //writev() takes at most IOV_MAX buffers at a time
+        struct iovec vect[IOV_MAX];
+        for (int j = 0; j < nbufs; j += IOV_MAX)
+        {
+            int count = nbufs - j < IOV_MAX ? nbufs - j : IOV_MAX;
+            for (int k = 0; k < count; k++)
+            {
+                vect[k].iov_base = databuf + (j + k) * bufsize;
+                vect[k].iov_len = bufsize;
+            }
 
-    gettimeofday(&lap2, 0);
+            before = Clock::now();
+            ssize_t written = stream.transport->sendv(vect, count);
 
-    long dataTime = (lap1.tv_sec - start.tv_sec)*1000000;
-    dataTime += (lap1.tv_usec - start.tv_usec);
+            //the buffers are back to back, so a short write is finished in one go
+            if (written >= 0 && (size_t)written < count * bufsize)
+                sendAll(*stream.transport, databuf + j * bufsize + written, count * bufsize - written);
+            stream.writeLatency.record(Clock::now() - before);
+        }
+        break;
+    }
+    case 3:
+    {
+        before = Clock::now();
+        sendAll(*stream.transport, databuf, length);
+        stream.writeLatency.record(Clock::now() - before);
+        break;
+    }
+    case 4:
+    {
+        before = Clock::now();
+        sent = sendZerocopy(stream, databuf, length);
+        stream.writeLatency.record(Clock::now() - before);
+        break;
+    }
+    case 5:
+    {
+        before = Clock::now();
+        sent = sendSplice(stream, databuf, length);
+        stream.writeLatency.record(Clock::now() - before);
+        break;
+    }
+    case 6:
+    {
+        //each stream has its own offset, so they can share the file
+        off_t offset = 0;
+        before = Clock::now();
+        while ((size_t)offset < length)
+        {
+            if (sendfile(stream.sd, config.fileFd, &offset, length - offset) <= 0)
+                break;
+        }
+        sent = offset;
+        stream.writeLatency.record(Clock::now() - before);
+        break;
+    }
+    }
 
-    long roundTime = (lap2.tv_sec - start.tv_sec)*1000000;
-    roundTime += (lap2.tv_usec - start.tv_usec);
+    uint64_t now = Clock::now();
+    stream.bytes += sent;
+    stream.throughput.record(now, sent);
+    stream.tcp.poll(now);
+}
 
-    std::cout << "Test " << type << ":";
-    std::cout << " data-sending time = " << dataTime << "usec, ";
-    std::cout << "round-trip time = "<< roundTime << "usec, ";
-    std::cout << "#reads = " << nReads << std::endl;
+/*
+ * Writes all of data, which a single write() won't do for a large enough
+ * length (Linux moves at most about 2GB per call).
+ *
+ * Returns false if the connection failed.
+ */
+bool writeAll(int sd, const uint8_t* data, size_t length)
+{
+    size_t written = 0;
+    while (written < length)
+    {
+        ssize_t bytes = write(sd, data + written, length - written);
+        if (bytes < 0 && errno == EINTR)
+            continue;
+        if (bytes <= 0)
+            return false;
+        written += bytes;
+    }
+    return true;
+}
 
-    close(clientSd);
-    return 0;
+/*
+ * Reads length bytes and throws them away, using a buffer of bufferSize bytes
+ * as often as it takes.
+ *
+ * Returns false if the connection failed or closed first.
+ */
+bool readAll(Transport& transport, uint8_t* buffer, size_t bufferSize, uint64_t length)
+{
+    while (length > 0)
+    {
+        ssize_t bytes = transport.receive(buffer, length < bufferSize ? length : bufferSize);
+        if (bytes < 0 && errno == EINTR)
+            continue;
+        if (bytes <= 0)
+            return false;
+        length -= bytes;
+    }
+    return true;
 }
 
 /*
- * Attempts to create connection to a given host using the specified port.
+ * Sends with MSG_ZEROCOPY, which pins the pages of data instead of copying
+ * them. The kernel reports when it's done with them on the error queue, and
+ * refuses more sends (ENOBUFS) once too many reports are waiting to be read.
  *
- * Any encountered errors will be printed to stderr.
+ * ENOBUFS with no reports to wait for means the kernel couldn't pin the pages
+ * at all, so that part is copied with an ordinary send() instead.
  *
- * Returns a socket descriptor if successful, or -1 on failure.
+ * data never changes during the test, so there is no need to wait for the
+ * completion before the buffer is sent again.
+ *
+ * Returns the number of bytes sent, which is length unless the send failed.
  */
-int connectToHost(char* host, char* port)
+size_t sendZerocopy(Stream& stream, const uint8_t* data, size_t length)
 {
-    addrinfo* serverAddress;
-    addrinfo hints;
-    std::memset(&hints, 0, sizeof(hints));
-    hints.ai_family = AF_INET;
-    hints.ai_socktype = SOCK_STREAM;
+    size_t sent = 0;
+    while (sent < length)
+    {
+        bool zerocopy = true;
+        ssize_t bytes = send(stream.sd, data + sent, length - sent, MSG_ZEROCOPY);
+        if (bytes < 0 && errno == ENOBUFS)
+        {
+            if (stream.zcDone < stream.zcSent)
+            {
+                reapZerocopy(stream, true);
+                continue;
+            }
+            zerocopy = false;
+            bytes = send(stream.sd, data + sent, length - sent, 0);
+        }
+        if (bytes < 0 && errno == EINTR)
+            continue;
+        if (bytes <= 0)
+            return sent;
+
+        sent += bytes;
+        if (zerocopy)
+            stream.zcSent++;
+    }
+
+    reapZerocopy(stream, false);
+    return sent;
+}
 
-    //attempt to resolve the IP address
-    int result = getaddrinfo(host, port, &hints, &serverAddress);
-    if (result != 0)
+/*
+ * Reads the zero-copy completions that are waiting on the error queue. Each
+ * one covers a range of sends, counted from 0 in the order they were made.
+ *
+ * The error queue never blocks, so waiting is done with poll(), which always
+ * reports POLLERR when there is something on it. It only waits while sends
+ * are outstanding, and for at most ZEROCOPY_WAIT_MS, so a report that never
+ * comes can't hang the caller.
+ */
+void reapZerocopy(Stream& stream, bool wait)
+{
+    if (wait && stream.zcDone < stream.zcSent)
     {
-        std::cerr << "getaddrinfo: " << gai_strerror(result) << std::endl;
-        return -1;
+        pollfd pfd;
+        pfd.fd = stream.sd;
+        pfd.events = 0;
+        poll(&pfd, 1, ZEROCOPY_WAIT_MS);
     }
 
-    //check to see if we got anything that allows us to make a connection
-    int sd;
-    for (addrinfo* addr = serverAddress; addr != NULL; addr = addr->ai_next)
+    while (true)
     {
-        sd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
-        if (sd < 0)
-            continue;
+        char control[128];
+        msghdr msg;
+        std::memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
 
-        if (connect(sd, addr->ai_addr, addr->ai_addrlen) < 0)
+        if (recvmsg(stream.sd, &msg, MSG_ERRQUEUE) < 0)
+            return;
+
+        for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg))
         {
-            close(sd);
-            sd = -1;
-            continue;
+            bool isV4 = cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR;
+            bool isV6 = cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR;
+            if (!isV4 && !isV6)
+                continue;
+
+            sock_extended_err* error = (sock_extended_err*)CMSG_DATA(cmsg);
+            if (error->ee_errno != 0 || error->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+                continue;
+
+            //ee_info to ee_data is the inclusive range of sends that finished
+            uint32_t finished = error->ee_data - error->ee_info + 1;
+            stream.zcDone += finished;
+            if (error->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+                stream.zcCopied += finished;
         }
+    }
+}
 
-        break;
+/*
+ * Maps the pages of data into the stream's pipe with vmsplice(), then moves
+ * them from the pipe to the socket with splice(), so the data is never copied
+ * through a user buffer on the way.
+ *
+ * Returns the number of bytes that reached the socket.
+ */
+size_t sendSplice(Stream& stream, uint8_t* data, size_t length)
+{
+    size_t mapped = 0, spliced = 0;
+    while (spliced < length)
+    {
+        if (mapped < length)
+        {
+            iovec vect;
+            vect.iov_base = data + mapped;
+            vect.iov_len = length - mapped;
+
+            ssize_t bytes = vmsplice(stream.pipe[1], &vect, 1, 0);
+            if (bytes <= 0)
+                return spliced;
+            mapped += bytes;
+        }
+
+        ssize_t bytes = splice(stream.pipe[0], nullptr, stream.sd, nullptr, mapped - spliced, SPLICE_F_MOVE);
+        if (bytes <= 0)
+            return spliced;
+        spliced += bytes;
     }
+    return spliced;
+}
 
-    freeaddrinfo(serverAddress);
+/*
+ * Writes data to an unlinked file in tmpfs, so that sendfile() reads it from
+ * the page cache rather than from a disk.
+ *
+ * Returns the open file, or -1.
+ */
+int createTmpfsCopy(const uint8_t* data, size_t length)
+{
+    char path[] = "/dev/shm/client-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0)
+    {
+        perror("Could not create a file in /dev/shm");
+        return -1;
+    }
+    unlink(path);
 
-    if (sd < 0)
+    if (!writeAll(fd, data, length))
     {
-        perror("socket error");
+        perror("Could not write to /dev/shm");
+        close(fd);
         return -1;
     }
 
-    return sd;
-}
\ No newline at end of file
+    return fd;
+}
+
+/*
+ * CPU time used by every thread of the process so far, in microseconds.
+ */
+long processCpuUsec(long& user, long& system)
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    user = usage.ru_utime.tv_sec * 1000000L + usage.ru_utime.tv_usec;
+    system = usage.ru_stime.tv_sec * 1000000L + usage.ru_stime.tv_usec;
+    return user + system;
+}
+
+/*
+ * A single stream prints the classic one line result. Several streams also
+ * get a line each, followed by the aggregate throughput, Jain's fairness index
+ * over the per-stream throughputs (1 means perfectly even) and the combined
+ * write latency. Both finish with the CPU time the whole run took.
+ */
+void printResults(const TestConfig& config, std::vector<Stream>& streams, long cpuUser, long cpuSystem)
+{
+    std::string latencyLabel = std::string("write latency (ns, ") + Clock::source() + ")";
+
+    if (streams.size() == 1)
+    {
+        long dataTime = (streams[0].sendDone - streams[0].start) / 1000;
+        long roundTime = (streams[0].replyDone - streams[0].start) / 1000;
+
+        std::cout << "Test " << config.type << ":";
+        std::cout << " data-sending time = " << dataTime << "usec, ";
+        std::cout << "round-trip time = "<< roundTime << "usec, ";
+        std::cout << "#reads = " << streams[0].nReads << std::endl;
+        streams[0].writeLatency.printPercentiles(std::cout, latencyLabel);
+        printPingPong(config, streams);
+        printCpuTime(config, streams, streams[0].bytes * 8.0 / ((streams[0].replyDone - streams[0].start) / 1000.0),
+                     cpuUser, cpuSystem);
+        return;
+    }
+
+    Histogram allLatency;
+    uint64_t totalBytes = 0, firstStart = streams[0].start, lastDone = 0;
+    double sum = 0, sumOfSquares = 0;
+
+    for (std::size_t i = 0; i < streams.size(); i++)
+    {
+        Stream& stream = streams[i];
+        long dataTime = (stream.sendDone - stream.start) / 1000;
+        long roundTime = (stream.replyDone - stream.start) / 1000;
+        double mbps = stream.bytes * 8.0 / ((stream.replyDone - stream.start) / 1000.0);
+
+        std::cout << "Stream " << i << ": Test " << config.type << ":";
+        std::cout << " data-sending time = " << dataTime << "usec, ";
+        std::cout << "round-trip time = "<< roundTime << "usec, ";
+        std::cout << "#reads = " << stream.nReads << ", ";
+        std::cout << "throughput = " << mbps << "Mbps" << std::endl;
+
+        allLatency.merge(stream.writeLatency);
+        totalBytes += stream.bytes;
+        if (stream.start < firstStart)
+            firstStart = stream.start;
+        if (stream.replyDone > lastDone)
+            lastDone = stream.replyDone;
+        sum += mbps;
+        sumOfSquares += mbps * mbps;
+    }
+
+    double fairness = (sum * sum) / (streams.size() * sumOfSquares);
+    long wallTime = (lastDone - firstStart) / 1000;
+
+    std::cout << "Aggregate: " << streams.size() << " streams, ";
+    std::cout << "time = " << wallTime << "usec, ";
+    std::cout << "throughput = " << totalBytes * 8.0 / ((lastDone - firstStart) / 1000.0) << "Mbps, ";
+    std::cout << "fairness = " << fairness << std::endl;
+    allLatency.printPercentiles(std::cout, latencyLabel);
+    printPingPong(config, streams);
+    printCpuTime(config, streams, totalBytes * 8.0 / ((lastDone - firstStart) / 1000.0), cpuUser, cpuSystem);
+}
+
+/*
+ * Prints the throughput next to what it cost, and for MSG_ZEROCOPY how many
+ * sends really avoided the copy (over loopback the kernel always copies).
+ * Timed runs finish with the throughput of every interval.
+ */
+void printCpuTime(const TestConfig& config, std::vector<Stream>& streams, double mbps,
+                  long cpuUser, long cpuSystem)
+{
+    uint64_t bytes = 0;
+    uint32_t zcSent = 0, zcCopied = 0;
+    for (std::size_t i = 0; i < streams.size(); i++)
+    {
+        bytes += streams[i].bytes;
+        zcSent += streams[i].zcSent;
+        zcCopied += streams[i].zcCopied;
+    }
+
+    std::cout << "throughput = " << mbps << "Mbps, ";
+    std::cout << "cpu time = " << cpuUser + cpuSystem << "usec, ";
+    std::cout << "user time = " << cpuUser << "usec, ";
+    std::cout << "system time = " << cpuSystem << "usec, ";
+    std::cout << "cpu per byte = " << (cpuUser + cpuSystem) * 1000.0 / bytes << "ns";
+    if (config.type == 4)
+        std::cout << ", zerocopy sends = " << zcSent << ", copied = " << zcCopied;
+    std::cout << std::endl;
+
+    if (config.durationMs > 0)
+    {
+        TimeSeries throughput;
+        for (std::size_t i = 0; i < streams.size(); i++)
+            throughput.merge(streams[i].throughput);
+        throughput.print(std::cout, "send throughput");
+    }
+}
+
+/*
+ * For a ping-pong test, prints how many requests were answered, how many per
+ * second, and the percentiles of their round-trip times over every stream.
+ */
+void printPingPong(const TestConfig& config, std::vector<Stream>& streams)
+{
+    if (config.replySize == 0)
+        return;
+
+    Histogram roundTrip;
+    uint64_t firstStart = streams[0].start, lastDone = 0;
+    for (std::size_t i = 0; i < streams.size(); i++)
+    {
+        roundTrip.merge(streams[i].roundTrip);
+        if (streams[i].start < firstStart)
+            firstStart = streams[i].start;
+        if (streams[i].sendDone > lastDone)
+            lastDone = streams[i].sendDone;
+    }
+
+    std::cout << "requests = " << roundTrip.count() << ", ";
+    std::cout << "request size = " << config.messageSize << ", ";
+    std::cout << "reply size = " << config.replySize << ", ";
+    std::cout << "depth = " << config.depth << ", ";
+    std::cout << "request rate = " << roundTrip.count() / ((lastDone - firstStart) / 1e9) << "/s" << std::endl;
+    roundTrip.printPercentiles(std::cout, std::string("round-trip latency (ns, ") + Clock::source() + ")");
+}
+
+/*
+ * Prints what each sending thread cost, one line per thread.
+ */
+void printThreadStats(const std::vector<Worker>& workers)
+{
+    for (std::size_t i = 0; i < workers.size(); i++)
+    {
+        std::string label = "client thread " + std::to_string(i);
+        ThreadStats::print(std::cout, label, workers[i].threadStart, workers[i].threadEnd);
+    }
+}
+
+/*
+ * Prints what TCP made of each stream when it finished, and how that changed
+ * over a timed run, so a slow run can be put down to the network (cwnd, RTT,
+ * retransmits), the receiver (rwnd limited) or the sender (sndbuf or
+ * application limited).
+ */
+void printTcp(const TestConfig& config, std::vector<Stream>& streams)
+{
+    for (std::size_t i = 0; i < streams.size(); i++)
+    {
+        std::string label = "client tcp";
+        if (streams.size() > 1)
+            label += ", stream " + std::to_string(i);
+        streams[i].tcp.print(std::cout, label, config.durationMs > 0);
+    }
+}
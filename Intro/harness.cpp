@@ -0,0 +1,871 @@
+/*
+ * Description:
+ * harness.cpp runs a benchmark over a sweep of parameters and summarizes it.
+ * Every point of the sweep is run a few times to warm up, then a number of
+ * measured times, and every "name = number" the benchmark prints is collected
+ * as a metric. Each metric gets its mean, median, standard deviation and 95%
+ * confidence interval, printed and optionally written as CSV or JSON. The
+ * CSV can be kept as a baseline, and a later run compared against it flags
+ * the metrics that got significantly worse.
+ *
+ * A sweep is described in a spec file (see sweep.spec):
+ *
+ *   # comments start with a hash
+ *   server = ./server {port}
+ *   command = ./client {port} {rep} {nbufs} {bufsize} {ip} {type}
+ *   set port = 3458
+ *   vary type = 1 2 3
+ *   vary nbufs,bufsize = 10,150 12,125 15,100
+ *   warmup = 1
+ *   iterations = 10
+ *   timeout = 60
+ *   higher = throughput
+ *   lower = data-sending time, round-trip time
+ *
+ * {name} in the command is replaced by the value of a set or vary. Each vary
+ * is a list of values (or of comma separated tuples, for parameters that go
+ * together), and the sweep runs every combination, the first vary changing
+ * slowest. The server, if there is one, is started before the first run and
+ * restarted whenever the parameters it uses change. higher and lower name the
+ * metrics compared against the baseline, and which way is better.
+ *
+ * A "[name]" line starts another sweep in the same file, which starts from
+ * everything above the first [name] and adds its own lines.
+ *
+ * Metrics are read from stdout and stderr together. Lines like
+ * "label: n=10 p50=20" become "label p50", indented lines (time series and
+ * distributions) are skipped, and if a name appears more than once in a run,
+ * its last value counts.
+ *
+ * It is intended to be part of an introduction in network programming.
+ */
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <cerrno>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <time.h>
+
+enum
+{
+    DEFAULT_ITERATIONS = 10,
+    DEFAULT_TIMEOUT_SEC = 60,
+    SERVER_START_MS = 300,      //time the server is given to start listening
+    DEFAULT_THRESHOLD_PCT = 5
+};
+
+/*
+ * One parameter, or several that change together, and the values it takes.
+ */
+struct Vary
+{
+    std::vector<std::string> names;
+    std::vector<std::vector<std::string> > values;
+};
+
+/*
+ * One sweep from the spec file.
+ */
+struct Sweep
+{
+    std::string name;
+    std::string command;
+    std::string server;
+    std::map<std::string, std::string> sets;
+    std::vector<Vary> varies;
+    int warmup;
+    int iterations;
+    int timeoutSec;
+    std::set<std::string> higher;   //metrics where more is better
+    std::set<std::string> lower;    //and where less is better
+};
+
+/*
+ * The summary of one metric at one point of a sweep.
+ */
+struct Summary
+{
+    std::string sweep;
+    std::string point;      //"type=1 nbufs=10 bufsize=150"
+    std::string metric;
+    int n;
+    double mean;
+    double median;
+    double stddev;
+    double ci95;            //half the width of the 95% confidence interval
+    double min;
+    double max;
+};
+
+//forward declarations
+bool parseSpec(const std::string& path, std::vector<Sweep>& sweeps);
+void applySpecLine(Sweep& sweep, const std::string& key, const std::string& value);
+std::vector<std::string> splitList(const std::string& list, char separator);
+std::string trim(const std::string& text);
+bool expand(const std::string& pattern, const std::map<std::string, std::string>& values, std::string& result);
+void runSweep(const Sweep& sweep, std::vector<Summary>& summaries);
+bool runCommand(const std::string& command, int timeoutSec, std::string& output);
+pid_t startServer(const std::string& command);
+void stopServer(pid_t pid);
+void parseMetrics(const std::string& output, std::map<std::string, double>& metrics);
+Summary summarize(const std::vector<double>& samples);
+double tCritical(int degrees);
+void printSummary(std::ostream& out, const Summary& summary);
+void writeCsv(const std::string& path, const std::vector<Summary>& summaries);
+void writeJson(const std::string& path, const std::vector<Summary>& summaries);
+bool readCsv(const std::string& path, std::vector<Summary>& summaries);
+int compareBaseline(const std::vector<Sweep>& sweeps, const std::vector<Summary>& summaries,
+                    const std::vector<Summary>& baseline, double thresholdPct);
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        std::cerr << "Error: Incorrect number of arguments." << std::endl;
+        std::cerr << "Correct usage: spec [--set name=value] [--csv file] [--json file]" << std::endl;
+        std::cerr << "               [--baseline file] [--threshold percent] [--iterations n]" << std::endl;
+        return -1;
+    }
+
+    std::string csvPath, jsonPath, baselinePath;
+    double thresholdPct = DEFAULT_THRESHOLD_PCT;
+    int iterations = 0;
+    std::map<std::string, std::string> overrides;
+
+    try
+    {
+        for (int i = 2; i < argc; i++)
+        {
+            std::string option = argv[i];
+            if (option == "--csv" && i+1 < argc)
+                csvPath = argv[++i];
+            else if (option == "--json" && i+1 < argc)
+                jsonPath = argv[++i];
+            else if (option == "--baseline" && i+1 < argc)
+                baselinePath = argv[++i];
+            else if (option == "--threshold" && i+1 < argc)
+                thresholdPct = std::stod(argv[++i]);
+            else if (option == "--iterations" && i+1 < argc)
+                iterations = std::stoi(argv[++i]);
+            else if (option == "--set" && i+1 < argc)
+            {
+                std::string assignment = argv[++i];
+                size_t equals = assignment.find('=');
+                if (equals == std::string::npos)
+                    throw std::invalid_argument(assignment);
+                overrides[assignment.substr(0, equals)] = assignment.substr(equals + 1);
+            }
+            else
+                throw std::invalid_argument(option);
+        }
+    }
+    catch (...)
+    {
+        std::cerr << "Error: Something is wrong with your arguments." << std::endl;
+        return -1;
+    }
+
+    std::vector<Sweep> sweeps;
+    if (!parseSpec(argv[1], sweeps))
+        return -1;
+
+    //the command line wins over the spec, e.g. for the server's address
+    for (std::size_t i = 0; i < sweeps.size(); i++)
+    {
+        for (std::map<std::string, std::string>::iterator it = overrides.begin(); it != overrides.end(); it++)
+            sweeps[i].sets[it->first] = it->second;
+        if (iterations > 0)
+            sweeps[i].iterations = iterations;
+    }
+
+    //a failed run shouldn't take the harness with it
+    signal(SIGPIPE, SIG_IGN);
+
+    std::vector<Summary> summaries;
+    for (std::size_t i = 0; i < sweeps.size(); i++)
+        runSweep(sweeps[i], summaries);
+
+    if (!csvPath.empty())
+        writeCsv(csvPath, summaries);
+    if (!jsonPath.empty())
+        writeJson(jsonPath, summaries);
+
+    if (!baselinePath.empty())
+    {
+        std::vector<Summary> baseline;
+        if (!readCsv(baselinePath, baseline))
+            return -1;
+
+        //regressions make the harness fail, so a script can stop on them
+        if (compareBaseline(sweeps, summaries, baseline, thresholdPct) > 0)
+            return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Reads the spec file into one or more sweeps.
+ *
+ * Returns false, after printing why, if the file can't be used.
+ */
+bool parseSpec(const std::string& path, std::vector<Sweep>& sweeps)
+{
+    std::ifstream file(path.c_str());
+    if (!file)
+    {
+        std::cerr << "Error: Could not open " << path << "." << std::endl;
+        return false;
+    }
+
+    Sweep defaults;
+    defaults.name = "sweep";
+    defaults.warmup = 1;
+    defaults.iterations = DEFAULT_ITERATIONS;
+    defaults.timeoutSec = DEFAULT_TIMEOUT_SEC;
+
+    std::string line;
+    int lineNumber = 0;
+    Sweep* current = &defaults;
+    while (std::getline(file, line))
+    {
+        lineNumber++;
+        size_t hash = line.find('#');
+        if (hash != std::string::npos && (hash == 0 || isspace(line[hash - 1])))
+            line = line.substr(0, hash);
+        line = trim(line);
+        if (line.empty())
+            continue;
+
+        if (line[0] == '[' && line[line.size() - 1] == ']')
+        {
+            sweeps.push_back(defaults);
+            sweeps.back().name = trim(line.substr(1, line.size() - 2));
+            current = &sweeps.back();
+            continue;
+        }
+
+        size_t equals = line.find('=');
+        if (equals == std::string::npos)
+        {
+            std::cerr << "Error: " << path << ":" << lineNumber << " isn't 'key = value'." << std::endl;
+            return false;
+        }
+
+        try
+        {
+            applySpecLine(*current, trim(line.substr(0, equals)), trim(line.substr(equals + 1)));
+        }
+        catch (std::exception& error)
+        {
+            std::cerr << "Error: " << path << ":" << lineNumber << ": " << error.what() << std::endl;
+            return false;
+        }
+    }
+
+    if (sweeps.empty())
+        sweeps.push_back(defaults);
+
+    for (std::size_t i = 0; i < sweeps.size(); i++)
+    {
+        if (sweeps[i].command.empty())
+        {
+            std::cerr << "Error: The sweep " << sweeps[i].name << " has no command." << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Applies one "key = value" line of the spec to a sweep. Throws
+ * std::invalid_argument if it doesn't make sense.
+ */
+void applySpecLine(Sweep& sweep, const std::string& key, const std::string& value)
+{
+    if (key == "command")
+        sweep.command = value;
+    else if (key == "server")
+        sweep.server = value;
+    else if (key == "warmup")
+        sweep.warmup = std::stoi(value);
+    else if (key == "iterations")
+        sweep.iterations = std::stoi(value);
+    else if (key == "timeout")
+        sweep.timeoutSec = std::stoi(value);
+    else if (key == "higher" || key == "lower")
+    {
+        std::vector<std::string> names = splitList(value, ',');
+        for (std::size_t i = 0; i < names.size(); i++)
+            (key == "higher" ? sweep.higher : sweep.lower).insert(names[i]);
+    }
+    else if (key.compare(0, 4, "set ") == 0)
+        sweep.sets[trim(key.substr(4))] = value;
+    else if (key.compare(0, 5, "vary ") == 0)
+    {
+        Vary vary;
+        vary.names = splitList(key.substr(5), ',');
+
+        std::istringstream in(value);
+        std::string tuple;
+        while (in >> tuple)
+        {
+            std::vector<std::string> values = splitList(tuple, ',');
+            if (values.size() != vary.names.size())
+                throw std::invalid_argument("'" + tuple + "' doesn't match " + key.substr(5));
+            vary.values.push_back(values);
+        }
+
+        if (vary.values.empty())
+            throw std::invalid_argument(key + " has no values");
+        sweep.varies.push_back(vary);
+    }
+    else
+        throw std::invalid_argument("unknown key " + key);
+
+    if (sweep.iterations < 1 || sweep.warmup < 0 || sweep.timeoutSec < 1)
+        throw std::invalid_argument("iterations and timeout must be positive");
+}
+
+std::vector<std::string> splitList(const std::string& list, char separator)
+{
+    std::vector<std::string> items;
+    std::istringstream in(list);
+    std::string item;
+    while (std::getline(in, item, separator))
+    {
+        item = trim(item);
+        if (!item.empty())
+            items.push_back(item);
+    }
+    return items;
+}
+
+std::string trim(const std::string& text)
+{
+    size_t first = text.find_first_not_of(" \t\r\n");
+    if (first == std::string::npos)
+        return "";
+    size_t last = text.find_last_not_of(" \t\r\n");
+    return text.substr(first, last - first + 1);
+}
+
+/*
+ * Replaces every {name} in pattern with its value.
+ *
+ * Returns false, after printing why, if a name has no value.
+ */
+bool expand(const std::string& pattern, const std::map<std::string, std::string>& values, std::string& result)
+{
+    result.clear();
+    size_t position = 0;
+    while (position < pattern.size())
+    {
+        size_t open = pattern.find('{', position);
+        size_t close = open == std::string::npos ? open : pattern.find('}', open);
+        if (close == std::string::npos)
+        {
+            result += pattern.substr(position);
+            break;
+        }
+
+        std::string name = pattern.substr(open + 1, close - open - 1);
+        std::map<std::string, std::string>::const_iterator found = values.find(name);
+        if (found == values.end())
+        {
+            std::cerr << "Error: Nothing sets {" << name << "}." << std::endl;
+            return false;
+        }
+
+        result += pattern.substr(position, open - position) + found->second;
+        position = close + 1;
+    }
+    return true;
+}
+
+/*
+ * Runs every point of a sweep, adding the summary of each metric at each
+ * point to summaries.
+ */
+void runSweep(const Sweep& sweep, std::vector<Summary>& summaries)
+{
+    //like an odometer over the varies, the last one turning fastest
+    std::vector<std::size_t> odometer(sweep.varies.size(), 0);
+    std::string runningServer;
+    pid_t serverPid = -1;
+
+    std::cout << "Running sweep " << sweep.name << std::endl;
+    while (true)
+    {
+        std::map<std::string, std::string> values = sweep.sets;
+        std::string point;
+        for (std::size_t v = 0; v < sweep.varies.size(); v++)
+        {
+            const Vary& vary = sweep.varies[v];
+            for (std::size_t n = 0; n < vary.names.size(); n++)
+            {
+                values[vary.names[n]] = vary.values[odometer[v]][n];
+                point += (point.empty() ? "" : " ") + vary.names[n] + "=" + vary.values[odometer[v]][n];
+            }
+        }
+        if (point.empty())
+            point = "default";
+
+        std::string command, server;
+        if (!expand(sweep.command, values, command) || !expand(sweep.server, values, server))
+            break;
+
+        if (server != runningServer)
+        {
+            stopServer(serverPid);
+            serverPid = server.empty() ? -1 : startServer(server);
+            runningServer = server;
+        }
+
+        std::map<std::string, std::vector<double> > samples;
+        int failures = 0;
+        for (int i = 0; i < sweep.warmup + sweep.iterations; i++)
+        {
+            std::string output;
+            std::map<std::string, double> metrics;
+            if (!runCommand(command, sweep.timeoutSec, output))
+            {
+                failures++;
+                continue;
+            }
+            parseMetrics(output, metrics);
+
+            //warmup runs only get the caches, connections and CPU clocks going
+            if (i < sweep.warmup)
+                continue;
+            for (std::map<std::string, double>::iterator it = metrics.begin(); it != metrics.end(); it++)
+                samples[it->first].push_back(it->second);
+        }
+
+        std::cout << point;
+        if (failures > 0)
+            std::cout << " (" << failures << " runs failed)";
+        std::cout << std::endl;
+
+        for (std::map<std::string, std::vector<double> >::iterator it = samples.begin(); it != samples.end(); it++)
+        {
+            Summary summary = summarize(it->second);
+            summary.sweep = sweep.name;
+            summary.point = point;
+            summary.metric = it->first;
+            printSummary(std::cout, summary);
+            summaries.push_back(summary);
+        }
+
+        //next point
+        int v = (int)sweep.varies.size() - 1;
+        while (v >= 0 && ++odometer[v] == sweep.varies[v].values.size())
+            odometer[v--] = 0;
+        if (v < 0)
+            break;
+    }
+
+    stopServer(serverPid);
+}
+
+/*
+ * Runs a command with sh, collecting what it writes to stdout and stderr. It
+ * is killed, along with anything it started, if it takes longer than
+ * timeoutSec.
+ *
+ * Returns false, after printing why, if it failed or timed out.
+ */
+bool runCommand(const std::string& command, int timeoutSec, std::string& output)
+{
+    int fds[2];
+    if (pipe(fds) < 0)
+    {
+        perror("pipe error");
+        return false;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        //its own process group, so a timeout kills the whole pipeline
+        setpgid(0, 0);
+        signal(SIGPIPE, SIG_DFL);
+        dup2(fds[1], STDOUT_FILENO);
+        dup2(fds[1], STDERR_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        execl("/bin/sh", "sh", "-c", command.c_str(), (char*)nullptr);
+        _exit(127);
+    }
+    if (pid < 0)
+    {
+        perror("fork error");
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    close(fds[1]);
+
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long long deadline = now.tv_sec * 1000LL + now.tv_nsec / 1000000 + timeoutSec * 1000LL;
+    bool timedOut = false;
+
+    char buffer[4096];
+    while (true)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long long left = deadline - (now.tv_sec * 1000LL + now.tv_nsec / 1000000);
+        pollfd pfd;
+        pfd.fd = fds[0];
+        pfd.events = POLLIN;
+        if (left <= 0 || poll(&pfd, 1, left) == 0)
+        {
+            timedOut = true;
+            kill(-pid, SIGKILL);
+            break;
+        }
+
+        ssize_t bytes = read(fds[0], buffer, sizeof(buffer));
+        if (bytes < 0 && errno == EINTR)
+            continue;
+        if (bytes <= 0)
+            break;
+        output.append(buffer, bytes);
+    }
+    close(fds[0]);
+
+    int status;
+    waitpid(pid, &status, 0);
+    if (timedOut)
+    {
+        std::cerr << "Error: Timed out: " << command << std::endl;
+        return false;
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        std::cerr << "Error: Failed: " << command << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Starts the server in the background, discarding its output, and gives it
+ * a moment to start listening.
+ *
+ * Returns its process group, or -1.
+ */
+pid_t startServer(const std::string& command)
+{
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        setpgid(0, 0);
+        signal(SIGPIPE, SIG_DFL);
+        freopen("/dev/null", "w", stdout);
+        freopen("/dev/null", "w", stderr);
+        execl("/bin/sh", "sh", "-c", command.c_str(), (char*)nullptr);
+        _exit(127);
+    }
+    if (pid < 0)
+    {
+        perror("fork error");
+        return -1;
+    }
+
+    //set from here too, or a quick stopServer() could race the child's setpgid()
+    setpgid(pid, pid);
+    usleep(SERVER_START_MS * 1000);
+    return pid;
+}
+
+/*
+ * SIGINT first, which server.cpp handles by closing its socket.
+ */
+void stopServer(pid_t pid)
+{
+    if (pid <= 0)
+        return;
+
+    kill(-pid, SIGINT);
+    for (int i = 0; i < 20 && waitpid(pid, nullptr, WNOHANG) == 0; i++)
+        usleep(50 * 1000);
+    kill(-pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+}
+
+/*
+ * Collects "name = number" pairs from a run's output. Units after the number
+ * ("usec", "Mbps") are ignored.
+ */
+void parseMetrics(const std::string& output, std::map<std::string, double>& metrics)
+{
+    std::istringstream in(output);
+    std::string line;
+    while (std::getline(in, line))
+    {
+        //time series and distributions are indented, and would repeat names
+        if (line.empty() || isspace(line[0]))
+            continue;
+
+        //"label: n=10 p50=20" is a set of percentiles named after the label
+        std::string prefix;
+        size_t colon = line.find(": ");
+        if (colon != std::string::npos && line.find(" = ") == std::string::npos)
+        {
+            prefix = line.substr(0, colon);
+            size_t parenthesis = prefix.find(" (");
+            if (parenthesis != std::string::npos)
+                prefix = prefix.substr(0, parenthesis);
+            prefix += " ";
+            line = line.substr(colon + 1);
+        }
+
+        size_t start = 0;
+        size_t equals;
+        while ((equals = line.find('=', start)) != std::string::npos)
+        {
+            //the name runs back to the last separator
+            size_t nameStart = line.find_last_of(prefix.empty() ? ",:" : ", ", equals);
+            nameStart = nameStart == std::string::npos || nameStart < start ? start : nameStart + 1;
+            std::string name = trim(line.substr(nameStart, equals - nameStart));
+
+            const char* value = line.c_str() + equals + 1;
+            char* end;
+            double number = std::strtod(value, &end);
+            if (end != value && !name.empty())
+                metrics[prefix + name] = number;
+            start = equals + 1;
+        }
+    }
+}
+
+Summary summarize(const std::vector<double>& samples)
+{
+    Summary summary;
+    std::vector<double> sorted = samples;
+    std::sort(sorted.begin(), sorted.end());
+
+    summary.n = sorted.size();
+    summary.min = sorted.front();
+    summary.max = sorted.back();
+    summary.median = summary.n % 2 ? sorted[summary.n / 2] : (sorted[summary.n / 2 - 1] + sorted[summary.n / 2]) / 2;
+
+    double sum = 0;
+    for (int i = 0; i < summary.n; i++)
+        sum += sorted[i];
+    summary.mean = sum / summary.n;
+
+    //sample standard deviation, and Student's t for the interval
+    double squares = 0;
+    for (int i = 0; i < summary.n; i++)
+        squares += (sorted[i] - summary.mean) * (sorted[i] - summary.mean);
+    summary.stddev = summary.n > 1 ? std::sqrt(squares / (summary.n - 1)) : 0;
+    summary.ci95 = summary.n > 1 ? tCritical(summary.n - 1) * summary.stddev / std::sqrt(summary.n) : 0;
+    return summary;
+}
+
+/*
+ * The two-sided 95% critical value of Student's t distribution.
+ */
+double tCritical(int degrees)
+{
+    static const double table[] =
+    {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+    };
+
+    if (degrees <= 30)
+        return table[degrees - 1];
+    if (degrees <= 60)
+        return 2.000;
+    if (degrees <= 120)
+        return 1.980;
+    return 1.960;
+}
+
+void printSummary(std::ostream& out, const Summary& summary)
+{
+    out << "  " << summary.metric << ": mean = " << summary.mean;
+    out << " +/- " << summary.ci95;
+    out << ", median = " << summary.median << ", stddev = " << summary.stddev;
+    out << ", min = " << summary.min << ", max = " << summary.max;
+    out << ", n = " << summary.n << std::endl;
+}
+
+void writeCsv(const std::string& path, const std::vector<Summary>& summaries)
+{
+    std::ofstream file(path.c_str());
+    file.precision(10);
+    file << "sweep,point,metric,n,mean,median,stddev,ci95,min,max" << std::endl;
+    for (std::size_t i = 0; i < summaries.size(); i++)
+    {
+        const Summary& s = summaries[i];
+        file << '"' << s.sweep << "\",\"" << s.point << "\",\"" << s.metric << "\",";
+        file << s.n << "," << s.mean << "," << s.median << "," << s.stddev << ",";
+        file << s.ci95 << "," << s.min << "," << s.max << std::endl;
+    }
+
+    if (!file)
+        std::cerr << "Error: Could not write " << path << "." << std::endl;
+}
+
+/*
+ * Escapes what can show up in a metric name for a JSON string.
+ */
+static std::string jsonString(const std::string& text)
+{
+    std::string escaped = "\"";
+    for (std::size_t i = 0; i < text.size(); i++)
+    {
+        if (text[i] == '"' || text[i] == '\\')
+            escaped += '\\';
+        escaped += text[i];
+    }
+    return escaped + "\"";
+}
+
+void writeJson(const std::string& path, const std::vector<Summary>& summaries)
+{
+    std::ofstream file(path.c_str());
+    file.precision(10);
+    file << "[" << std::endl;
+    for (std::size_t i = 0; i < summaries.size(); i++)
+    {
+        const Summary& s = summaries[i];
+        file << "  {\"sweep\": " << jsonString(s.sweep) << ", \"point\": " << jsonString(s.point);
+        file << ", \"metric\": " << jsonString(s.metric) << ", \"n\": " << s.n;
+        file << ", \"mean\": " << s.mean << ", \"median\": " << s.median;
+        file << ", \"stddev\": " << s.stddev << ", \"ci95\": " << s.ci95;
+        file << ", \"min\": " << s.min << ", \"max\": " << s.max << "}";
+        file << (i + 1 < summaries.size() ? "," : "") << std::endl;
+    }
+    file << "]" << std::endl;
+
+    if (!file)
+        std::cerr << "Error: Could not write " << path << "." << std::endl;
+}
+
+/*
+ * Reads back a CSV written by writeCsv().
+ *
+ * Returns false, after printing why, if it can't be read.
+ */
+bool readCsv(const std::string& path, std::vector<Summary>& summaries)
+{
+    std::ifstream file(path.c_str());
+    std::string line;
+    if (!std::getline(file, line))
+    {
+        std::cerr << "Error: Could not read the baseline " << path << "." << std::endl;
+        return false;
+    }
+
+    while (std::getline(file, line))
+    {
+        //three quoted fields, then the numbers
+        std::vector<std::string> quoted;
+        size_t position = 0;
+        for (int i = 0; i < 3; i++)
+        {
+            size_t open = line.find('"', position);
+            size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+            if (close == std::string::npos)
+                break;
+            quoted.push_back(line.substr(open + 1, close - open - 1));
+            position = close + 1;
+        }
+
+        Summary s;
+        char comma;
+        std::istringstream numbers(line.substr(position));
+        if (quoted.size() != 3 || !(numbers >> comma >> s.n >> comma >> s.mean >> comma >> s.median >> comma >>
+                                    s.stddev >> comma >> s.ci95 >> comma >> s.min >> comma >> s.max))
+        {
+            std::cerr << "Error: The baseline " << path << " isn't a CSV from this harness." << std::endl;
+            return false;
+        }
+
+        s.sweep = quoted[0];
+        s.point = quoted[1];
+        s.metric = quoted[2];
+        summaries.push_back(s);
+    }
+    return true;
+}
+
+/*
+ * Compares the metrics each sweep names in higher and lower with the
+ * baseline. A metric regressed if its mean got worse by more than
+ * thresholdPct and the two confidence intervals don't overlap, so that noise
+ * alone isn't reported.
+ *
+ * Returns the number of regressions.
+ */
+int compareBaseline(const std::vector<Sweep>& sweeps, const std::vector<Summary>& summaries,
+                    const std::vector<Summary>& baseline, double thresholdPct)
+{
+    std::map<std::string, const Summary*> before;
+    for (std::size_t i = 0; i < baseline.size(); i++)
+        before[baseline[i].sweep + "|" + baseline[i].point + "|" + baseline[i].metric] = &baseline[i];
+
+    std::map<std::string, const Sweep*> sweepNamed;
+    for (std::size_t i = 0; i < sweeps.size(); i++)
+        sweepNamed[sweeps[i].name] = &sweeps[i];
+
+    int regressions = 0, compared = 0;
+    std::cout << "Comparing with the baseline" << std::endl;
+    for (std::size_t i = 0; i < summaries.size(); i++)
+    {
+        const Summary& now = summaries[i];
+        const Sweep& sweep = *sweepNamed[now.sweep];
+        bool higherIsBetter = sweep.higher.count(now.metric) > 0;
+        if (!higherIsBetter && sweep.lower.count(now.metric) == 0)
+            continue;
+
+        std::map<std::string, const Summary*>::iterator found =
+            before.find(now.sweep + "|" + now.point + "|" + now.metric);
+        if (found == before.end() || found->second->mean == 0)
+            continue;
+
+        const Summary& then = *found->second;
+        double changePct = (now.mean - then.mean) * 100.0 / std::fabs(then.mean);
+        double worsePct = higherIsBetter ? -changePct : changePct;
+        bool separated = std::fabs(now.mean - then.mean) > now.ci95 + then.ci95;
+        compared++;
+
+        if (worsePct > thresholdPct && separated)
+        {
+            regressions++;
+            std::cout << "REGRESSION " << now.sweep << " " << now.point << ": " << now.metric;
+            std::cout << " = " << now.mean << " (was " << then.mean << ", ";
+            std::cout << (changePct > 0 ? "+" : "") << changePct << "%)" << std::endl;
+        }
+        else if (-worsePct > thresholdPct && separated)
+        {
+            std::cout << "improved " << now.sweep << " " << now.point << ": " << now.metric;
+            std::cout << " = " << now.mean << " (was " << then.mean << ", ";
+            std::cout << (changePct > 0 ? "+" : "") << changePct << "%)" << std::endl;
+        }
+    }
+
+    std::cout << "compared = " << compared << ", regressions = " << regressions << std::endl;
+    return regressions;
+}
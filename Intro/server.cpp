@@ -4,7 +4,44 @@
  *
  * Description:
  * server.cpp is a server that is used to read a set amount of data from a
- * client, and then print how long it spent reading.
+ * client, and then print how long it spent reading. The client says how much
+ * it will send in a header at the start of the connection (see Protocol.h),
+ * or that it will send for a fixed time, in which case the throughput of
+ * every interval is printed too. In a ping-pong test every message is
+ * answered with a reply of the size the client asked for. The latency and size of
+ * every read() are recorded as well, and printed as percentiles and a size
+ * distribution.
+ *
+ * --engine picks how the data is received: a blocking thread per client
+ * (threads, the default), a single thread with epoll, or a single thread with
+ * io_uring. See ServerEngine.h.
+ *
+ * The threads engine can also receive in different ways, picked with --recv:
+ *
+ *   read     - read() the rest of the current message (the original)
+ *   large    - read() into one large buffer, ignoring message boundaries
+ *   readv    - readv() the rest of the message and the next ones, scattered
+ *              into separate buffers
+ *   waitall  - recv() each message with MSG_WAITALL
+ *   lowat    - read() like the original, but with SO_RCVLOWAT set to the
+ *              message size so that the kernel only wakes us up for whole
+ *              messages
+ *   busypoll - read() like the original, with SO_BUSY_POLL set so that the
+ *              kernel spins on the device queue before sleeping
+ *   trunc    - recv() with MSG_TRUNC, which throws the data away in the
+ *              kernel instead of copying it out
+ *
+ * Socket profiles (see SocketTuning.h) are applied to every connection.
+ *
+ * --transport unix listens on a Unix domain socket instead of TCP, and
+ * --transport shm receives through shared memory rings (see Transport.h),
+ * which only the threads engine with --recv read or large can do.
+ *
+ * --cpus pins the threads that serve clients, round robin over a CPU list or
+ * the CPUs next to a network card's interrupts (see Affinity.h). Buffers are
+ * allocated after pinning, so they land on the CPU's own NUMA node. --perf
+ * adds each serving thread's context switches and hardware counters to its
+ * results (see ThreadStats.h).
  *
  * It is intended to be part of an introduction in network programming.
  */
@@ -13,47 +50,115 @@
 #include <iostream>
 #include <string>
 #include <cstring>
+#include <cstdio>
 #include <netdb.h>
 #include <unistd.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 #include <cstdint>
 #include <pthread.h>
 #include <signal.h>
-#include <sys/time.h>
+#include <stdexcept>
+#include <vector>
+#include "Clock.h"
+#include "Affinity.h"
+#include "ThreadStats.h"
+#include "ServerEngine.h"
+#include "SocketTuning.h"
+#include "Protocol.h"
+#include "Transport.h"
+
+enum RecvStrategy
+{
+    RECV_READ,
+    RECV_LARGE,
+    RECV_READV,
+    RECV_WAITALL,
+    RECV_LOWAT,
+    RECV_BUSYPOLL,
+    RECV_TRUNC,
+    RECV_STRATEGIES
+};
 
 enum
 {
-    BUFSIZE = 1500,
-    ALLOWED_CONNECTIONS = 16
+    LARGE_BUFSIZE = 256 * 1024,
+    READV_BUFFERS = 16,
+    BUSY_POLL_USEC = 50
+};
+
+const char* strategyNames[RECV_STRATEGIES] =
+{
+    "read", "large", "readv", "waitall", "lowat", "busypoll", "trunc"
 };
 
 //forward declarations
 void interruptHandler(int signal);
 int createSocketListener(int port);
 void *handleClient(void *args);
+bool prepareStrategy(int sd, const TestHeader& header);
+int receiveOnce(Transport& transport, uint8_t* databuf, const ReceiveStats& stats);
 
 //global to allow cleanup if we receive SIGINT
 int serverSd;
 
-//because console output is not reentrant
-pthread_mutex_t mut = PTHREAD_MUTEX_INITIALIZER;
+//how every client is received, set once before any clients are accepted
+RecvStrategy strategy = RECV_READ;
+SocketProfile profile;
+TransportConfig transportConfig;
+std::vector<int> cpus;
+int serverPort;
 
 int main(int argc, char *argv[])
 {
-    //should have 3 arguments here
-    if (argc < 3)
+    //should have at least 2 arguments here
+    if (argc < 2)
     {
         std::cerr << "Error: Incorrect number of arguments." << std::endl;
-        std::cerr << "Correct usage: port repetition" << std::endl;
+        std::cerr << "Correct usage: port [--tsc] [--engine threads|epoll|uring]" << std::endl;
+        std::cerr << "               [--recv read|large|readv|waitall|lowat|busypoll|trunc]" << std::endl;
+        std::cerr << "               [--profile default|latency|throughput|small]" << std::endl;
+        std::cerr << "               [--rcvbuf n] [--sndbuf n] [--nodelay] [--quickack]" << std::endl;
+        std::cerr << "               [--cpus list|irq:interface] [--perf]" << std::endl;
+        std::cerr << "               [--transport tcp|unix|shm] [--spin]" << std::endl;
         return -1;
     }
 
     int port;
-    int repetition;
+    bool useTsc = false;
+    std::string engine = "threads";
+    std::string recv = "read";
+    std::string cpuSpec;
 
     try
     {
         port = std::stoi(argv[1]);
-        repetition = std::stoi(argv[2]);
+
+        //the repetition used to be given here, it comes from the client now
+        int i = 2;
+        if (i < argc && argv[i][0] != '-')
+            std::stoi(argv[i++]);
+
+        for (; i < argc; i++)
+        {
+            std::string option = argv[i];
+            if (option == "--tsc")
+                useTsc = true;
+            else if (option == "--engine" && i+1 < argc)
+                engine = argv[++i];
+            else if (option == "--recv" && i+1 < argc)
+                recv = argv[++i];
+            else if (option == "--cpus" && i+1 < argc)
+                cpuSpec = argv[++i];
+            else if (option == "--perf")
+                ThreadStats::enable();
+            else if (parseTuningOption(i, argc, argv, profile))
+                continue;
+            else if (parseTransportOption(i, argc, argv, transportConfig))
+                continue;
+            else
+                throw std::invalid_argument(option);
+        }
     }
     catch (...)
     {
@@ -63,16 +168,68 @@ int main(int argc, char *argv[])
         return -1;
     }
 
+    if (engine != "threads" && engine != "epoll" && engine != "uring")
+    {
+        std::cerr << "Error: The engine must be threads, epoll or uring." << std::endl;
+        return -1;
+    }
+
+    int found = 0;
+    while (found < RECV_STRATEGIES && recv != strategyNames[found])
+        found++;
+    if (found == RECV_STRATEGIES)
+    {
+        std::cerr << "Error: Unknown receive strategy " << recv << "." << std::endl;
+        return -1;
+    }
+    strategy = (RecvStrategy)found;
+
+    if (strategy != RECV_READ && engine != "threads")
+    {
+        std::cerr << "Error: --recv only applies to the threads engine." << std::endl;
+        return -1;
+    }
+
+    //the rings are read by a blocking thread, with no socket to poll or set options on
+    if (transportConfig.kind == TRANSPORT_SHM &&
+        (engine != "threads" || (strategy != RECV_READ && strategy != RECV_LARGE)))
+    {
+        std::cerr << "Error: shm only works with the threads engine and --recv read or large." << std::endl;
+        return -1;
+    }
+
+    if (!cpuSpec.empty() && !resolveCpus(cpuSpec, cpus))
+        return -1;
+
+    if (useTsc && !Clock::useTsc())
+        std::cerr << "Warning: no invariant TSC, using CLOCK_MONOTONIC." << std::endl;
+
     //start handling SIGINT (closes the server socket before termination)
     signal(SIGINT, interruptHandler);
 
+    serverPort = port;
     serverSd = createSocketListener(port);
+    printTransport(std::cout, transportConfig);
+    printProfile(std::cout, serverSd, profile);
+
+    //the event-driven engines serve every client from this thread
+    if (engine != "threads" && !cpus.empty())
+        pinThread(cpus[0]);
+    if (engine == "epoll")
+        runEpollEngine(serverSd);
+    else if (engine == "uring")
+        runUringEngine(serverSd);
+    if (engine != "threads")
+    {
+        close(serverSd);
+        return -1;
+    }
 
     sockaddr_in newSockAddr;
     socklen_t newSockAddrSize = sizeof(newSockAddr);
 
     //allow the server to keep looking for incoming connections
-    while (true)
+    for (int clients = 0; ; clients++)
     {
         int newSd = accept(serverSd, (sockaddr*)&newSockAddr, &newSockAddrSize);
 
@@ -81,7 +238,7 @@ int main(int argc, char *argv[])
         pthread_t newThread;
         int* args = new int[2];
         args[0] = newSd;
-        args[1] = repetition;
+        args[1] = cpus.empty() ? -1 : cpus[clients % cpus.size()];
         pthread_create(&newThread, nullptr, handleClient, args);
         pthread_detach(newThread);
     }
@@ -96,6 +253,8 @@ void interruptHandler(int signal)
 {
     std::cout << "\nClosing server socket" << std::endl;
     close(serverSd);
+    if (transportConfig.kind != TRANSPORT_TCP)
+        unlink(unixPath(serverPort).c_str());
     exit(0);
 }
 
@@ -103,12 +262,30 @@ void interruptHandler(int signal)
  * Create a new socket that listens for incoming connections on a given port.
  *
  * This socket will accept connections from any IP address and will reuse local
- * addresses for new incoming connections.
+ * addresses for new incoming connections. The unix and shm transports listen
+ * on a Unix domain socket named after the port instead.
  *
  * Returns a valid socket descriptor.
  */
 int createSocketListener(int port)
 {
+    if (transportConfig.kind != TRANSPORT_TCP)
+    {
+        sockaddr_un unixSockAddr;
+        std::memset(&unixSockAddr, 0, sizeof(unixSockAddr));
+        unixSockAddr.sun_family = AF_UNIX;
+        std::strncpy(unixSockAddr.sun_path, unixPath(port).c_str(), sizeof(unixSockAddr.sun_path) - 1);
+
+        //left behind by a server that didn't get to clean up
+        unlink(unixSockAddr.sun_path);
+
+        int sd = socket(AF_UNIX, SOCK_STREAM, 0);
+        bind(sd, (sockaddr *)&unixSockAddr, sizeof(unixSockAddr));
+        applyProfile(sd, profile);
+        listen(sd, ALLOWED_CONNECTIONS);
+        return sd;
+    }
+
     //Allow server to accept a connection from any IP address on the given port
     sockaddr_in acceptSockAddr;
     std::memset(&acceptSockAddr, 0, sizeof(acceptSockAddr));
@@ -124,6 +301,9 @@ int createSocketListener(int port)
     setsockopt(sd, SOL_SOCKET, SO_REUSEADDR, (char *)&on, sizeof(on));
     bind(sd, (sockaddr *)&acceptSockAddr, sizeof(acceptSockAddr));
 
+    //before listen() so that the window scale reflects the buffer sizes
+    applyProfile(sd, profile);
+
     listen(sd, ALLOWED_CONNECTIONS);
 
     return sd;
@@ -142,33 +322,139 @@ void* handleClient(void *args)
     int* arguments = (int *)args;
     int sd = arguments[0];
 
-    int repetition = arguments[1];
-    uint8_t databuf[BUFSIZE];
+    //before the buffer is touched, so that it's local to the CPU
+    if (arguments[1] >= 0)
+        pinThread(arguments[1]);
 
-    timeval start, end;
-    int nRead, count = 0;
+    uint8_t* databuf = new uint8_t[LARGE_BUFSIZE];
+    uint64_t before;
+    size_t position;
+    TestHeader header;
+    ReceiveStats stats;
 
-    gettimeofday(&start, 0);
-    for (int i = 0; i < repetition; i++)
+    applyProfile(sd, profile);
+
+    //for shm, this waits for the client's rings
+    Transport* transport = createTransport(transportConfig, sd, false);
+
+    if (transport != nullptr && readHeader(*transport, header))
     {
-        nRead = 0;
-        while (nRead < BUFSIZE)
+        prepareStrategy(sd, header);
+
+        //messages are back to back, so only the total matters
+        startReceive(stats, header, transport->socket());
+        while (nextRead(stats, LARGE_BUFSIZE, position) > 0)
         {
-            nRead += read(sd, &databuf[nRead], BUFSIZE - nRead);
-            count++;
+            before = Clock::now();
+            int bytes = receiveOnce(*transport, databuf, stats);
+            stats.readLatency.record(Clock::now() - before);
+            stats.reads++;
+
+            //the end of a duration run, or the client went away early
+            if (bytes <= 0)
+                break;
+
+            recordRead(stats, bytes);
+            rearmQuickAck(sd, profile);
+
+            uint64_t reply = replyOwed(stats, bytes);
+            if (reply > 0 && !writeReply(*transport, databuf, LARGE_BUFSIZE, reply, stats))
+                break;
         }
+        endReceive(stats);
+        sendAll(*transport, (uint8_t*)&stats.reads, sizeof(stats.reads));
 
+        //a blocking read is one wakeup
+        stats.wakeups = stats.reads;
+        reportReceive((std::string("threads/") + strategyNames[strategy]).c_str(), stats);
+    }
+
+    delete[] databuf;
+    delete transport;
+    delete[](arguments);
+    ThreadStats::release();
+    return nullptr;
+}
+
+/*
+ * Sets the socket options the receive strategy depends on.
+ *
+ * Returns false, after printing why, if the kernel refused them.
+ */
+bool prepareStrategy(int sd, const TestHeader& header)
+{
+    int value;
+    if (strategy == RECV_LOWAT)
+    {
+        value = header.messageSize < LARGE_BUFSIZE ? header.messageSize : LARGE_BUFSIZE;
+        if (setsockopt(sd, SOL_SOCKET, SO_RCVLOWAT, &value, sizeof(value)) < 0)
+        {
+            perror("SO_RCVLOWAT error");
+            return false;
+        }
+    }
+    else if (strategy == RECV_BUSYPOLL)
+    {
+        //raising it past net.core.busy_read needs CAP_NET_ADMIN
+        value = BUSY_POLL_USEC;
+        if (setsockopt(sd, SOL_SOCKET, SO_BUSY_POLL, &value, sizeof(value)) < 0)
+        {
+            perror("SO_BUSY_POLL error");
+            return false;
+        }
     }
-    gettimeofday(&end, 0);
-    write(sd, &count, sizeof(count));
 
-    long receiveTime = (end.tv_sec - start.tv_sec)*1000000;
-    receiveTime += (end.tv_usec - start.tv_usec);
+    return true;
+}
 
-    pthread_mutex_lock(&mut);
-    std::cout << "data-receiving time = "<< receiveTime <<"usec" << std::endl;
-    pthread_mutex_unlock(&mut);
+/*
+ * Makes one receive call using the current strategy. No strategy asks for
+ * more than the client has left to send, so the reply is never read.
+ * read and large go through the transport; the rest need its socket.
+ *
+ * Returns what the call returned.
+ */
+int receiveOnce(Transport& transport, uint8_t* databuf, const ReceiveStats& stats)
+{
+    int sd = transport.socket();
+    size_t position;
+    size_t size = nextRead(stats, LARGE_BUFSIZE, position);
 
-    close(sd);
-    delete[](arguments);
-}
\ No newline at end of file
+    //ignoring message boundaries, as much as fits in the buffer
+    long long left = expectedBytes(stats.header) - stats.bytes;
+    int large = LARGE_BUFSIZE;
+    if (stats.header.mode != MODE_DURATION && left < large)
+        large = left;
+
+    switch (strategy)
+    {
+    case RECV_LARGE:
+        return transport.receive(databuf, large);
+    case RECV_READV:
+    {
+        //the rest of this message, then whole ones after it while they fit
+        uint64_t messageSize = stats.header.messageSize;
+        iovec vect[READV_BUFFERS];
+        vect[0].iov_base = databuf + position;
+        vect[0].iov_len = size;
+        left -= size;
+
+        int count = 1;
+        while (count < READV_BUFFERS && (count + 1) * messageSize <= LARGE_BUFSIZE &&
+               (left > 0 || stats.header.mode == MODE_DURATION))
+        {
+            vect[count].iov_base = databuf + count * messageSize;
+            vect[count].iov_len = messageSize;
+            left -= messageSize;
+            count++;
+        }
+        return readv(sd, vect, count);
+    }
+    case RECV_WAITALL:
+        return recv(sd, databuf + position, size, MSG_WAITALL);
+    case RECV_TRUNC:
+        return recv(sd, nullptr, large, MSG_TRUNC);
+    default:
+        return transport.receive(databuf + position, size);
+    }
+}
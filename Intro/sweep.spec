@@ -0,0 +1,24 @@
+# The sweep test.sh runs, for the harness:
+#   ./harness sweep.spec --set ip=<server> --set rep=<repetition>
+# Leave the server line in to test against a local server, or take it out
+# and start ./server 3458 on the other host.
+server = ./server {port}
+command = ./client {port} {rep} {nbufs} {bufsize} {ip} {type}
+set port = 3458
+set ip = 127.0.0.1
+set rep = 20000
+warmup = 1
+iterations = 10
+timeout = 60
+higher = throughput
+lower = data-sending time, round-trip time, cpu time, write latency p99
+
+[copying]
+vary type = 1 2 3
+vary nbufs,bufsize = 10,150 12,125 15,100 20,75 30,50 60,25
+
+# the zero-copy types send the whole buffer at once, so only one split matters
+[zerocopy]
+vary type = 4 5 6
+set nbufs = 1
+set bufsize = 1500
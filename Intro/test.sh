@@ -33,3 +33,12 @@ for i in `seq 0 5`;
 			done
         done
 
+#the zero-copy types send the whole buffer at once, so only one split matters
+for TYPE in 4 5 6;
+	do
+        echo "Running Tests for Type $TYPE"
+		for j in `seq 1 10`;
+			do
+				echo $(./client $PORT $REP 1 1500 $IP $TYPE)
+			done
+        done
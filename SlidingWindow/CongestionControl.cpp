@@ -0,0 +1,272 @@
+/*
+ * Description:
+ * CongestionControl.cpp implements the congestion control algorithms declared
+ * in CongestionControl.h.
+ *
+ * It is intended to be part of a series on network programming.
+ */
+
+#include "CongestionControl.h"
+#include <cmath>
+#include <cstddef>
+
+enum
+{
+    INITIAL_SSTHRESH = 1 << 30,     //slow start until the first loss
+    MIN_WINDOW = 2
+};
+
+/*
+ * Slow start, then +1 packet per window of ACKs; halved on a loss, and back
+ * to one packet after a timeout.
+ */
+class AimdControl : public CongestionControl
+{
+public:
+    AimdControl(double maxWindow) : cwnd(1), ssthresh(INITIAL_SSTHRESH), maxWindow(maxWindow) {}
+
+    const char* name() const { return "aimd"; }
+
+    void onAck(int acked, long, long)
+    {
+        if(cwnd < ssthresh)
+            cwnd += acked;
+        else
+            cwnd += (double)acked / cwnd;
+
+        if(cwnd > maxWindow)
+            cwnd = maxWindow;
+    }
+
+    void onLoss(long)
+    {
+        ssthresh = cwnd / 2 > MIN_WINDOW ? cwnd / 2 : (double)MIN_WINDOW;
+        cwnd = ssthresh;
+    }
+
+    void onTimeout(long)
+    {
+        ssthresh = cwnd / 2 > MIN_WINDOW ? cwnd / 2 : (double)MIN_WINDOW;
+        cwnd = 1;
+    }
+
+    double window() const { return cwnd; }
+
+private:
+    double cwnd;
+    double ssthresh;
+    double maxWindow;
+};
+
+/*
+ * CUBIC, with fast convergence and the TCP-friendly region. Its curve is in
+ * seconds, so on a path with a tiny RTT the Reno estimate is what grows the
+ * window, which is what RFC 8312 intends.
+ */
+class CubicControl : public CongestionControl
+{
+public:
+    CubicControl(double maxWindow) : cwnd(1), ssthresh(INITIAL_SSTHRESH), maxWindow(maxWindow),
+                                     wMax(0), lastWMax(0), epochStart(0), k(0), origin(0),
+                                     wEst(0), minRtt(0) {}
+
+    const char* name() const { return "cubic"; }
+
+    void onAck(int acked, long rtt, long now)
+    {
+        if(rtt > 0 && (minRtt == 0 || rtt < minRtt))
+            minRtt = rtt;
+
+        if(cwnd < ssthresh)
+        {
+            cwnd = cwnd + acked < maxWindow ? cwnd + acked : maxWindow;
+            return;
+        }
+
+        if(epochStart == 0)
+        {
+            //a new congestion avoidance epoch, centred on the last loss
+            epochStart = now;
+            if(cwnd < wMax)
+            {
+                k = std::cbrt((wMax - cwnd) / C);
+                origin = wMax;
+            }
+            else
+            {
+                k = 0;
+                origin = cwnd;
+            }
+            wEst = cwnd;
+        }
+
+        //where the curve will be one RTT from now
+        double t = (now - epochStart + minRtt) / 1e6;
+        double target = origin + C * (t - k) * (t - k) * (t - k);
+
+        //Reno's window over the same time, which CUBIC never falls behind
+        wEst += 3 * (1 - BETA) / (1 + BETA) * acked / cwnd;
+        if(wEst > target)
+            target = wEst;
+
+        if(target > cwnd)
+            cwnd += (target - cwnd) / cwnd * acked;
+        else
+            cwnd += 0.01 * acked / cwnd;
+
+        if(cwnd > maxWindow)
+            cwnd = maxWindow;
+    }
+
+    void onLoss(long)
+    {
+        epochStart = 0;
+
+        //fast convergence: let go of bandwidth sooner if the last loss came earlier
+        if(cwnd < lastWMax)
+            wMax = cwnd * (1 + BETA) / 2;
+        else
+            wMax = cwnd;
+        lastWMax = cwnd;
+
+        cwnd = cwnd * BETA > MIN_WINDOW ? cwnd * BETA : (double)MIN_WINDOW;
+        ssthresh = cwnd;
+    }
+
+    void onTimeout(long now)
+    {
+        onLoss(now);
+        cwnd = 1;
+    }
+
+    double window() const { return cwnd; }
+
+private:
+    static constexpr double C = 0.4;
+    static constexpr double BETA = 0.7;
+
+    double cwnd;
+    double ssthresh;
+    double maxWindow;
+    double wMax;        //the window at the last loss
+    double lastWMax;
+    long epochStart;    //when the current epoch started, 0 for none
+    double k;           //seconds the curve takes to get back to wMax
+    double origin;
+    double wEst;        //the window Reno would have
+    long minRtt;
+};
+
+/*
+ * A window-based take on BBR. Once per round trip it measures the delivery
+ * rate, keeping the highest of the last ROUNDS, and the minimum RTT; the
+ * window is then the bandwidth-delay product times a gain that starts high
+ * to find the bottleneck, and then cycles a little above and below 1 to probe
+ * for more while draining any queue. Losses alone don't shrink it.
+ */
+class BbrControl : public CongestionControl
+{
+public:
+    BbrControl(double maxWindow) : cwnd(INITIAL_WINDOW), maxWindow(maxWindow), minRtt(0),
+                                   roundStart(0), delivered(0), round(0), startup(true),
+                                   fullRounds(0), fullRate(0), cycle(0)
+    {
+        for(int i = 0; i < ROUNDS; i++)
+            rates[i] = 0;
+    }
+
+    const char* name() const { return "bbr"; }
+
+    void onAck(int acked, long rtt, long now)
+    {
+        if(rtt > 0 && (minRtt == 0 || rtt < minRtt))
+            minRtt = rtt;
+        delivered += acked;
+
+        if(roundStart == 0)
+            roundStart = now;
+
+        //a round trip is over: take the delivery rate of it
+        if(minRtt == 0 || now - roundStart < minRtt)
+            return;
+        rates[round % ROUNDS] = delivered / (double)(now - roundStart);
+        round++;
+        roundStart = now;
+        delivered = 0;
+
+        double bottleneck = 0;
+        for(int i = 0; i < ROUNDS; i++)
+            bottleneck = rates[i] > bottleneck ? rates[i] : bottleneck;
+
+        double gain;
+        if(startup)
+        {
+            //the pipe is full once the rate stops growing by a quarter
+            if(bottleneck >= fullRate * 1.25)
+            {
+                fullRate = bottleneck;
+                fullRounds = 0;
+            }
+            else if(++fullRounds >= 3)
+                startup = false;
+            gain = STARTUP_GAIN;
+        }
+        else
+        {
+            static const double cycleGains[] = {1.25, 0.75, 1, 1, 1, 1, 1, 1};
+            gain = cycleGains[cycle++ % 8];
+        }
+
+        double bdp = bottleneck * minRtt;
+        cwnd = 2 * gain * bdp;
+        if(cwnd < INITIAL_WINDOW)
+            cwnd = INITIAL_WINDOW;
+        if(cwnd > maxWindow)
+            cwnd = maxWindow;
+    }
+
+    void onLoss(long)
+    {
+    }
+
+    void onTimeout(long)
+    {
+        //start measuring again from a small window
+        cwnd = INITIAL_WINDOW;
+        roundStart = 0;
+        delivered = 0;
+    }
+
+    double window() const { return cwnd; }
+
+private:
+    enum
+    {
+        INITIAL_WINDOW = 4,
+        ROUNDS = 10
+    };
+    static constexpr double STARTUP_GAIN = 2.89;
+
+    double cwnd;
+    double maxWindow;
+    long minRtt;
+    long roundStart;
+    long delivered;     //packets acknowledged this round
+    int round;
+    double rates[ROUNDS];   //packets per usec, one per round
+    bool startup;
+    int fullRounds;     //rounds the rate hasn't grown by much
+    double fullRate;
+    int cycle;
+};
+
+CongestionControl* createCongestionControl(const std::string& name, double maxWindow)
+{
+    if(name == "aimd")
+        return new AimdControl(maxWindow);
+    if(name == "cubic")
+        return new CubicControl(maxWindow);
+    if(name == "bbr")
+        return new BbrControl(maxWindow);
+    return NULL;
+}
@@ -0,0 +1,63 @@
+/*
+ * Description:
+ * CongestionControl.h declares the interface a sender uses to decide how many
+ * packets it may have in flight, and three ways of deciding:
+ *
+ *   aimd  - slow start, then additive increase and multiplicative decrease
+ *           (TCP Reno): +1 packet per round trip, halved on a loss
+ *   cubic - CUBIC (RFC 8312): after a loss the window grows back along a
+ *           cubic curve centred on where the loss happened, but never slower
+ *           than Reno would
+ *   bbr   - a delay-based model in the spirit of BBR: it measures the
+ *           bottleneck rate and the minimum RTT, and keeps about two
+ *           bandwidth-delay products in flight, whatever the losses
+ *
+ * The sender reports what happens to its packets; times are in usec.
+ *
+ * It is intended to be part of a series on network programming.
+ */
+#ifndef _CONGESTIONCONTROL_H_
+#define _CONGESTIONCONTROL_H_
+
+#include <string>
+
+class CongestionControl
+{
+public:
+    virtual ~CongestionControl() {}
+
+    virtual const char* name() const = 0;
+
+    /**
+     * acked packets were newly acknowledged at now. rtt is what the ACK
+     * measured, or 0 if it didn't.
+     */
+    virtual void onAck(int acked, long rtt, long now) = 0;
+
+    /**
+     * A packet was found lost from later packets being acknowledged. Called
+     * once per loss event, not for every packet lost in it.
+     */
+    virtual void onLoss(long now) = 0;
+
+    /**
+     * The retransmission timer fired.
+     */
+    virtual void onTimeout(long now) = 0;
+
+    /**
+     * How many packets may be in flight.
+     */
+    virtual double window() const = 0;
+};
+
+/**
+ * Creates the algorithm called name (aimd, cubic or bbr), for a sender that
+ * never has more than maxWindow packets in flight. The window stops growing
+ * there, as a window that isn't used can't be known to be safe.
+ *
+ * Returns NULL if there is no such algorithm.
+ */
+CongestionControl* createCongestionControl(const std::string& name, double maxWindow);
+
+#endif
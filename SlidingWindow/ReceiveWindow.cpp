@@ -0,0 +1,79 @@
+/*
+ * Description:
+ * ReceiveWindow.cpp implements the circular receive bitmap declared in
+ * ReceiveWindow.h.
+ *
+ * It is intended to be part of a series on network programming.
+ */
+
+#include "ReceiveWindow.h"
+
+ReceiveWindow::ReceiveWindow(int size)
+{
+    if(size < 1)
+        size = 1;
+
+    bits.assign((size + WORD_BITS - 1) / WORD_BITS + 1, 0);
+    capacity = bits.size() * WORD_BITS;
+    next = 0;
+}
+
+uint64_t ReceiveWindow::unwrap(uint32_t sequence) const
+{
+    //the distance from next, taken as the shorter way around
+    return next + (int32_t)(sequence - (uint32_t)next);
+}
+
+bool ReceiveWindow::add(uint64_t sequence)
+{
+    if(sequence < next || sequence - next >= capacity)
+        return false;
+
+    uint64_t& word = bits[sequence / WORD_BITS % bits.size()];
+    uint64_t bit = (uint64_t)1 << (sequence % WORD_BITS);
+    if(word & bit)
+        return false;
+    word |= bit;
+
+    if(sequence != next)
+        return true;
+
+    //skip the run of arrived packets a word at a time, clearing their bits so
+    //that the slots are free for the packets a window further on
+    for(;;)
+    {
+        uint64_t& current = bits[next / WORD_BITS % bits.size()];
+        int offset = next % WORD_BITS;
+
+        //the bits below offset are shifted out, and come back in as ones
+        uint64_t missing = ~(current >> offset);
+        int run = missing == 0 ? WORD_BITS : __builtin_ctzll(missing);
+
+        uint64_t arrived = run == WORD_BITS ? ~(uint64_t)0 : ((uint64_t)1 << run) - 1;
+        current &= ~(arrived << offset);
+        next += run;
+
+        if(offset + run < WORD_BITS)
+            return true;
+    }
+}
+
+uint64_t ReceiveWindow::expected() const
+{
+    return next;
+}
+
+uint64_t ReceiveWindow::sack(int count) const
+{
+    //the bits from next on may straddle two words
+    uint64_t index = next / WORD_BITS % bits.size();
+    int offset = next % WORD_BITS;
+
+    uint64_t result = bits[index] >> offset;
+    if(offset != 0)
+        result |= bits[(index + 1) % bits.size()] << (WORD_BITS - offset);
+
+    if(count < WORD_BITS)
+        result &= ((uint64_t)1 << count) - 1;
+    return result;
+}
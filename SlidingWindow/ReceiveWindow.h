@@ -0,0 +1,67 @@
+/*
+ * Description:
+ * ReceiveWindow.h declares the receiver's record of which packets have
+ * arrived: a circular bitmap with one bit per sequence number, from the first
+ * packet still missing up to as far ahead as the sender may run. Its memory
+ * is set by the window size, not by how long the transfer is, and moving the
+ * cumulative ACK forward skips a whole word of arrived packets at a time.
+ *
+ * Sequence numbers are 64 bits, so they never wrap. Packets carry the low 32
+ * bits of theirs, which unwrap() turns back into the full number by picking
+ * the one nearest to what the window expects next.
+ *
+ * It is intended to be part of a series on network programming.
+ */
+#ifndef _RECEIVEWINDOW_H_
+#define _RECEIVEWINDOW_H_
+
+#include <cstdint>
+#include <vector>
+
+class ReceiveWindow
+{
+public:
+    enum
+    {
+        WORD_BITS = 64
+    };
+
+    /**
+     * A window for a sender that runs at most size packets ahead. It keeps
+     * one word more than that, so that sack() can always look a whole word
+     * past the first missing packet.
+     */
+    ReceiveWindow(int size);
+
+    /**
+     * The full sequence number of a packet that carries the low 32 bits of it.
+     */
+    uint64_t unwrap(uint32_t sequence) const;
+
+    /**
+     * Records that a packet has arrived, and moves expected() past it and
+     * past every packet after it that has arrived too.
+     *
+     * Returns false for a packet that had already arrived, or that is too far
+     * ahead to be kept.
+     */
+    bool add(uint64_t sequence);
+
+    /**
+     * The first packet that hasn't arrived. Every one before it has.
+     */
+    uint64_t expected() const;
+
+    /**
+     * Which of the count (up to WORD_BITS) packets from expected() on have
+     * arrived: bit i is set for packet expected()+i, so bit 0 never is.
+     */
+    uint64_t sack(int count) const;
+
+private:
+    std::vector<uint64_t> bits;     //bit s % capacity: packet s has arrived
+    uint64_t capacity;              //bits.size() * WORD_BITS
+    uint64_t next;                  //expected()
+};
+
+#endif
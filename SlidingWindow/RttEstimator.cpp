@@ -0,0 +1,62 @@
+/*
+ * Description:
+ * RttEstimator.cpp implements the retransmission timeout calculation declared
+ * in RttEstimator.h.
+ *
+ * It is intended to be part of a series on network programming.
+ */
+
+#include "RttEstimator.h"
+
+RttEstimator::RttEstimator()
+{
+    smoothed = 0;
+    variation = 0;
+    rto = INITIAL_RTO;
+}
+
+void RttEstimator::sample(long rtt)
+{
+    if(rtt < 1)
+        rtt = 1;
+
+    if(smoothed == 0)
+    {
+        //the first measurement
+        smoothed = rtt;
+        variation = rtt / 2;
+    }
+    else
+    {
+        //RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R|, then SRTT = 7/8 SRTT + 1/8 R
+        long error = rtt > smoothed ? rtt - smoothed : smoothed - rtt;
+        variation += (error - variation) / 4;
+        smoothed += (rtt - smoothed) / 8;
+    }
+
+    rto = smoothed + 4 * variation;
+    if(rto < MIN_RTO)
+        rto = MIN_RTO;
+    if(rto > MAX_RTO)
+        rto = MAX_RTO;
+}
+
+void RttEstimator::backoff()
+{
+    rto = rto * 2 < MAX_RTO ? rto * 2 : MAX_RTO;
+}
+
+long RttEstimator::timeout() const
+{
+    return rto;
+}
+
+long RttEstimator::srtt() const
+{
+    return smoothed;
+}
+
+long RttEstimator::rttvar() const
+{
+    return variation;
+}
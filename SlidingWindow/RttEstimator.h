@@ -0,0 +1,55 @@
+/*
+ * Description:
+ * RttEstimator.h declares the retransmission timeout calculation of TCP
+ * (RFC 6298): a smoothed round-trip time and its variation, updated from
+ * every measurement the way Jacobson and Karels proposed, with the timeout
+ * set to SRTT + 4 * RTTVAR and doubled each time it fires.
+ *
+ * Measurements come from a timestamp the sender puts in every packet and the
+ * receiver echoes in its ACK. Each echo names the transmission it answers,
+ * so unlike timing a packet from when it was first sent, an ACK for a
+ * retransmission still gives a valid sample. Karn's rule still holds for the
+ * backoff: a doubled timeout stays doubled until a new measurement comes in.
+ *
+ * It is intended to be part of a series on network programming.
+ */
+#ifndef _RTTESTIMATOR_H_
+#define _RTTESTIMATOR_H_
+
+class RttEstimator
+{
+public:
+    enum
+    {
+        INITIAL_RTO = 1500,     //usec, until the first measurement
+        MIN_RTO = 200,          //usec, well above loopback, far below the RFC's 1s
+        MAX_RTO = 1000000       //usec, the most backing off can reach
+    };
+
+    RttEstimator();
+
+    /**
+     * Adds a round-trip time measurement, in usec, and undoes any backoff.
+     */
+    void sample(long rtt);
+
+    /**
+     * Doubles the timeout, after it has fired.
+     */
+    void backoff();
+
+    /**
+     * How long to wait for an ACK before retransmitting, in usec.
+     */
+    long timeout() const;
+
+    long srtt() const;
+    long rttvar() const;
+
+private:
+    long smoothed;      //SRTT, 0 before the first measurement
+    long variation;     //RTTVAR
+    long rto;
+};
+
+#endif
@@ -6,13 +6,22 @@
 #include "UdpSocket.h"
 
 // Constructor ----------------------------------------------------------------
-UdpSocket::UdpSocket( int port ) : port( port ), sd( NULL_SD ) {
+UdpSocket::UdpSocket( int port, bool reusePort ) : port( port ), sd( NULL_SD ) {
 
   // Open a UDP socket (a datagram socket )
   if( ( sd = socket( AF_INET, SOCK_DGRAM, 0 ) ) < 0 ) {
     cerr << "Cannot open a UDP socket." << endl;
   }
 
+  // Let other sockets that ask for it bind the same port. The kernel then
+  // spreads incoming datagrams over them by a hash of the sender's address,
+  // so each peer always reaches the same socket.
+  int on = 1;
+  if( reusePort &&
+      setsockopt( sd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof( on ) ) < 0 ) {
+    cerr << "Cannot share the UDP port." << endl;
+  }
+
   // Bind our local address
   bzero( (char*)&myAddr, sizeof( myAddr ) );    // Zero-initialize myAddr
   myAddr.sin_family      = AF_INET;             // Use address family internet
@@ -33,6 +42,11 @@ UdpSocket::~UdpSocket( ) {
 
 // Set the IP addr given a destination IP name in char[] ----------------------
 bool UdpSocket::setDestAddress( const char ipName[] ) {
+  return setDestAddress( ipName, port );         // the peer uses my port
+}
+
+// Set the IP addr and port given a destination IP name in char[] and int ----
+bool UdpSocket::setDestAddress( const char ipName[], int destPort ) {
 
   // Get the host entry corresponding to this destination ipName
   struct hostent* host = gethostbyname( ipName );
@@ -46,20 +60,39 @@ bool UdpSocket::setDestAddress( const char ipName[] ) {
   destAddr.sin_family      = AF_INET;            // Use address family internet
   destAddr.sin_addr.s_addr =                     // set the destination IP addr
     inet_addr( inet_ntoa( *(struct in_addr*)*host->h_addr_list ) );
-  destAddr.sin_port        = htons( port );      // set the destination port
+  destAddr.sin_port        = htons( destPort );  // set the destination port
 
   return true;                                   // set in success
 }
 
-// Check if this socket has data to receive -----------------------------------
-int UdpSocket::pollRecvFrom( ) {
+// Check if this socket has data to receive within timeout msec --------------
+int UdpSocket::pollRecvFrom( int timeout ) {
   struct pollfd pfd[1];
   pfd[0].fd = sd;             // declare I'll check the data availability of sd
   pfd[0].events = POLLRDNORM; // declare I'm interested in only reading from sd
 
-  // check it immediately and return a positive number if sd is readable,
-  // otherwise return 0 or a negative number
-  return poll( pfd, 1, 0 );
+  // check it (immediately by default) and return a positive number if sd is
+  // readable, otherwise return 0 or a negative number
+  return poll( pfd, 1, timeout );
+}
+
+// Sleep until this socket has data to receive or timeout usec have passed ---
+int UdpSocket::waitRecvFrom( long timeout ) {
+  struct pollfd pfd[1];
+  pfd[0].fd = sd;
+  pfd[0].events = POLLRDNORM;
+
+  // poll( ) only counts in milliseconds, which is coarser than a
+  // retransmission timeout can be, so use ppoll( )
+  struct timespec ts;
+  if ( timeout < 0 )
+    timeout = 0;
+  ts.tv_sec  = timeout / 1000000;
+  ts.tv_nsec = ( timeout % 1000000 ) * 1000;
+
+  // return a positive number if sd became readable, 0 if the time ran out,
+  // or a negative number on an error
+  return ppoll( pfd, 1, &ts, NULL );
 }
 
 // Send msg[] of length size through the sd socket ----------------------------
@@ -91,3 +124,176 @@ int UdpSocket::ackTo( char msg[], int length ) {
   // return the number of bytes sent
   return sendto( sd, msg, length, 0, &srcAddr, sizeof( srcAddr ) );
 }
+
+// Send an acknowledgment in msg[] whose size is length to peer ---------------
+int UdpSocket::ackTo( char msg[], int length, const struct sockaddr_in& peer ) {
+
+  // a server with many peers answers each one at the address that
+  // recvBatch( ) reported for its packets
+  return sendto( sd, msg, length, 0, (const sockaddr *)&peer, sizeof( peer ) );
+}
+
+// Send count messages through the sd socket in as few system calls as -------
+// possible. Message i is made of the iovlen iovecs starting at iov[i*iovlen],
+// so a header and a shared payload can go out without being copied together.
+int UdpSocket::sendBatch( struct iovec iov[], int iovlen, int count ) {
+  struct mmsghdr msgs[MAXBATCH];
+  int sent = 0;
+
+  while ( sent < count ) {
+    int batch = ( count - sent < MAXBATCH ) ? count - sent : MAXBATCH;
+    bzero( (char *)msgs, sizeof( msgs[0] ) * batch );
+    for ( int i = 0; i < batch; i++ ) {
+      msgs[i].msg_hdr.msg_iov     = &iov[( sent + i ) * iovlen];
+      msgs[i].msg_hdr.msg_iovlen  = iovlen;
+      msgs[i].msg_hdr.msg_name    = &destAddr;
+      msgs[i].msg_hdr.msg_namelen = sizeof( destAddr );
+    }
+
+    // the kernel may take fewer than asked for, so carry on from there
+    int result = sendmmsg( sd, msgs, batch, 0 );
+    if ( result <= 0 )
+      return ( sent > 0 ) ? sent : result;
+    sent += result;
+  }
+
+  // return the number of messages sent
+  return sent;
+}
+
+// Receive up to count messages through the sd socket -------------------------
+// Message i lands in the iovlen iovecs starting at iov[i*iovlen] and its size
+// goes in lengths[i]. This blocks until one message has arrived and then takes
+// whatever else is already queued, up to MAXBATCH messages.
+int UdpSocket::recvBatch( struct iovec iov[], int iovlen, int count,
+                          int lengths[], struct sockaddr_in srcAddrs[] ) {
+  struct mmsghdr msgs[MAXBATCH];
+  struct sockaddr_in addrs[MAXBATCH];
+
+  if ( count > MAXBATCH )
+    count = MAXBATCH;
+
+  // each message records the address of the computer that sent it
+  bzero( (char *)msgs, sizeof( msgs[0] ) * count );
+  for ( int i = 0; i < count; i++ ) {
+    msgs[i].msg_hdr.msg_iov     = &iov[i * iovlen];
+    msgs[i].msg_hdr.msg_iovlen  = iovlen;
+    msgs[i].msg_hdr.msg_name    = &addrs[i];
+    msgs[i].msg_hdr.msg_namelen = sizeof( addrs[i] );
+  }
+
+  int received = recvmmsg( sd, msgs, count, MSG_WAITFORONE, NULL );
+  for ( int i = 0; i < received; i++ ) {
+    lengths[i] = msgs[i].msg_len;
+    if ( srcAddrs != NULL )
+      srcAddrs[i] = addrs[i];
+  }
+
+  // ackTo( ) answers whoever sent the last message, as after recvFrom( )
+  if ( received > 0 )
+    memcpy( &srcAddr, &addrs[received - 1], sizeof( srcAddr ) );
+
+  // return the number of messages received
+  return received;
+}
+
+// Turn UDP generic receive offload on or off ---------------------------------
+// With it on, the kernel may hand over a run of equal-sized datagrams from the
+// same sender as a single buffer, which only recvSegments( ) knows to split.
+bool UdpSocket::setGro( bool on ) {
+  int value = on ? 1 : 0;
+  if ( setsockopt( sd, SOL_UDP, UDP_GRO, &value, sizeof( value ) ) < 0 ) {
+    cerr << "Cannot set UDP_GRO on the UDP socket." << endl;
+    return false;
+  }
+  return true;
+}
+
+// Send count segments through the sd socket with UDP segmentation offload ---
+// Segment i is made of the iovlen iovecs starting at iov[i*iovlen], and all
+// but the last must be as big as the first. Up to MAXGSO of them go down the
+// stack as one large datagram, which is split into segment-sized datagrams
+// only at the last moment, by the network card or by the kernel.
+int UdpSocket::sendSegments( struct iovec iov[], int iovlen, int count ) {
+  int segmentSize = 0;
+  for ( int i = 0; i < iovlen; i++ )
+    segmentSize += iov[i].iov_len;
+
+  char control[CMSG_SPACE( sizeof( uint16_t ) )];
+  int sent = 0;
+
+  while ( sent < count ) {
+    int batch = ( count - sent < MAXGSO ) ? count - sent : MAXGSO;
+
+    struct msghdr msg;
+    bzero( (char *)&msg, sizeof( msg ) );
+    msg.msg_name       = &destAddr;
+    msg.msg_namelen    = sizeof( destAddr );
+    msg.msg_iov        = &iov[sent * iovlen];
+    msg.msg_iovlen     = batch * iovlen;
+
+    // the segment size travels with the datagram
+    bzero( control, sizeof( control ) );
+    msg.msg_control    = control;
+    msg.msg_controllen = sizeof( control );
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR( &msg );
+    cmsg->cmsg_level   = SOL_UDP;
+    cmsg->cmsg_type    = UDP_SEGMENT;
+    cmsg->cmsg_len     = CMSG_LEN( sizeof( uint16_t ) );
+    *(uint16_t *)CMSG_DATA( cmsg ) = segmentSize;
+
+    if ( sendmsg( sd, &msg, 0 ) < 0 )
+      return ( sent > 0 ) ? sent : -1;
+    sent += batch;
+  }
+
+  // return the number of segments sent
+  return sent;
+}
+
+// Receive one datagram through the sd socket into buffer[] of length size ----
+// and point segments[] at the datagrams it is made of, at most maxSegments of
+// them. Without GRO, or when nothing could be coalesced, that is just one.
+int UdpSocket::recvSegments( char buffer[], int length, struct iovec segments[],
+                             int maxSegments ) {
+  char control[CMSG_SPACE( sizeof( int ) )];
+  struct iovec iov;
+  iov.iov_base = buffer;
+  iov.iov_len  = length;
+
+  socklen_t addrlen = sizeof( srcAddr );
+  bzero( (char *)&srcAddr, sizeof( srcAddr ) );
+
+  struct msghdr msg;
+  bzero( (char *)&msg, sizeof( msg ) );
+  msg.msg_name       = &srcAddr;
+  msg.msg_namelen    = addrlen;
+  msg.msg_iov        = &iov;
+  msg.msg_iovlen     = 1;
+  msg.msg_control    = control;
+  msg.msg_controllen = sizeof( control );
+
+  int received = recvmsg( sd, &msg, 0 );
+  if ( received < 0 )
+    return received;
+
+  // the kernel says how big the segments were if it coalesced any
+  int segmentSize = received;
+  for ( struct cmsghdr* cmsg = CMSG_FIRSTHDR( &msg ); cmsg != NULL;
+        cmsg = CMSG_NXTHDR( &msg, cmsg ) ) {
+    if ( cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO )
+      segmentSize = *(int *)CMSG_DATA( cmsg );
+  }
+
+  int count = 0;
+  for ( int offset = 0; offset < received && count < maxSegments;
+        offset += segmentSize ) {
+    segments[count].iov_base = buffer + offset;
+    segments[count].iov_len  =
+      ( received - offset < segmentSize ) ? received - offset : segmentSize;
+    count++;
+  }
+
+  // return the number of segments received
+  return count;
+}
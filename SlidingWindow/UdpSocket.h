@@ -8,6 +8,8 @@
 
 #include <iostream>
 #define MSGSIZE 1460      // UDP message size in bytes
+#define MAXBATCH 64       // most messages moved by one sendmmsg/recvmmsg call
+#define MAXGSO 44         // most MSGSIZE segments that fit in one 64KB datagram
 
 using namespace std;
 
@@ -16,26 +18,44 @@ extern "C"
 #include <sys/types.h>    // for sockets
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>  // for UDP_SEGMENT and UDP_GRO
 #include <arpa/inet.h>
 
 #include <netdb.h>        // for gethostbyname( )
 #include <unistd.h>       // for close( )
 #include <string.h>       // for bzero( )
 
-#include <sys/poll.h>     // for poll( )
+#include <sys/poll.h>     // for poll( ) and ppoll( )
+#include <sys/uio.h>      // for struct iovec
 }
 
 #define NULL_SD -1        // means no socket descriptor
 
 class UdpSocket {
  public:
-  UdpSocket( int );              // open an UDP socket with int port
+  UdpSocket( int, bool = false ); // open an UDP socket with int port, which
+                                 // other sockets can share if bool is true
   ~UdpSocket( );
   bool setDestAddress( const char[] ); // set the IP addr given an IP name in char[]
-  int pollRecvFrom( );           // check if this socket has data to receive
+  bool setDestAddress( const char[], int ); // the same, at a port other than mine
+  int pollRecvFrom( int = 0 );   // check if this socket has data to receive
+                                 // within int msec
+  int waitRecvFrom( long );      // sleep until there is data to receive or
+                                 // long usec have passed
   int sendTo( char[], int );     // send a message in char[] whose size is int
   int recvFrom( char[], int );   // receive a message in char[] of int size
   int ackTo( char[], int );      // send an ack message in char[] of int size
+  int ackTo( char[], int, const struct sockaddr_in& ); // the same, to a given
+                                 // peer rather than to the last sender
+  int sendBatch( struct iovec[], int, int ); // send int messages of int iovecs each
+  int recvBatch( struct iovec[], int, int, int[], // receive up to int messages
+                 struct sockaddr_in[] = NULL );   // of int iovecs each
+  bool setGro( bool );           // have the kernel coalesce received datagrams
+  int sendSegments( struct iovec[], int, int ); // send int segments of int
+                                                // iovecs each as one datagram
+  int recvSegments( char[], int, struct iovec[], int ); // receive a coalesced
+                                 // datagram in char[] of int size and split it
+                                 // into at most int segments in iovec[]
  private:
   int port;                      // this UDP port
   int sd;                        // this UDP socket descriptor
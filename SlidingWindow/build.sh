@@ -1,2 +1,3 @@
-g++ UdpSocket.cpp Timer.cpp udp.cpp hw2.cpp -o hw2
-g++ UdpSocket.cpp Timer.cpp udpa.cpp hw3a.cpp -o hw3
\ No newline at end of file
+g++ UdpSocket.cpp Timer.cpp udp.cpp RttEstimator.cpp ReceiveWindow.cpp offload.cpp hw2.cpp -o hw2 -std=c++11
+g++ UdpSocket.cpp Timer.cpp udpa.cpp RttEstimator.cpp ReceiveWindow.cpp CongestionControl.cpp offload.cpp hw3a.cpp -o hw3 -lpthread -std=c++11
+g++ impair.cpp -o impair -std=c++11
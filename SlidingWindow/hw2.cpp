@@ -1,4 +1,5 @@
 #include <iostream>
+#include <stdlib.h>       // for atoi( )
 #include "UdpSocket.h"
 #include "Timer.h"
 
@@ -14,16 +15,14 @@ void clientUnreliable( UdpSocket &sock, const int max, int message[] );
 int clientStopWait( UdpSocket &sock, const int max, int message[] );
 int clientSlidingWindow( UdpSocket &sock, const int max, int message[],
 			  int windowSize );
-//int clientSlowAIMD( UdpSocket &sock, const int max, int message[],
-//		     int windowSize, bool rttOn );
+void clientOffload( UdpSocket &sock, const int max, int message[] );
 
 // server packet receiving fucntions
 void serverUnreliable( UdpSocket &sock, const int max, int message[] );
 void serverReliable( UdpSocket &sock, const int max, int message[] );
 void serverEarlyRetrans( UdpSocket &sock, const int max, int message[],
 			 int windowSize );
-//void serverEarlyRetrans( UdpSocket &sock, const int max, int message[],
-//			 int windowSize, bool congestion );
+void serverOffload( UdpSocket &sock, const int max, int message[] );
 
 enum myPartType { CLIENT, SERVER, ERROR } myPart;
 
@@ -34,13 +33,16 @@ int main( int argc, char *argv[] ) {
 
   myPart = ( argc == 1 ) ? SERVER : CLIENT;
 
-  if ( argc != 1 && argc != 2 ) {
-    cerr << "usage: " << argv[0] << " [serverIpName]" << endl;
+  if ( argc > 3 ) {
+    cerr << "usage: " << argv[0] << " [serverIpName [serverPort]]" << endl;
     return -1;
   }
 
+  // the server's port can differ from PORT, e.g. to go through ./impair
+  int serverPort = ( argc == 3 ) ? atoi( argv[2] ) : PORT;
+
   if ( myPart == CLIENT ) // I am a client and thus set my server address
-    if ( sock.setDestAddress( argv[1] ) == false ) {
+    if ( sock.setDestAddress( argv[1], serverPort ) == false ) {
       cerr << "cannot find the destination IP name: " << argv[1] << endl;
       return -1;
     }
@@ -50,6 +52,7 @@ int main( int argc, char *argv[] ) {
   cerr << "   1: unreliable test" << endl;
   cerr << "   2: stop-and-wait test" << endl;
   cerr << "   3: sliding windows" << endl;
+  cerr << "   4: offload (sendmmsg, GSO/GRO) benchmark" << endl;
   cerr << "--> ";
   cin >> testNumber;
 
@@ -84,6 +87,9 @@ int main( int argc, char *argv[] ) {
 	cerr << "retransmits = " << retransmits << endl;
       }
       break;
+    case 4:
+      clientOffload( sock, MAX, message );                     // actual test
+      break;
     default:
       cerr << "no such test case" << endl;
       break;
@@ -101,6 +107,9 @@ int main( int argc, char *argv[] ) {
       for ( int windowSize = 1; windowSize <= MAXWIN; windowSize++ )
 	serverEarlyRetrans( sock, MAX, message, windowSize );
       break;
+    case 4:
+      serverOffload( sock, MAX, message );
+      break;
     default:
       cerr << "no such test case" << endl;
       break;
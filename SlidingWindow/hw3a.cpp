@@ -1,6 +1,8 @@
 #include <iostream>
+#include <stdlib.h>       // for atoi( )
 #include "UdpSocket.h"
 #include "Timer.h"
+#include "CongestionControl.h"
 
 using namespace std;
 
@@ -9,6 +11,7 @@ using namespace std;
 #define MAXWIN 30        // the maximum window size
 #define DROP_TESTS 2     // the number of tests where we drop packets
 #define LOOP 10          // loop in test 4 and 5
+#define MAXCWND 64       // the most a congestion window can grow to in test 6
 
 //the window sizes for the the packet dropping tests
 const int DROPWINSIZES[] = {1,30};
@@ -18,33 +21,45 @@ void clientUnreliable( UdpSocket &sock, const int max, int message[] );
 int clientStopWait( UdpSocket &sock, const int max, int message[] );
 int clientSlidingWindow( UdpSocket &sock, const int max, int message[],
 			  int windowSize );
-//int clientSlowAIMD( UdpSocket &sock, const int max, int message[],
-//		     int windowSize, bool rttOn );
+void clientOffload( UdpSocket &sock, const int max, int message[] );
+int clientSelectiveRepeat( UdpSocket &sock, const int max, int message[],
+			   int windowSize, CongestionControl* congestion = NULL,
+			   const struct iovec payloads[] = NULL );
+int clientFileTransfer( UdpSocket &sock, const char path[], int message[],
+			int windowSize, CongestionControl* congestion = NULL );
 
 // server packet receiving fucntions
 void serverUnreliable( UdpSocket &sock, const int max, int message[] );
 void serverReliable( UdpSocket &sock, const int max, int message[] );
 void serverEarlyRetrans( UdpSocket &sock, const int max, int message[],
 			 int windowSize, int dropRate );
-//void serverEarlyRetrans( UdpSocket &sock, const int max, int message[],
-//			 int windowSize, bool congestion );
+void serverOffload( UdpSocket &sock, const int max, int message[] );
+void serverSelectiveRepeat( UdpSocket &sock, const int max, int message[],
+			    int windowSize, int dropRate );
+bool serverFileTransfer( UdpSocket &sock, const char path[], int windowSize );
+void serverMultiPeer( UdpSocket &sock, int port, const int max, int windowSize,
+		      int clients, int workers );
 
 enum myPartType { CLIENT, SERVER, ERROR } myPart;
 
 int main( int argc, char *argv[] ) {
 
   int message[MSGSIZE/4]; // prepare a 1460-byte message: 1460/4 = 365 ints;
-  UdpSocket sock( PORT );  // define a UDP socket
-
   myPart = ( argc == 1 ) ? SERVER : CLIENT;
 
-  if ( argc != 1 && argc != 2 ) {
-    cerr << "usage: " << argv[0] << " [serverIpName]" << endl;
+  // the server shares its port, so that test 8 can add sockets to it
+  UdpSocket sock( PORT, myPart == SERVER );  // define a UDP socket
+
+  if ( argc > 3 ) {
+    cerr << "usage: " << argv[0] << " [serverIpName [serverPort]]" << endl;
     return -1;
   }
 
+  // the server's port can differ from PORT, e.g. to go through ./impair
+  int serverPort = ( argc == 3 ) ? atoi( argv[2] ) : PORT;
+
   if ( myPart == CLIENT ) // I am a client and thus set my server address
-    if ( sock.setDestAddress( argv[1] ) == false ) {
+    if ( sock.setDestAddress( argv[1], serverPort ) == false ) {
       cerr << "cannot find the destination IP name: " << argv[1] << endl;
       return -1;
     }
@@ -54,9 +69,48 @@ int main( int argc, char *argv[] ) {
   cerr << "   1: unreliable test" << endl;
   cerr << "   2: stop-and-wait test" << endl;
   cerr << "   3: sliding windows" << endl;
+  cerr << "   4: offload (sendmmsg, GSO/GRO) benchmark" << endl;
+  cerr << "   5: go-back-N vs selective repeat" << endl;
+  cerr << "   6: congestion control" << endl;
+  cerr << "   7: file transfer" << endl;
+  cerr << "   8: many clients (one flow each, SO_REUSEPORT workers)" << endl;
   cerr << "--> ";
   cin >> testNumber;
 
+  // only the client needs to know which algorithm it runs
+  CongestionControl* congestion = NULL;
+  if ( myPart == CLIENT && testNumber >= 6 && testNumber <= 8 ) {
+    string algorithm;
+    cerr << "Choose a congestion control (aimd, cubic, bbr)" << endl;
+    cerr << "--> ";
+    cin >> algorithm;
+    congestion = createCongestionControl( algorithm, MAXCWND );
+    if ( congestion == NULL ) {
+      cerr << "no such congestion control: " << algorithm << endl;
+      return -1;
+    }
+  }
+
+  // the file transfer reads a file at one end and writes it at the other
+  string path;
+  if ( testNumber == 7 ) {
+    cerr << ( myPart == CLIENT ? "File to send" : "File to write" ) << endl;
+    cerr << "--> ";
+    cin >> path;
+  }
+
+  // the server of test 8 needs to know when everyone is done
+  int clients = 0;
+  int workers = 0;
+  if ( myPart == SERVER && testNumber == 8 ) {
+    cerr << "Number of clients" << endl;
+    cerr << "--> ";
+    cin >> clients;
+    cerr << "Worker threads" << endl;
+    cerr << "--> ";
+    cin >> workers;
+  }
+
   if ( myPart == CLIENT ) {
 
     Timer timer;           // define a timer
@@ -94,6 +148,63 @@ int main( int argc, char *argv[] ) {
           }
       }
       break;
+    case 4:
+      clientOffload( sock, MAX, message );                     // actual test
+      break;
+    case 5:
+      for(int i = 0; i < DROP_TESTS; i++)
+      {
+          for(int dropRate = 0; dropRate <= LOOP; dropRate++)
+          {
+              timer.start( );                                        // go-back-N
+              int goBackNRetransmits =
+              clientSlidingWindow( sock, MAX, message, DROPWINSIZES[i] );
+              long goBackNTime = timer.lap( );
+              timer.start( );                                        // selective repeat
+              retransmits =
+              clientSelectiveRepeat( sock, MAX, message, DROPWINSIZES[i] );
+              long selectiveTime = timer.lap( );
+              cerr << "Window size = ";
+              cerr << DROPWINSIZES[i] << " ";
+              cerr << "Drop Percentage = ";
+              cout << dropRate << " ";
+              cerr << "Go-back-N time = ";
+              cout << goBackNTime << " ";
+              cerr << "Selective repeat time = ";
+              cout << selectiveTime << endl;
+              cerr << "retransmits = " << goBackNRetransmits << " / " << retransmits << endl;
+          }
+      }
+      break;
+    case 6:
+      for(int dropRate = 0; dropRate <= LOOP; dropRate++)
+      {
+          // every run starts from scratch
+          CongestionControl* fresh = createCongestionControl( congestion->name(), MAXCWND );
+          timer.start( );                                        // start timer
+          retransmits =
+          clientSelectiveRepeat( sock, MAX, message, MAXCWND, fresh ); // actual test
+          cerr << "Congestion control = ";
+          cerr << fresh->name() << " ";
+          cerr << "Drop Percentage = ";
+          cout << dropRate << " ";
+          cerr << "Elasped time = ";
+          cout << timer.lap( ) << endl;
+          cerr << "retransmits = " << retransmits << endl;
+          delete fresh;
+      }
+      break;
+    case 7:
+      clientFileTransfer( sock, path.c_str( ), message, MAXCWND, congestion ); // reports itself
+      break;
+    case 8:
+      timer.start( );                                          // start timer
+      retransmits =
+      clientSelectiveRepeat( sock, MAX, message, MAXCWND, congestion ); // actual test
+      cerr << "Elasped time = ";                               // lap timer
+      cout << timer.lap( ) << endl;
+      cerr << "retransmits = " << retransmits << endl;
+      break;
     default:
       cerr << "no such test case" << endl;
       break;
@@ -116,21 +227,46 @@ int main( int argc, char *argv[] ) {
           }
       }
       break;
+    case 4:
+      serverOffload( sock, MAX, message );
+      break;
+    case 5:
+      for(int i = 0; i < DROP_TESTS; i++)
+      {
+          for(int dropRate = 0; dropRate <= LOOP; dropRate++)
+          {
+              serverEarlyRetrans( sock, MAX, message, DROPWINSIZES[i], dropRate );
+              serverSelectiveRepeat( sock, MAX, message, DROPWINSIZES[i], dropRate );
+          }
+      }
+      break;
+    case 6:
+      for(int dropRate = 0; dropRate <= LOOP; dropRate++)
+          serverSelectiveRepeat( sock, MAX, message, MAXCWND, dropRate );
+      break;
+    case 7:
+      serverFileTransfer( sock, path.c_str( ), MAXCWND );
+      break;
+    case 8:
+      serverMultiPeer( sock, PORT, MAX, MAXCWND, clients, workers );
+      break;
     default:
       cerr << "no such test case" << endl;
       break;
     }
 
     // The server should make sure that the last ack has been delivered to
-    // the client. Send it three time in three seconds
+    // the client. Send it three time in three seconds. The file transfer
+    // isn't MAX packets long, and already did this with its own last ack
     cerr << "server ending..." << endl;
-    for ( int i = 0; i < 10; i++ ) {
+    for ( int i = 0; i < 10 && testNumber != 7; i++ ) {
       sleep( 1 );
       int ack = MAX - 1;
       sock.ackTo( (char *)&ack, sizeof( ack ) );
     }
   }
 
+  delete congestion;
   cerr << "finished" << endl;
 
   return 0;
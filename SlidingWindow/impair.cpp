@@ -0,0 +1,540 @@
+/*
+ * Description:
+ * impair.cpp is a UDP relay that sits between the client and the server of
+ * hw2/hw3 and does to their packets what a real network would: it loses,
+ * delays, reorders and duplicates them, and lets them through no faster than
+ * a given rate. Unlike dropping packets inside the server, it works on both
+ * directions, so ACKs get lost and delayed too, and it needs neither root nor
+ * netem.
+ *
+ *   ./hw3                                  server, on port 23460
+ *   ./impair 23461 127.0.0.1 23460 --loss 1 --delay 200 --jitter 50
+ *   ./hw3 127.0.0.1 23461                  client, talking to the relay
+ *
+ * Every option applies to both directions. Prefixed with data- (client to
+ * server) or ack- (server to client), as in --ack-loss 5, it applies to
+ * one only:
+ *
+ *   --loss pct                 independent (Bernoulli) loss
+ *   --ge p,r[,bad[,good]]      Gilbert-Elliott loss: p% chance of going from
+ *                              the good state to the bad one per packet, r%
+ *                              of coming back, and losing bad% (100) of the
+ *                              packets in the bad state and good% (0) in the
+ *                              good one
+ *   --delay usec               one-way delay
+ *   --jitter usec              spread of the delay, which reorders packets
+ *   --dist name                uniform (delay +- jitter), normal (standard
+ *                              deviation jitter) or pareto (delay plus a
+ *                              heavy tail of scale jitter)
+ *   --reorder pct              packets sent straight away, ahead of delayed ones
+ *   --duplicate pct            packets sent twice
+ *   --rate mbps                bottleneck bandwidth, 0 for none
+ *   --queue packets            bottleneck queue, beyond which packets are
+ *                              dropped (100)
+ *   --seed n                   for the random numbers (1)
+ *
+ * Each direction draws from its own generator seeded from --seed, so the
+ * same seed makes the same decisions for the nth packet in each direction,
+ * whatever the other direction does. The relay runs until it is
+ * interrupted, then prints what it did to each direction.
+ *
+ * It is intended to be part of a series on network programming.
+ */
+
+#include <iostream>
+#include <vector>
+#include <queue>
+#include <string>
+#include <random>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <cmath>
+#include <csignal>
+#include <ctime>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+enum
+{
+    MAX_PACKET = 65536,
+    DEFAULT_QUEUE = 100,
+    DIRECTIONS = 2,
+    DATA = 0,           //client to server
+    ACK = 1             //server to client
+};
+
+enum Distribution { UNIFORM, NORMAL, PARETO };
+
+static const char* directionNames[DIRECTIONS] = {"data", "ack"};
+
+/*
+ * What to do to the packets going one way.
+ */
+struct Impairment
+{
+    double loss;            //percent
+    bool gilbert;           //Gilbert-Elliott loss instead of Bernoulli
+    double toBad;           //percent per packet
+    double toGood;
+    double lossBad;
+    double lossGood;
+    long delay;             //usec
+    long jitter;
+    Distribution distribution;
+    double reorder;         //percent
+    double duplicate;
+    double rate;            //bits per usec, i.e. Mbps; 0 for no limit
+    int queue;              //packets
+
+    Impairment();
+};
+
+/*
+ * What was done to them.
+ */
+struct DirectionStats
+{
+    long received;
+    long lost;
+    long queueDrops;
+    long reordered;
+    long duplicated;
+    long sent;
+
+    DirectionStats() : received(0), lost(0), queueDrops(0), reordered(0), duplicated(0), sent(0) {}
+};
+
+/*
+ * One way through the relay: its impairments, the state they need, and what
+ * they did.
+ */
+struct Direction
+{
+    Impairment impairment;
+    std::mt19937_64 random;
+    bool bad;               //the Gilbert-Elliott state
+    double linkFree;        //when the bottleneck has sent what it has queued
+    DirectionStats stats;
+
+    Direction() : bad(false), linkFree(0) {}
+};
+
+/*
+ * A packet on its way out, in order of when it leaves, then of when it came.
+ */
+struct Pending
+{
+    long release;
+    uint64_t order;
+    int direction;
+    std::vector<char> data;
+
+    bool operator>(const Pending& other) const
+    {
+        return release != other.release ? release > other.release : order > other.order;
+    }
+};
+
+typedef std::priority_queue<Pending, std::vector<Pending>, std::greater<Pending> > PendingQueue;
+
+static volatile sig_atomic_t interrupted = 0;
+
+//forward declarations
+static bool parseImpairment(int& i, int argc, char* argv[], Direction directions[]);
+static bool setImpairment(Impairment& impairment, const std::string& name, const std::string& value);
+static bool lookup(const char* host, int port, sockaddr_in& address);
+static long nowUsec();
+static double percent(Direction& direction);
+static long delayFor(Direction& direction);
+static void impair(Direction& direction, int index, const char* data, int length, long now,
+                   uint64_t& order, PendingQueue& pending);
+static void printStats(const Direction directions[]);
+
+static void onSignal(int)
+{
+    interrupted = 1;
+}
+
+Impairment::Impairment()
+{
+    loss = 0;
+    gilbert = false;
+    toBad = toGood = lossBad = lossGood = 0;
+    delay = jitter = 0;
+    distribution = UNIFORM;
+    reorder = duplicate = 0;
+    rate = 0;
+    queue = DEFAULT_QUEUE;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 4)
+    {
+        std::cerr << "usage: " << argv[0] << " listenPort serverHost serverPort" << std::endl;
+        std::cerr << "       [--[data-|ack-]loss pct] [--[data-|ack-]ge p,r[,bad[,good]]]" << std::endl;
+        std::cerr << "       [--[data-|ack-]delay usec] [--[data-|ack-]jitter usec]" << std::endl;
+        std::cerr << "       [--[data-|ack-]dist uniform|normal|pareto]" << std::endl;
+        std::cerr << "       [--[data-|ack-]reorder pct] [--[data-|ack-]duplicate pct]" << std::endl;
+        std::cerr << "       [--[data-|ack-]rate mbps] [--[data-|ack-]queue packets] [--seed n]" << std::endl;
+        return -1;
+    }
+
+    Direction directions[DIRECTIONS];
+    int listenPort;
+    sockaddr_in server;
+    unsigned long seed = 1;
+
+    try
+    {
+        listenPort = std::stoi(argv[1]);
+        if (!lookup(argv[2], std::stoi(argv[3]), server))
+            throw std::invalid_argument(argv[2]);
+
+        for (int i = 4; i < argc; i++)
+        {
+            std::string option = argv[i];
+            if (option == "--seed" && i+1 < argc)
+                seed = std::stoul(argv[++i]);
+            else if (!parseImpairment(i, argc, argv, directions))
+                throw std::invalid_argument(option);
+        }
+    }
+    catch (...)
+    {
+        std::cerr << "Error: bad argument. Run " << argv[0] << " alone for its usage." << std::endl;
+        return -1;
+    }
+
+    for (int d = 0; d < DIRECTIONS; d++)
+        directions[d].random.seed(seed * DIRECTIONS + d);
+
+    int sd = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in local;
+    std::memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    local.sin_port = htons(listenPort);
+    if (sd < 0 || bind(sd, (sockaddr*)&local, sizeof(local)) < 0)
+    {
+        perror("impair");
+        return -1;
+    }
+
+    //Ctrl-C stops the relay and prints what it did, rather than killing it
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = onSignal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    //whoever isn't the server is the client; a new client replaces the old one
+    sockaddr_in client;
+    bool haveClient = false;
+
+    PendingQueue pending;
+    uint64_t order = 0;
+    std::vector<char> buffer(MAX_PACKET);
+
+    while (!interrupted)
+    {
+        //sleep until a packet comes in or the next one is due to go out
+        long now = nowUsec();
+        timespec wait;
+        timespec* timeout = NULL;
+        if (!pending.empty())
+        {
+            long left = pending.top().release > now ? pending.top().release - now : 0;
+            wait.tv_sec = left / 1000000;
+            wait.tv_nsec = left % 1000000 * 1000;
+            timeout = &wait;
+        }
+
+        pollfd pfd;
+        pfd.fd = sd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (ppoll(&pfd, 1, timeout, NULL) < 0 && errno != EINTR)
+        {
+            perror("ppoll");
+            break;
+        }
+
+        //take in everything that has arrived
+        while (true)
+        {
+            sockaddr_in from;
+            socklen_t fromLength = sizeof(from);
+            int length = recvfrom(sd, &buffer[0], buffer.size(), MSG_DONTWAIT, (sockaddr*)&from, &fromLength);
+            if (length < 0)
+                break;
+
+            bool fromServer = from.sin_addr.s_addr == server.sin_addr.s_addr &&
+                              from.sin_port == server.sin_port;
+            if (!fromServer)
+            {
+                client = from;
+                haveClient = true;
+            }
+            else if (!haveClient)
+                continue;
+
+            int d = fromServer ? ACK : DATA;
+            impair(directions[d], d, &buffer[0], length, nowUsec(), order, pending);
+        }
+
+        //and send out everything that is due
+        now = nowUsec();
+        while (!pending.empty() && pending.top().release <= now)
+        {
+            const Pending& packet = pending.top();
+            const sockaddr_in& to = packet.direction == DATA ? server : client;
+            if (sendto(sd, packet.data.data(), packet.data.size(), 0, (const sockaddr*)&to, sizeof(to)) > 0)
+                directions[packet.direction].stats.sent++;
+            pending.pop();
+        }
+    }
+
+    printStats(directions);
+    close(sd);
+    return 0;
+}
+
+/**
+ * Parses one impairment option, with the value after it, into the direction
+ * it names, or into both.
+ *
+ * Returns false if argv[i] isn't one.
+ */
+static bool parseImpairment(int& i, int argc, char* argv[], Direction directions[])
+{
+    std::string option = argv[i];
+    if (option.compare(0, 2, "--") != 0 || i+1 >= argc)
+        return false;
+
+    int first = 0;
+    int last = DIRECTIONS - 1;
+    std::string name = option.substr(2);
+    if (name.compare(0, 5, "data-") == 0)
+    {
+        last = DATA;
+        name = name.substr(5);
+    }
+    else if (name.compare(0, 4, "ack-") == 0)
+    {
+        first = ACK;
+        name = name.substr(4);
+    }
+
+    for (int d = first; d <= last; d++)
+    {
+        if (!setImpairment(directions[d].impairment, name, argv[i+1]))
+            return false;
+    }
+
+    i++;
+    return true;
+}
+
+/**
+ * Sets the impairment called name to value.
+ *
+ * Returns false if there is no such impairment.
+ */
+static bool setImpairment(Impairment& impairment, const std::string& name, const std::string& value)
+{
+    if (name == "loss")
+        impairment.loss = std::stod(value);
+    else if (name == "ge")
+    {
+        //p,r[,bad[,good]]
+        double numbers[4] = {0, 0, 100, 0};
+        size_t start = 0;
+        int count = 0;
+        while (count < 4)
+        {
+            size_t comma = value.find(',', start);
+            numbers[count++] = std::stod(value.substr(start, comma - start));
+            if (comma == std::string::npos)
+                break;
+            start = comma + 1;
+        }
+        if (count < 2)
+            throw std::invalid_argument(value);
+
+        impairment.gilbert = true;
+        impairment.toBad = numbers[0];
+        impairment.toGood = numbers[1];
+        impairment.lossBad = numbers[2];
+        impairment.lossGood = numbers[3];
+    }
+    else if (name == "delay")
+        impairment.delay = std::stol(value);
+    else if (name == "jitter")
+        impairment.jitter = std::stol(value);
+    else if (name == "dist")
+    {
+        if (value == "uniform")
+            impairment.distribution = UNIFORM;
+        else if (value == "normal")
+            impairment.distribution = NORMAL;
+        else if (value == "pareto")
+            impairment.distribution = PARETO;
+        else
+            throw std::invalid_argument(value);
+    }
+    else if (name == "reorder")
+        impairment.reorder = std::stod(value);
+    else if (name == "duplicate")
+        impairment.duplicate = std::stod(value);
+    else if (name == "rate")
+        impairment.rate = std::stod(value);
+    else if (name == "queue")
+        impairment.queue = std::stoi(value);
+    else
+        return false;
+
+    return true;
+}
+
+static bool lookup(const char* host, int port, sockaddr_in& address)
+{
+    hostent* entry = gethostbyname(host);
+    if (entry == NULL)
+        return false;
+
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    std::memcpy(&address.sin_addr, entry->h_addr_list[0], sizeof(address.sin_addr));
+    address.sin_port = htons(port);
+    return true;
+}
+
+static long nowUsec()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000L + now.tv_nsec / 1000;
+}
+
+/**
+ * A number in [0, 100), to compare a percentage with.
+ */
+static double percent(Direction& direction)
+{
+    return std::uniform_real_distribution<double>(0, 100)(direction.random);
+}
+
+/**
+ * How long the next packet is held back, in usec.
+ */
+static long delayFor(Direction& direction)
+{
+    const Impairment& impairment = direction.impairment;
+    if (impairment.jitter == 0)
+        return impairment.delay;
+
+    double delay;
+    if (impairment.distribution == NORMAL)
+        delay = std::normal_distribution<double>(impairment.delay, impairment.jitter)(direction.random);
+    else if (impairment.distribution == PARETO)
+    {
+        //shape 2.5 has a finite mean and variance, but a long tail
+        double uniform = std::uniform_real_distribution<double>(0, 1)(direction.random);
+        delay = impairment.delay + impairment.jitter * (std::pow(1 - uniform, -1 / 2.5) - 1);
+    }
+    else
+        delay = std::uniform_real_distribution<double>(impairment.delay - impairment.jitter,
+                                                       impairment.delay + impairment.jitter)(direction.random);
+
+    return delay > 0 ? (long)delay : 0;
+}
+
+/**
+ * Decides what happens to a packet that has come in, and queues whatever is
+ * left of it to go out.
+ *
+ * The order of the decisions is the one netem uses: loss, duplication, then
+ * the bottleneck queue, then the delay, which reordering skips.
+ */
+static void impair(Direction& direction, int index, const char* data, int length, long now,
+                   uint64_t& order, PendingQueue& pending)
+{
+    const Impairment& impairment = direction.impairment;
+    direction.stats.received++;
+
+    bool lost;
+    if (impairment.gilbert)
+    {
+        //move between the states first, then lose according to the new one
+        if (percent(direction) < (direction.bad ? impairment.toGood : impairment.toBad))
+            direction.bad = !direction.bad;
+        lost = percent(direction) < (direction.bad ? impairment.lossBad : impairment.lossGood);
+    }
+    else
+        lost = percent(direction) < impairment.loss;
+
+    if (lost)
+    {
+        direction.stats.lost++;
+        return;
+    }
+
+    int copies = 1;
+    if (percent(direction) < impairment.duplicate)
+    {
+        copies = 2;
+        direction.stats.duplicated++;
+    }
+
+    for (int copy = 0; copy < copies; copy++)
+    {
+        //the bottleneck sends one packet at a time, so a packet leaves once
+        //everything ahead of it has, and drops if too much is ahead of it
+        long leaves = now;
+        if (impairment.rate > 0)
+        {
+            double transmit = length * 8 / impairment.rate;
+            if (direction.linkFree < now)
+                direction.linkFree = now;
+            if ((direction.linkFree - now) / transmit >= impairment.queue)
+            {
+                direction.stats.queueDrops++;
+                continue;
+            }
+
+            direction.linkFree += transmit;
+            leaves = (long)direction.linkFree;
+        }
+
+        Pending packet;
+        packet.release = leaves;
+        if (percent(direction) < impairment.reorder)
+            direction.stats.reordered++;
+        else
+            packet.release += delayFor(direction);
+        packet.order = order++;
+        packet.direction = index;
+        packet.data.assign(data, data + length);
+        pending.push(packet);
+    }
+}
+
+static void printStats(const Direction directions[])
+{
+    for (int d = 0; d < DIRECTIONS; d++)
+    {
+        const DirectionStats& stats = directions[d].stats;
+        std::cout << directionNames[d] << ": received = " << stats.received;
+        std::cout << ", lost = " << stats.lost << ", queue drops = " << stats.queueDrops;
+        std::cout << ", duplicated = " << stats.duplicated << ", reordered = " << stats.reordered;
+        std::cout << ", sent = " << stats.sent << std::endl;
+    }
+}
@@ -0,0 +1,177 @@
+/*
+ * Description:
+ * offload.cpp is a benchmark of how many UDP packets per second can be moved,
+ * and at what CPU cost, depending on how many of them each system call
+ * carries:
+ *
+ *   plain - one packet per sendto/recvfrom
+ *   batch - a batch of packets per sendmmsg/recvmmsg
+ *   gso   - one 64KB datagram per sendmsg, cut into packets by UDP_SEGMENT,
+ *           and received as coalesced buffers with UDP_GRO
+ *
+ * The client blasts max packets in each mode, with a pause in between, and
+ * the server counts what arrives. Nothing is retransmitted, so what the server
+ * misses shows how far the sender got ahead of it.
+ *
+ * It is intended to be part of a series on network programming.
+ */
+
+#include "UdpSocket.h"
+#include "Timer.h"
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+enum
+{
+    OFFLOAD_MODES = 3,
+    IDLE_MSEC = 1000,   //a mode is over once the server hears nothing for this long
+    PAUSE_SEC = 2       //how long the client waits between modes
+};
+
+static const char* modeNames[OFFLOAD_MODES] = {"plain", "batch", "gso"};
+
+//forward declarations
+static long cpuUsec();
+static void report(const char* side, int mode, int packets, int max, int calls, long time, long cpu);
+
+/**
+ * Sends max packets in each mode as fast as it can and reports how fast that
+ * was.
+ */
+void clientOffload( UdpSocket &sock, const int max, int message[] )
+{
+    //each packet is its sequence number followed by the rest of message[]
+    std::vector<int> sequences(max);
+    std::vector<iovec> packets(max * 2);
+    for(int i = 0; i < max; i++)
+    {
+        sequences[i] = i;
+        packets[i*2].iov_base = &sequences[i];
+        packets[i*2].iov_len = sizeof(int);
+        packets[i*2+1].iov_base = (char*)message + sizeof(int);
+        packets[i*2+1].iov_len = MSGSIZE - sizeof(int);
+    }
+
+    for(int mode = 0; mode < OFFLOAD_MODES; mode++)
+    {
+        Timer timer;
+        int calls = 0;
+        int sent = 0;
+        long cpuBefore = cpuUsec();
+        timer.start();
+
+        for(int i = 0; i < max; )
+        {
+            int result;
+            if(mode == 0)
+            {
+                message[0] = i;
+                result = sock.sendTo((char*)message, MSGSIZE) == MSGSIZE ? 1 : -1;
+            }
+            else if(mode == 1)
+                result = sock.sendBatch(&packets[i*2], 2, std::min(MAXBATCH, max - i));
+            else
+                result = sock.sendSegments(&packets[i*2], 2, std::min(MAXGSO, max - i));
+            calls++;
+
+            //UDP_SEGMENT needs Linux 4.18 or later
+            if(result <= 0)
+            {
+                perror(modeNames[mode]);
+                break;
+            }
+
+            i += result;
+            sent = i;
+        }
+
+        report("client", mode, sent, max, calls, timer.lap(), cpuUsec() - cpuBefore);
+
+        //give the server time to see that this mode is over
+        sleep(PAUSE_SEC);
+    }
+}
+
+/**
+ * Receives the client's packets in each mode, and reports how many arrived,
+ * how fast, and at what CPU cost.
+ */
+void serverOffload( UdpSocket &sock, const int max, int message[] )
+{
+    std::vector<char> buffers(MAXBATCH * MSGSIZE);
+    iovec batch[MAXBATCH];
+    int lengths[MAXBATCH];
+    for(int i = 0; i < MAXBATCH; i++)
+    {
+        batch[i].iov_base = &buffers[i * MSGSIZE];
+        batch[i].iov_len = MSGSIZE;
+    }
+    iovec segments[MAXGSO + 1];
+
+    for(int mode = 0; mode < OFFLOAD_MODES; mode++)
+    {
+        //coalesced buffers would be cut short by a plain recvfrom
+        if(mode == 2 && !sock.setGro(true))
+            return;
+
+        Timer timer;
+        int calls = 0;
+        int received = 0;
+        long cpuBefore = 0;
+        long time = 0;
+
+        //the clock starts with the first packet, and stops at the last one
+        while(received == 0 || sock.pollRecvFrom(IDLE_MSEC) > 0)
+        {
+            int result;
+            if(mode == 0)
+                result = sock.recvFrom((char*)message, MSGSIZE) > 0 ? 1 : -1;
+            else if(mode == 1)
+                result = sock.recvBatch(batch, 1, MAXBATCH, lengths);
+            else
+                result = sock.recvSegments(&buffers[0], buffers.size(), segments, MAXGSO + 1);
+            if(result <= 0)
+                break;
+
+            if(received == 0)
+            {
+                timer.start();
+                cpuBefore = cpuUsec();
+            }
+            calls++;
+            received += result;
+            time = timer.lap();
+        }
+
+        report("server", mode, received, max, calls, time, cpuUsec() - cpuBefore);
+    }
+
+    sock.setGro(false);
+}
+
+/**
+ * CPU time used by the process so far, in microseconds.
+ */
+static long cpuUsec()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000L +
+           usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+static void report(const char* side, int mode, int packets, int max, int calls, long time, long cpu)
+{
+    cout << side << " " << modeNames[mode] << ": packets = " << packets << " of " << max;
+    cout << ", calls = " << calls << ", time = " << time << "usec";
+    if(time > 0)
+        cout << ", packets/sec = " << (long long)packets * 1000000 / time;
+    cout << ", cpu time = " << cpu << "usec";
+    if(packets > 0)
+        cout << ", cpu per packet = " << cpu * 1000 / packets << "ns";
+    cout << endl;
+}
@@ -11,46 +11,75 @@
 
 #include "UdpSocket.h"
 #include "Timer.h"
+#include "RttEstimator.h"
+#include "ReceiveWindow.h"
 #include <iostream>
+#include <vector>
+#include <string>
+#include <cstdint>
 
 
+/*
+ * What the server sends back: the ACK, and the timestamp of the packet that
+ * prompted it, which the client measures its round-trip time with. Packets
+ * carry their sequence number in message[0] and that timestamp in message[1].
+ */
+struct Ack
+{
+    int ack;
+    unsigned int echo;
+};
+
 /**
- * The client stops and waits for an ACK before sending the next packet.
+ * The client stops and waits for an ACK before sending the next packet. It
+ * gives up waiting after a timeout that follows the round-trip time.
  *
  * Returns the number of times it had to resend a packet.
  */
 int clientStopWait( UdpSocket &sock, const int max, int message[] )
 {
-    int retransmits;
+    int retransmits = 0;
     Timer timer;
+    Timer clock;
+    RttEstimator rtt;
+    clock.start();
 
     // transfer message[] max times
     for ( int i = 0; i < max; i++ )
     {
         message[0] = i;
+        message[1] = clock.lap();
         sock.sendTo( ( char * )message, MSGSIZE );
         cerr << "message = " << message[0] << endl;
 
         timer.start();
 
-        //Loop until we get the correct ACK
+        //Loop until we get the correct ACK, sleeping in between
         while(true)
         {
-            if(timer.lap() > 1500)
+            long timeLeft = rtt.timeout() - timer.lap();
+            if(timeLeft <= 0)
             {
+                rtt.backoff();
+                message[1] = clock.lap();
                 sock.sendTo( ( char * )message, MSGSIZE );
                 retransmits++;
                 timer.start();
+                continue;
             }
 
-            //check to see if we got anything form the server
-            if(sock.pollRecvFrom()>0)
+            //wait for anything from the server, or for the timeout
+            if(sock.waitRecvFrom(timeLeft)>0)
             {
-                int ACK;
-                sock.recvFrom( ( char * ) &ACK, sizeof(ACK) );
+                Ack ACK;
+                int length = sock.recvFrom( ( char * ) &ACK, sizeof(ACK) );
+
+                //the echo says which transmission this answers
+                if(length == sizeof(ACK))
+                    rtt.sample(clock.lap() - ACK.echo);
 
                 //if we received the right ACK number, then we are good
-                if(ACK == i)
+                if(length >= (int)sizeof(int) && ACK.ack == i)
                     break;
 
                 //otherwise, we got a dup, and we will ignore it
@@ -58,6 +87,7 @@ int clientStopWait( UdpSocket &sock, const int max, int message[] )
         }
     }
 
+    cerr << "srtt = " << rtt.srtt() << " rttvar = " << rtt.rttvar() << " rto = " << rtt.timeout() << endl;
     return retransmits;
 }
 
@@ -73,7 +103,10 @@ void serverReliable( UdpSocket &sock, const int max, int message[] )
         cerr << message[0] << endl;
 
         //ACK the message no matter what (could be a duplicate due to timeout lost ACK, etc.)
-        sock.ackTo((char*)message, sizeof(int));
+        Ack ack;
+        ack.ack = message[0];
+        ack.echo = message[1];
+        sock.ackTo((char*)&ack, sizeof(ack));
 
         //if this wasn't the right message
         if(i != message[0])
@@ -88,105 +121,163 @@ void serverReliable( UdpSocket &sock, const int max, int message[] )
  * The client will send a set of packets to the server and will send more
  * packets as it receives acknowledgements.
  *
+ * Whatever fits in the window goes out in one sendBatch() call, and all the
+ * ACKs waiting when it checks are read with one recvBatch() call.
+ *
  * Returns the number of times that it retransmitted a packet.
  */
 int clientSlidingWindow( UdpSocket &sock, const int max, int message[], int windowSize )
 {
     int sequence = 0;
-    int highestSequence = -1;
-    int packetsInTransit = 0;
     int lowestUnAckedPacket = 0;
     int retransmits = 0;
     Timer timer;
+    Timer clock;
+    RttEstimator rtt;
+    clock.start();
+
+    //every packet is its sequence number and timestamp followed by the rest
+    //of message[], so a whole window goes out in one call without copying
+    //the payload
+    std::vector<int> headers(windowSize * 2);
+    std::vector<iovec> packets(windowSize * 2);
+
+    //ACKs that have piled up are read in one call as well
+    Ack acks[MAXBATCH];
+    int ackLengths[MAXBATCH];
+    iovec ackBuffers[MAXBATCH];
+    for(int i = 0; i < MAXBATCH; i++)
+    {
+        ackBuffers[i].iov_base = &acks[i];
+        ackBuffers[i].iov_len = sizeof(Ack);
+    }
 
     while(lowestUnAckedPacket < max)
     {
-        //only send more packets if we have packets to send
-        if(sequence < max)
+        //fill whatever room there is in the window with new packets, and
+        //print their numbers in one go too, as cerr isn't buffered
+        int count = 0;
+        std::string trace;
+        int now = clock.lap();
+        while(sequence < max && sequence - lowestUnAckedPacket < windowSize)
         {
-            message[0] = sequence;
-            sock.sendTo( ( char * )message, MSGSIZE );
-            cerr << message[0] << endl;
+            headers[count*2] = sequence;
+            headers[count*2+1] = now;
+            packets[count*2].iov_base = &headers[count*2];
+            packets[count*2].iov_len = 2 * sizeof(int);
+            packets[count*2+1].iov_base = (char*)message + 2 * sizeof(int);
+            packets[count*2+1].iov_len = MSGSIZE - 2 * sizeof(int);
+            trace += std::to_string(sequence) + "\n";
 
-            packetsInTransit++;
-            highestSequence = sequence;
+            count++;
             sequence++;
+        }
 
-            //while the packets in transit is less than the window size, send more.
-            if(packetsInTransit < windowSize)
-                continue;
+        if(count > 0)
+        {
+            sock.sendBatch(packets.data(), 2, count);
+            cerr << trace;
         }
 
         //start the timer after we have gotten to our window size
         timer.start();
 
-        //Loop until we get an ACK
+        //Loop until the window has room again, sleeping in between
         while(true)
         {
-            if(timer.lap() > 1500)
+            long timeLeft = rtt.timeout() - timer.lap();
+            if(timeLeft <= 0)
             {
+                rtt.backoff();
                 message[0] = lowestUnAckedPacket;
+                message[1] = clock.lap();
                 sock.sendTo( (char*)message, MSGSIZE );
                 retransmits++;
                 timer.start();
+                continue;
             }
 
-            //check to see if we got anything form the server
-            if(sock.pollRecvFrom()>0)
+            //wait for anything from the server, or for the timeout
+            if(sock.waitRecvFrom(timeLeft)>0)
             {
-                int ACK;
-                sock.recvFrom((char*) &ACK, sizeof(ACK));
-
-                //figures out the number of packets we didn't get ACK'd
-                packetsInTransit = highestSequence-ACK;
+                int received = sock.recvBatch(ackBuffers, 1, MAXBATCH, ackLengths);
 
                 //The ACK is the highest number we have an acknowledgement for,
-                //so ACK+1 is the lowest packet we haven't gotten one for
-                lowestUnAckedPacket = ACK + 1;
+                //so ACK+1 is the lowest packet we haven't gotten one for. ACKs
+                //can arrive out of order, so only the highest counts.
+                for(int i = 0; i < received; i++)
+                {
+                    if(ackLengths[i] == sizeof(Ack))
+                        rtt.sample(clock.lap() - acks[i].echo);
+                    if(ackLengths[i] >= (int)sizeof(int) && acks[i].ack + 1 > lowestUnAckedPacket)
+                        lowestUnAckedPacket = acks[i].ack + 1;
+                }
 
                 //if we have room to send more packets on the network
-                if(packetsInTransit < windowSize)
+                if(sequence - lowestUnAckedPacket < windowSize)
                     break;
             }
         }
     }
 
+    cerr << "srtt = " << rtt.srtt() << " rttvar = " << rtt.rttvar() << " rto = " << rtt.timeout() << endl;
     return retransmits;
 }
 
 /**
  * The server willacknowledge all packets received with a cumulative ACK to
  * allow the client to send a range of packets and not worry about missing ACKs.
+ * Everything that has arrived is read with one recvBatch() call and covered
+ * by one ACK.
  */
 void serverEarlyRetrans( UdpSocket &sock, const int max, int message[], int windowSize )
 {
-    //max so that we don't go past the array when calculating cumulative ACK
-    int messagesReceived[max];
-    for(int i = 0; i < max; i++)
-        messagesReceived[i] = -1;
+    //only the packets the client can have in flight, however long the transfer
+    ReceiveWindow window(windowSize);
+    unsigned int echo = 0;
 
-    //start at -1 in case we don't receive packet 0
-    int cumulativeACK = -1;
+    //packets are read a batch at a time, as many as have arrived
+    std::vector<char> packets(MAXBATCH * MSGSIZE);
+    iovec buffers[MAXBATCH];
+    int lengths[MAXBATCH];
+    for(int i = 0; i < MAXBATCH; i++)
+    {
+        buffers[i].iov_base = &packets[i * MSGSIZE];
+        buffers[i].iov_len = MSGSIZE;
+    }
 
     //loop until we have all the massages
-    while(cumulativeACK < max-1)
+    while(window.expected() < (uint64_t)max)
     {
-        sock.recvFrom((char*)message, MSGSIZE);
-        cerr << message[0] << endl;
+        int received = sock.recvBatch(buffers, 1, MAXBATCH, lengths);
+        int accepted = 0;
+        std::string trace;
 
-        //mark this message as being recieved
-        messagesReceived[message[0]] = message[0];
-
-        //Calculate the new cumulative ACK
-        for(int i = cumulativeACK+1; i < max; i++)
+        for(int p = 0; p < received; p++)
         {
-            if(messagesReceived[i] == -1)
-                break;
+            uint64_t sequence = window.unwrap(*(uint32_t*)buffers[p].iov_base);
+            trace += std::to_string(sequence) + "\n";
+
+            //mark this message as being recieved, unless it is a stray
+            if(lengths[p] < 2 * (int)sizeof(int) || sequence >= (uint64_t)max)
+                continue;
 
-            cumulativeACK=i;
+            window.add(sequence);
+            echo = ((int*)buffers[p].iov_base)[1];
+            accepted++;
         }
 
-        //send ACK
-        sock.ackTo((char*)&cumulativeACK, sizeof(int));
+        cerr << trace;
+
+        //nothing new to ACK if the whole batch was dropped
+        if(accepted == 0)
+            continue;
+
+        //one ACK covers the whole batch, and echoes its newest timestamp; the
+        //cumulative ACK goes back as the low 32 bits, -1 before packet 0
+        Ack ack;
+        ack.ack = (int)(window.expected() - 1);
+        ack.echo = echo;
+        sock.ackTo((char*)&ack, sizeof(ack));
     }
 }
\ No newline at end of file
@@ -4,54 +4,96 @@
  *
  * Description:
  * udpa.cpp is an alternate version of udp.cpp. It changes serverEarlyRetrans to
- * accept a drop rate parameter so that it can simulate dropping packets.
+ * accept a drop rate parameter so that it can simulate dropping packets, and
+ * adds a selective-repeat version of the sliding window, whose ACKs say which
+ * packets arrived so that only the lost ones are resent, a file transfer on
+ * top of it, and a server for many of its clients at once.
  *
  * It is intended to be part of a series on network programming.
  */
 
 #include "UdpSocket.h"
 #include "Timer.h"
+#include "RttEstimator.h"
+#include "ReceiveWindow.h"
+#include "CongestionControl.h"
 #include <iostream>
+#include <vector>
+#include <string>
 #include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <unordered_map>
+#include <thread>
+#include <atomic>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 
+/*
+ * What the server sends back: the ACK, and the timestamp of the packet that
+ * prompted it, which the client measures its round-trip time with. Packets
+ * carry their sequence number in message[0] and that timestamp in message[1].
+ */
+struct Ack
+{
+    int ack;
+    unsigned int echo;
+};
+
 /**
- * The client stops and waits for an ACK before sending the next packet.
+ * The client stops and waits for an ACK before sending the next packet. It
+ * gives up waiting after a timeout that follows the round-trip time.
  *
  * Returns the number of times it had to resend a packet.
  */
 int clientStopWait( UdpSocket &sock, const int max, int message[] )
 {
-    int retransmits;
+    int retransmits = 0;
     Timer timer;
+    Timer clock;
+    RttEstimator rtt;
+    clock.start();
 
     // transfer message[] max times
     for ( int i = 0; i < max; i++ )
     {
         message[0] = i;
+        message[1] = clock.lap();
         sock.sendTo( ( char * )message, MSGSIZE );
         cerr << "message = " << message[0] << endl;
 
         timer.start();
 
-        //Loop until we get the correct ACK
+        //Loop until we get the correct ACK, sleeping in between
         while(true)
         {
-            if(timer.lap() > 1500)
+            long timeLeft = rtt.timeout() - timer.lap();
+            if(timeLeft <= 0)
             {
+                rtt.backoff();
+                message[1] = clock.lap();
                 sock.sendTo( ( char * )message, MSGSIZE );
                 retransmits++;
                 timer.start();
+                continue;
             }
 
-            //check to see if we got anything form the server
-            if(sock.pollRecvFrom()>0)
+            //wait for anything from the server, or for the timeout
+            if(sock.waitRecvFrom(timeLeft)>0)
             {
-                int ACK;
-                sock.recvFrom( ( char * ) &ACK, sizeof(ACK) );
+                Ack ACK;
+                int length = sock.recvFrom( ( char * ) &ACK, sizeof(ACK) );
+
+                //the echo says which transmission this answers
+                if(length == sizeof(ACK))
+                    rtt.sample(clock.lap() - ACK.echo);
 
                 //if we received the right ACK number, then we are good
-                if(ACK == i)
+                if(length >= (int)sizeof(int) && ACK.ack == i)
                     break;
 
                 //otherwise, we got a dup, and we will ignore it
@@ -59,6 +101,7 @@ int clientStopWait( UdpSocket &sock, const int max, int message[] )
         }
     }
 
+    cerr << "srtt = " << rtt.srtt() << " rttvar = " << rtt.rttvar() << " rto = " << rtt.timeout() << endl;
     return retransmits;
 }
 
@@ -74,7 +117,10 @@ void serverReliable( UdpSocket &sock, const int max, int message[] )
         cerr << message[0] << endl;
 
         //ACK the message no matter what (could be a duplicate due to timeout lost ACK, etc.)
-        sock.ackTo((char*)message, sizeof(int));
+        Ack ack;
+        ack.ack = message[0];
+        ack.echo = message[1];
+        sock.ackTo((char*)&ack, sizeof(ack));
 
         //if this wasn't the right message
         if(i != message[0])
@@ -89,116 +135,969 @@ void serverReliable( UdpSocket &sock, const int max, int message[] )
  * The client will send a set of packets to the server and will send more
  * packets as it receives acknowledgements.
  *
+ * Whatever fits in the window goes out in one sendBatch() call, and all the
+ * ACKs waiting when it checks are read with one recvBatch() call.
+ *
  * Returns the number of times that it retransmitted a packet.
  */
 int clientSlidingWindow( UdpSocket &sock, const int max, int message[], int windowSize )
 {
     int sequence = 0;
-    int highestSequence = -1;
-    int packetsInTransit = 0;
     int lowestUnAckedPacket = 0;
     int retransmits = 0;
     Timer timer;
+    Timer clock;
+    RttEstimator rtt;
+    clock.start();
+
+    //every packet is its sequence number and timestamp followed by the rest
+    //of message[], so a whole window goes out in one call without copying
+    //the payload
+    std::vector<int> headers(windowSize * 2);
+    std::vector<iovec> packets(windowSize * 2);
+
+    //ACKs that have piled up are read in one call as well
+    Ack acks[MAXBATCH];
+    int ackLengths[MAXBATCH];
+    iovec ackBuffers[MAXBATCH];
+    for(int i = 0; i < MAXBATCH; i++)
+    {
+        ackBuffers[i].iov_base = &acks[i];
+        ackBuffers[i].iov_len = sizeof(Ack);
+    }
 
     while(lowestUnAckedPacket < max)
     {
-        //only send more packets if we have packets to send
-        if(sequence < max)
+        //fill whatever room there is in the window with new packets, and
+        //print their numbers in one go too, as cerr isn't buffered
+        int count = 0;
+        std::string trace;
+        int now = clock.lap();
+        while(sequence < max && sequence - lowestUnAckedPacket < windowSize)
         {
-            message[0] = sequence;
-            sock.sendTo( ( char * )message, MSGSIZE );
-            cerr << message[0] << endl;
+            headers[count*2] = sequence;
+            headers[count*2+1] = now;
+            packets[count*2].iov_base = &headers[count*2];
+            packets[count*2].iov_len = 2 * sizeof(int);
+            packets[count*2+1].iov_base = (char*)message + 2 * sizeof(int);
+            packets[count*2+1].iov_len = MSGSIZE - 2 * sizeof(int);
+            trace += std::to_string(sequence) + "\n";
 
-            packetsInTransit++;
-            highestSequence = sequence;
+            count++;
             sequence++;
+        }
 
-            //while the packets in transit is less than the window size, send more.
-            if(packetsInTransit < windowSize)
-                continue;
+        if(count > 0)
+        {
+            sock.sendBatch(packets.data(), 2, count);
+            cerr << trace;
         }
 
         //start the timer after we have gotten to our window size
         timer.start();
 
-        //Loop until we get an ACK
+        //Loop until the window has room again, sleeping in between
         while(true)
         {
-            if(timer.lap() > 1500)
+            long timeLeft = rtt.timeout() - timer.lap();
+            if(timeLeft <= 0)
             {
+                rtt.backoff();
                 message[0] = lowestUnAckedPacket;
+                message[1] = clock.lap();
                 sock.sendTo( (char*)message, MSGSIZE );
                 retransmits++;
                 timer.start();
+                continue;
             }
 
-            //check to see if we got anything form the server
-            if(sock.pollRecvFrom()>0)
+            //wait for anything from the server, or for the timeout
+            if(sock.waitRecvFrom(timeLeft)>0)
             {
-                int ACK;
-                sock.recvFrom((char*) &ACK, sizeof(ACK));
-
-                //figures out the number of packets we didn't get ACK'd
-                packetsInTransit = highestSequence-ACK;
+                int received = sock.recvBatch(ackBuffers, 1, MAXBATCH, ackLengths);
 
                 //The ACK is the highest number we have an acknowledgement for,
-                //so ACK+1 is the lowest packet we haven't gotten one for
-                lowestUnAckedPacket = ACK + 1;
+                //so ACK+1 is the lowest packet we haven't gotten one for. ACKs
+                //can arrive out of order, so only the highest counts.
+                for(int i = 0; i < received; i++)
+                {
+                    if(ackLengths[i] == sizeof(Ack))
+                        rtt.sample(clock.lap() - acks[i].echo);
+                    if(ackLengths[i] >= (int)sizeof(int) && acks[i].ack + 1 > lowestUnAckedPacket)
+                        lowestUnAckedPacket = acks[i].ack + 1;
+                }
 
                 //if we have room to send more packets on the network
-                if(packetsInTransit < windowSize)
+                if(sequence - lowestUnAckedPacket < windowSize)
                     break;
             }
         }
     }
 
+    cerr << "srtt = " << rtt.srtt() << " rttvar = " << rtt.rttvar() << " rto = " << rtt.timeout() << endl;
     return retransmits;
 }
 
 /**
  * The server willacknowledge all packets received with a cumulative ACK to
  * allow the client to send a range of packets and not worry about missing ACKs.
+ * Everything that has arrived is read with one recvBatch() call and covered
+ * by one ACK.
  *
  * This version of the function will drop a percentage of packets it recieves
  * based on the dropRate parameter.
  */
 void serverEarlyRetrans( UdpSocket &sock, const int max, int message[], int windowSize, int dropRate )
 {
-    //max so that we don't go past the array when calculating cumulative ACK
-    int messagesReceived[max];
-    for(int i = 0; i < max; i++)
-        messagesReceived[i] = -1;
+    //only the packets the client can have in flight, however long the transfer
+    ReceiveWindow window(windowSize);
+    unsigned int echo = 0;
 
-    //start at -1 in case we don't receive packet 0
-    int cumulativeACK = -1;
+    //packets are read a batch at a time, as many as have arrived
+    std::vector<char> packets(MAXBATCH * MSGSIZE);
+    iovec buffers[MAXBATCH];
+    int lengths[MAXBATCH];
+    for(int i = 0; i < MAXBATCH; i++)
+    {
+        buffers[i].iov_base = &packets[i * MSGSIZE];
+        buffers[i].iov_len = MSGSIZE;
+    }
 
     //loop until we have all the massages
-    while(cumulativeACK < max-1)
+    while(window.expected() < (uint64_t)max)
     {
-        sock.recvFrom((char*)message, MSGSIZE);
-        cerr << message[0] << endl;
+        int received = sock.recvBatch(buffers, 1, MAXBATCH, lengths);
+        int accepted = 0;
+        std::string trace;
+
+        for(int p = 0; p < received; p++)
+        {
+            uint64_t sequence = window.unwrap(*(uint32_t*)buffers[p].iov_base);
+            trace += std::to_string(sequence) + "\n";
+
+            //drop some percentage of ALL ACK's we receive based on dropRate
+            if(rand()%100 < dropRate)
+            {
+                trace += "Dropping Packet " + std::to_string(sequence) + "\n";
+                continue;
+            }
+
+            //mark this message as being recieved, unless it is a stray
+            if(lengths[p] < 2 * (int)sizeof(int) || sequence >= (uint64_t)max)
+                continue;
+
+            window.add(sequence);
+            echo = ((int*)buffers[p].iov_base)[1];
+            accepted++;
+        }
+
+        cerr << trace;
+
+        //nothing new to ACK if the whole batch was dropped
+        if(accepted == 0)
+            continue;
+
+        //one ACK covers the whole batch, and echoes its newest timestamp; the
+        //cumulative ACK goes back as the low 32 bits, -1 before packet 0
+        Ack ack;
+        ack.ack = (int)(window.expected() - 1);
+        ack.echo = echo;
+        sock.ackTo((char*)&ack, sizeof(ack));
+    }
+
+}
+
+/*
+ * The ACK of the selective-repeat protocol: the cumulative ACK, plus which of
+ * the packets after it have arrived as well.
+ */
+struct SackAck
+{
+    int cumulative;     //every packet up to and including this one has arrived
+    unsigned int echo;  //as in Ack
+    uint64_t sack;      //bit i set: packet cumulative+1+i has arrived too
+};
+
+enum
+{
+    SACK_BITS = 64,
+    DUP_THRESHOLD = 3,  //packets that have to arrive after a hole before it counts as lost
+    TRACE_USEC = 10000, //how often the congestion window is traced
+    WORKER_POLL_USEC = 100000,  //how often an idle worker of serverMultiPeer looks up
+    FLOW_IDLE_USEC = 1000000,   //how long a finished client is remembered
+    LINGER_USEC = 3000000,      //how long serverFileTransfer answers after the last packet
+    CHUNK = MSGSIZE - 2 * sizeof(int)   //file bytes per packet, after the header
+};
+
+/*
+ * Packet 0 of a file transfer: how big the file is, which also says how many
+ * packets follow, and a checksum of it to compare the copy with.
+ */
+struct FileInfo
+{
+    uint64_t size;
+    uint64_t checksum;
+};
+
+/**
+ * Sends packet sequence again, stamped with now.
+ */
+static void resendPacket( UdpSocket &sock, int sequence, int now, const iovec& payload )
+{
+    int header[2] = {sequence, now};
+    iovec packet[2];
+    packet[0].iov_base = header;
+    packet[0].iov_len = sizeof(header);
+    packet[1] = payload;
+    sock.sendBatch(packet, 2, 1);
+}
+
+/**
+ * The client sends a window of packets like clientSlidingWindow, but keeps a
+ * timer for every packet (with the same adaptive timeout) and only ever
+ * resends the ones the server is missing. A packet counts as lost once DUP_THRESHOLD packets sent after it
+ * have been acknowledged (the same signal as TCP's three duplicate ACKs), and
+ * is resent straight away rather than after a timeout.
+ *
+ * With a congestion control, windowSize is only the most it can grow to. The
+ * window and the throughput of every TRACE_USEC are then printed at the end.
+ *
+ * Every packet carries the rest of message[] after its header, unless
+ * payloads[] gives each one its own.
+ *
+ * Returns the number of times that it retransmitted a packet.
+ */
+int clientSelectiveRepeat( UdpSocket &sock, const int max, int message[], int windowSize,
+                           CongestionControl* congestion, const iovec payloads[] )
+{
+    int sequence = 0;
+    int lowestUnAckedPacket = 0;
+    int retransmits = 0;
+    int dupAcks = 0;
+    int recoveryPoint = -1;     //losses up to here belong to the last loss event
+    Timer clock;
+    RttEstimator rtt;
+    clock.start();
+
+    //window and throughput over time
+    long traceStart = 0;
+    int traceAcked = 0;
+    std::string window;
+
+    //per packet in the window, indexed by sequence % windowSize
+    std::vector<bool> acked(windowSize);
+    std::vector<bool> fastRetransmitted(windowSize);
+    std::vector<long> sentAt(windowSize);
+
+    //new packets are sent as in clientSlidingWindow, without copying the payload
+    std::vector<int> headers(windowSize * 2);
+    std::vector<iovec> packets(windowSize * 2);
+    iovec filler;
+    filler.iov_base = (char*)message + 2 * sizeof(int);
+    filler.iov_len = MSGSIZE - 2 * sizeof(int);
+
+    SackAck acks[MAXBATCH];
+    int ackLengths[MAXBATCH];
+    iovec ackBuffers[MAXBATCH];
+    for(int i = 0; i < MAXBATCH; i++)
+    {
+        ackBuffers[i].iov_base = &acks[i];
+        ackBuffers[i].iov_len = sizeof(SackAck);
+    }
+
+    while(lowestUnAckedPacket < max)
+    {
+        long now = clock.lap();
+
+        //the congestion window, if there is one, can only make it smaller
+        int allowed = windowSize;
+        if(congestion != NULL && congestion->window() < allowed)
+            allowed = congestion->window() > 1 ? (int)congestion->window() : 1;
+
+        //fill whatever room there is in the window with new packets
+        int count = 0;
+        std::string trace;
+        while(sequence < max && sequence - lowestUnAckedPacket < allowed)
+        {
+            int slot = sequence % windowSize;
+            acked[slot] = false;
+            fastRetransmitted[slot] = false;
+            sentAt[slot] = now;
+
+            headers[count*2] = sequence;
+            headers[count*2+1] = now;
+            packets[count*2].iov_base = &headers[count*2];
+            packets[count*2].iov_len = 2 * sizeof(int);
+            packets[count*2+1] = payloads != NULL ? payloads[sequence] : filler;
+            trace += std::to_string(sequence) + "\n";
+
+            count++;
+            sequence++;
+        }
+
+        if(count > 0)
+        {
+            sock.sendBatch(packets.data(), 2, count);
+            cerr << trace;
+        }
+
+        //resend only the packets whose own timer ran out, and find out when
+        //the next one will
+        long timeout = rtt.timeout();
+        long nextTimeout = now + timeout;
+        bool timedOut = false;
+        for(int s = lowestUnAckedPacket; s < sequence; s++)
+        {
+            //the oldest packet keeps its timer even if it was SACKed, as the
+            //server only has it for sure once the cumulative ACK says so
+            int slot = s % windowSize;
+            if(acked[slot] && s != lowestUnAckedPacket)
+                continue;
+
+            if(now - sentAt[slot] >= timeout)
+            {
+                resendPacket(sock, s, now, payloads != NULL ? payloads[s] : filler);
+                retransmits++;
+                sentAt[slot] = now;
+                timedOut = true;
+            }
 
-        //drop some percentage of ALL ACK's we receive based on dropRate
-        if(rand()%100 < dropRate)
+            if(sentAt[slot] + timeout < nextTimeout)
+                nextTimeout = sentAt[slot] + timeout;
+        }
+
+        //once per round of timeouts, however many packets it took
+        if(timedOut)
         {
-            cerr << "Dropping Packet " << message[0] << endl;
+            rtt.backoff();
+            if(congestion != NULL)
+                congestion->onTimeout(now);
+            recoveryPoint = sequence - 1;
+        }
+
+        //wait for anything from the server, or for the next timeout
+        if(sock.waitRecvFrom(nextTimeout - clock.lap()) <= 0)
             continue;
+
+        int received = sock.recvBatch(ackBuffers, 1, MAXBATCH, ackLengths);
+        for(int i = 0; i < received; i++)
+        {
+            //nothing can be acknowledged before it was sent; that's left
+            //over from an earlier run
+            SackAck& ack = acks[i];
+            if(ackLengths[i] < (int)sizeof(int) || ack.cumulative >= sequence)
+                continue;
+
+            //a bare cumulative ACK says nothing about the rest
+            long measured = 0;
+            if(ackLengths[i] == sizeof(SackAck))
+            {
+                measured = clock.lap() - ack.echo;
+                rtt.sample(measured);
+            }
+            else
+                ack.sack = 0;
+
+            //a cumulative ACK that moves nothing is a duplicate
+            int newlyAcked = 0;
+            if(ack.cumulative + 1 > lowestUnAckedPacket)
+            {
+                for(int s = lowestUnAckedPacket; s <= ack.cumulative; s++)
+                {
+                    if(!acked[s % windowSize])
+                        newlyAcked++;
+                }
+                lowestUnAckedPacket = ack.cumulative + 1;
+                dupAcks = 0;
+            }
+            else if(ack.cumulative + 1 == lowestUnAckedPacket)
+                dupAcks++;
+            else
+                ack.sack = 0;   //reordered behind a newer ACK, so its SACK is stale too
+
+            //mark what the server already has, and count how many packets
+            //arrived after each hole
+            int highestSacked = -1;
+            for(int bit = 0; bit < SACK_BITS; bit++)
+            {
+                int s = ack.cumulative + 1 + bit;
+                if((ack.sack >> bit & 1) && s >= lowestUnAckedPacket && s < sequence)
+                {
+                    if(!acked[s % windowSize])
+                        newlyAcked++;
+                    acked[s % windowSize] = true;
+                    highestSacked = s;
+                }
+            }
+
+            traceAcked += newlyAcked;
+            if(congestion != NULL && newlyAcked > 0)
+                congestion->onAck(newlyAcked, measured, clock.lap());
+
+            int sackedAbove = 0;
+            int from = highestSacked > lowestUnAckedPacket ? highestSacked : lowestUnAckedPacket;
+            for(int s = from; s >= lowestUnAckedPacket && s < sequence; s--)
+            {
+                int slot = s % windowSize;
+                if(acked[slot])
+                {
+                    sackedAbove++;
+                    continue;
+                }
+
+                //fast retransmit, once per hole; the timer still covers it after
+                bool lost = sackedAbove >= DUP_THRESHOLD ||
+                            (s == lowestUnAckedPacket && dupAcks >= DUP_THRESHOLD);
+                if(lost && !fastRetransmitted[slot])
+                {
+                    resendPacket(sock, s, clock.lap(), payloads != NULL ? payloads[s] : filler);
+                    retransmits++;
+                    fastRetransmitted[slot] = true;
+                    sentAt[slot] = clock.lap();
+
+                    if(congestion != NULL && s > recoveryPoint)
+                        congestion->onLoss(clock.lap());
+                    if(s > recoveryPoint)
+                        recoveryPoint = sequence - 1;
+                }
+            }
         }
 
-        //mark this message as being recieved
-        messagesReceived[message[0]] = message[0];
+        //the window at the end of every TRACE_USEC, and what got through in it
+        long elapsed = clock.lap() - traceStart;
+        if(congestion != NULL && elapsed >= TRACE_USEC)
+        {
+            traceStart += elapsed;
+            window += "  t = " + std::to_string(traceStart / 1000) + "ms, cwnd = " +
+                      std::to_string(congestion->window()) + ", throughput = " +
+                      std::to_string(traceAcked * MSGSIZE * 8.0 / elapsed) + "Mbps\n";
+            traceAcked = 0;
+        }
+    }
+
+    if(congestion != NULL)
+        cout << window;
+
+    cerr << "srtt = " << rtt.srtt() << " rttvar = " << rtt.rttvar() << " rto = " << rtt.timeout() << endl;
+    return retransmits;
+}
 
-        //Calculate the new cumulative ACK
-        for(int i = cumulativeACK+1; i < max; i++)
+/**
+ * The server for clientSelectiveRepeat. It keeps whatever arrives, in any
+ * order, like serverEarlyRetrans, but its ACKs also say which packets after
+ * the cumulative ACK it has, so that only the missing ones are resent.
+ *
+ * Like serverEarlyRetrans, it drops dropRate percent of the packets it
+ * receives.
+ */
+void serverSelectiveRepeat( UdpSocket &sock, const int max, int message[], int windowSize, int dropRate )
+{
+    //only the packets the client can have in flight, however long the transfer
+    ReceiveWindow window(windowSize);
+
+    SackAck ack;
+    ack.cumulative = -1;
+    ack.echo = 0;
+
+    std::vector<char> packets(MAXBATCH * MSGSIZE);
+    iovec buffers[MAXBATCH];
+    int lengths[MAXBATCH];
+    for(int i = 0; i < MAXBATCH; i++)
+    {
+        buffers[i].iov_base = &packets[i * MSGSIZE];
+        buffers[i].iov_len = MSGSIZE;
+    }
+
+    //loop until we have all the massages
+    while(window.expected() < (uint64_t)max)
+    {
+        int received = sock.recvBatch(buffers, 1, MAXBATCH, lengths);
+        int accepted = 0;
+        std::string trace;
+
+        for(int p = 0; p < received; p++)
         {
-            if(messagesReceived[i] == -1)
+            uint64_t sequence = window.unwrap(*(uint32_t*)buffers[p].iov_base);
+            trace += std::to_string(sequence) + "\n";
+
+            //drop some percentage of the packets we receive based on dropRate
+            if(rand()%100 < dropRate)
+            {
+                trace += "Dropping Packet " + std::to_string(sequence) + "\n";
+                continue;
+            }
+
+            if(lengths[p] < 2 * (int)sizeof(int) || sequence >= (uint64_t)max)
+                continue;
+
+            //echo the newest timestamp
+            window.add(sequence);
+            ack.echo = ((int*)buffers[p].iov_base)[1];
+            accepted++;
+        }
+
+        cerr << trace;
+
+        //nothing new to ACK if the whole batch was dropped
+        if(accepted == 0)
+            continue;
+
+        ack.cumulative = (int)(window.expected() - 1);
+        ack.sack = window.sack(SACK_BITS);
+
+        //one ACK covers the whole batch
+        sock.ackTo((char*)&ack, sizeof(ack));
+    }
+}
+
+/**
+ * A Fletcher-64 checksum: two running sums of the file's 32-bit words, so
+ * that it notices bytes in the wrong place as well as wrong bytes.
+ */
+static uint64_t fileChecksum( const char* data, uint64_t size )
+{
+    //the sums are folded every 1024 words, before they can overflow
+    const uint64_t MODULUS = 0xFFFFFFFF;
+    uint64_t sum1 = 0;
+    uint64_t sum2 = 0;
+    uint64_t i = 0;
+
+    while(i < size)
+    {
+        for(int n = 0; n < 1024 && i < size; n++, i += 4)
+        {
+            uint32_t word = 0;
+            memcpy(&word, data + i, size - i < 4 ? size - i : 4);
+            sum1 += word;
+            sum2 += sum1;
+        }
+        sum1 %= MODULUS;
+        sum2 %= MODULUS;
+    }
+
+    return sum2 << 32 | sum1;
+}
+
+/**
+ * Sends a file with the selective-repeat protocol. The file is mapped into
+ * memory and every packet's payload points straight at its CHUNK bytes of it,
+ * so nothing is copied on the way to the kernel. Packet 0 carries a FileInfo
+ * instead, and the server knows from it when the file is over.
+ *
+ * As in clientSelectiveRepeat, a congestion control keeps the window below
+ * windowSize.
+ *
+ * Returns the number of retransmissions, or -1 if the file can't be read.
+ */
+int clientFileTransfer( UdpSocket &sock, const char path[], int message[], int windowSize,
+                        CongestionControl* congestion )
+{
+    int fd = open(path, O_RDONLY);
+    struct stat status;
+    if(fd < 0 || fstat(fd, &status) < 0)
+    {
+        perror(path);
+        return -1;
+    }
+
+    FileInfo info;
+    info.size = status.st_size;
+    char* file = NULL;
+    if(info.size > 0)
+    {
+        file = (char*)mmap(NULL, info.size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(file == MAP_FAILED)
+        {
+            perror(path);
+            close(fd);
+            return -1;
+        }
+        madvise(file, info.size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    //read the file once before the clock starts, so that it is in the page
+    //cache and the checksum isn't part of the time
+    info.checksum = fileChecksum(file, info.size);
+
+    int packets = 1 + (info.size + CHUNK - 1) / CHUNK;
+    std::vector<iovec> payloads(packets);
+    payloads[0].iov_base = &info;
+    payloads[0].iov_len = sizeof(info);
+    for(int s = 1; s < packets; s++)
+    {
+        uint64_t offset = (uint64_t)(s - 1) * CHUNK;
+        payloads[s].iov_base = file + offset;
+        payloads[s].iov_len = info.size - offset < CHUNK ? info.size - offset : CHUNK;
+    }
+
+    Timer timer;
+    timer.start();
+    int retransmits = clientSelectiveRepeat(sock, packets, message, windowSize, congestion, payloads.data());
+    long time = timer.lap();
+
+    cerr << "bytes = ";
+    cout << info.size << " ";
+    cerr << "packets = " << packets << " time = ";
+    cout << time << " ";
+    cerr << "goodput = ";
+    cout << (time > 0 ? info.size * 8.0 / time : 0) << endl;
+    cerr << "Mbps, retransmits = " << retransmits << endl;
+
+    if(file != NULL)
+        munmap(file, info.size);
+    return retransmits;
+}
+
+/**
+ * Receives a file sent by clientFileTransfer into path. As soon as packet 0
+ * says how big it is, path is allocated at that size and mapped, and every
+ * packet's payload is copied straight to its place in it, in whatever order
+ * they come. Packets that come before packet 0 have nowhere to go yet, so
+ * they aren't acknowledged, and the client sends them again.
+ *
+ * Once every packet is in, it keeps resending the last ACK to whatever the
+ * client sends until LINGER_USEC pass without anything, in case it was lost.
+ *
+ * Returns whether the copy's checksum matched the original's.
+ */
+bool serverFileTransfer( UdpSocket &sock, const char path[], int windowSize )
+{
+    ReceiveWindow window(windowSize);
+
+    SackAck ack;
+    ack.cumulative = -1;
+    ack.echo = 0;
+
+    std::vector<char> packets(MAXBATCH * MSGSIZE);
+    iovec buffers[MAXBATCH];
+    int lengths[MAXBATCH];
+    for(int i = 0; i < MAXBATCH; i++)
+    {
+        buffers[i].iov_base = &packets[i * MSGSIZE];
+        buffers[i].iov_len = MSGSIZE;
+    }
+
+    FileInfo info;
+    char* file = NULL;
+    uint64_t total = 0;         //packets, once packet 0 has said
+    Timer timer;
+
+    while(total == 0 || window.expected() < total)
+    {
+        int received = sock.recvBatch(buffers, 1, MAXBATCH, lengths);
+        int accepted = 0;
+
+        for(int p = 0; p < received; p++)
+        {
+            int* header = (int*)buffers[p].iov_base;
+            char* payload = (char*)buffers[p].iov_base + 2 * sizeof(int);
+            int length = lengths[p] - 2 * (int)sizeof(int);
+            uint64_t sequence = window.unwrap(header[0]);
+
+            if(length < 0 || (total == 0 && sequence != 0) || (total != 0 && sequence >= total))
+                continue;
+
+            //a payload that isn't as long as its place in the file is a stray
+            uint64_t offset = sequence == 0 ? 0 : (sequence - 1) * CHUNK;
+            if(sequence == 0 ? length != sizeof(FileInfo) :
+                               (uint64_t)length != (info.size - offset < CHUNK ? info.size - offset : CHUNK))
+                continue;
+
+            ack.echo = header[1];
+            accepted++;
+            if(!window.add(sequence))
+                continue;
+
+            if(sequence != 0)
+            {
+                memcpy(file + offset, payload, length);
+                continue;
+            }
+
+            //the clock starts with packet 0, as the client's does with it
+            memcpy(&info, payload, sizeof(info));
+            total = 1 + (info.size + CHUNK - 1) / CHUNK;
+            timer.start();
+
+            //allocate the blocks now rather than as the pages are first
+            //written, and fall back on a sparse file where that isn't possible
+            int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if(fd < 0 || (posix_fallocate(fd, 0, info.size) != 0 && ftruncate(fd, info.size) < 0))
+            {
+                perror(path);
+                if(fd >= 0)
+                    close(fd);
+                return false;
+            }
+            if(info.size > 0)
+            {
+                file = (char*)mmap(NULL, info.size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+                if(file == MAP_FAILED)
+                {
+                    perror(path);
+                    close(fd);
+                    return false;
+                }
+            }
+            close(fd);
+        }
+
+        //nothing new to ACK if the whole batch was dropped
+        if(accepted == 0)
+            continue;
+
+        ack.cumulative = (int)(window.expected() - 1);
+        ack.sack = window.sack(SACK_BITS);
+        sock.ackTo((char*)&ack, sizeof(ack));
+    }
+
+    long time = timer.lap();
+    uint64_t checksum = fileChecksum(file, info.size);
+    if(file != NULL)
+        munmap(file, info.size);
+
+    cerr << "bytes = ";
+    cout << info.size << " ";
+    cerr << "time = ";
+    cout << time << " ";
+    cerr << "goodput = ";
+    cout << (time > 0 ? info.size * 8.0 / time : 0) << endl;
+    cerr << "Mbps, checksum " << (checksum == info.checksum ? "matches" : "DOES NOT MATCH") << endl;
+
+    //the client only stops once it has the last ACK, so keep answering what
+    //it resends, with the final cumulative ACK, until it has gone quiet for
+    //longer than its longest timeout
+    while(sock.waitRecvFrom(LINGER_USEC) > 0)
+    {
+        int received = sock.recvBatch(buffers, 1, MAXBATCH, lengths);
+        for(int p = 0; p < received; p++)
+        {
+            if(lengths[p] >= 2 * (int)sizeof(int))
+                ack.echo = ((int*)buffers[p].iov_base)[1];
+        }
+        sock.ackTo((char*)&ack, sizeof(ack));
+    }
+
+    return checksum == info.checksum;
+}
+
+/*
+ * What the multi-peer server keeps for each client: the receive window and
+ * ACK of serverSelectiveRepeat, where to send that ACK, and when the client
+ * started and finished.
+ */
+struct Flow
+{
+    ReceiveWindow window;
+    SackAck ack;
+    sockaddr_in peer;
+    long packets;
+    long started;       //usec, on the server's clock
+    long finished;      //0 until every packet has arrived
+    long heard;         //when the last packet came
+    bool touched;       //to be ACKed at the end of this batch
+
+    Flow(int windowSize) : window(windowSize), packets(0), started(0), finished(0), heard(0), touched(false)
+    {
+        ack.cumulative = -1;
+        ack.echo = 0;
+        ack.sack = 0;
+    }
+};
+
+/*
+ * What one worker of the multi-peer server did.
+ */
+struct WorkerStats
+{
+    int flows;
+    long packets;
+    long calls;                     //recvBatch() calls that returned packets
+    std::vector<long> completions;  //usec from a client's first packet to its last
+    long firstStarted;              //-1 until a client comes
+    long lastFinished;
+
+    WorkerStats() : flows(0), packets(0), calls(0), firstStarted(-1), lastFinished(0) {}
+};
+
+/**
+ * One worker of serverMultiPeer: it serves every client the kernel sends to
+ * its socket, each with its own flow, and answers each batch with one ACK
+ * per client that had packets in it. It stops once all the clients are done
+ * and nothing has come for FLOW_IDLE_USEC, so that the last ACKs can still be
+ * resent if they get lost.
+ */
+static void multiPeerWorker( UdpSocket* sock, const int max, int windowSize, int clients,
+                             std::atomic<int>* completed, Timer clock, WorkerStats* stats )
+{
+    std::unordered_map<uint64_t, Flow> flows;
+    std::vector<Flow*> touched;
+
+    std::vector<char> packets(MAXBATCH * MSGSIZE);
+    iovec buffers[MAXBATCH];
+    int lengths[MAXBATCH];
+    sockaddr_in peers[MAXBATCH];
+    for(int i = 0; i < MAXBATCH; i++)
+    {
+        buffers[i].iov_base = &packets[i * MSGSIZE];
+        buffers[i].iov_len = MSGSIZE;
+    }
+
+    long quietSince = clock.lap();
+    while(true)
+    {
+        if(sock->waitRecvFrom(WORKER_POLL_USEC) <= 0)
+        {
+            long now = clock.lap();
+            if(*completed >= clients && now - quietSince >= FLOW_IDLE_USEC)
                 break;
 
-            cumulativeACK=i;
+            //forget the clients that are done and have gone quiet, so that
+            //the table only holds the live ones
+            for(auto flow = flows.begin(); flow != flows.end(); )
+            {
+                if(flow->second.finished != 0 && now - flow->second.heard >= FLOW_IDLE_USEC)
+                    flow = flows.erase(flow);
+                else
+                    ++flow;
+            }
+            continue;
+        }
+
+        int received = sock->recvBatch(buffers, 1, MAXBATCH, lengths, peers);
+        if(received <= 0)
+            continue;
+
+        long now = clock.lap();
+        quietSince = now;
+        stats->calls++;
+        stats->packets += received;
+
+        for(int p = 0; p < received; p++)
+        {
+            if(lengths[p] < 2 * (int)sizeof(int))
+                continue;
+
+            //a client is its address and port
+            uint64_t key = (uint64_t)peers[p].sin_addr.s_addr << 16 | peers[p].sin_port;
+            //a client is counted and timed from its first packet, even a stray one
+            auto found = flows.find(key);
+            if(found == flows.end())
+            {
+                found = flows.emplace(key, Flow(windowSize)).first;
+                found->second.peer = peers[p];
+                found->second.started = now;
+                stats->flows++;
+                if(stats->firstStarted < 0)
+                    stats->firstStarted = now;
+            }
+            Flow& flow = found->second;
+
+            int* header = (int*)buffers[p].iov_base;
+            uint64_t sequence = flow.window.unwrap(header[0]);
+            if(sequence >= (uint64_t)max)
+                continue;
+
+            flow.window.add(sequence);
+            flow.ack.echo = header[1];
+            flow.packets++;
+            flow.heard = now;
+            if(!flow.touched)
+            {
+                flow.touched = true;
+                touched.push_back(&flow);
+            }
         }
 
-        //send ACK
-        sock.ackTo((char*)&cumulativeACK, sizeof(int));
+        //one ACK per client in the batch, however many packets it sent
+        for(size_t i = 0; i < touched.size(); i++)
+        {
+            Flow& flow = *touched[i];
+            flow.touched = false;
+            flow.ack.cumulative = (int)(flow.window.expected() - 1);
+            flow.ack.sack = flow.window.sack(SACK_BITS);
+            sock->ackTo((char*)&flow.ack, sizeof(flow.ack), flow.peer);
+
+            if(flow.finished == 0 && flow.window.expected() >= (uint64_t)max)
+            {
+                flow.finished = now;
+                stats->completions.push_back(now - flow.started);
+                stats->lastFinished = now;
+                (*completed)++;
+            }
+        }
+        touched.clear();
     }
+}
 
-}
\ No newline at end of file
+/**
+ * The server for many clients at once, each running clientSelectiveRepeat.
+ * A single socket can only answer whoever sent last, so instead each client
+ * gets a flow of its own, found by its address, with its own receive window
+ * and ACK. The flows are spread over workers threads, each with its own
+ * socket on the same port (SO_REUSEPORT) and its own flow table. The kernel
+ * sends all of a client's packets to the same socket, so the threads never
+ * share anything.
+ *
+ * sock must have been opened with the port shared; it is the first worker's.
+ * It returns once clients clients have sent all max packets.
+ */
+void serverMultiPeer( UdpSocket &sock, int port, const int max, int windowSize, int clients, int workers )
+{
+    if(workers < 1)
+        workers = 1;
+
+    //the other sockets join before any client starts, as the kernel's choice
+    //of socket changes with the number of them
+    std::vector<UdpSocket*> sockets(1, &sock);
+    for(int i = 1; i < workers; i++)
+        sockets.push_back(new UdpSocket(port, true));
+
+    std::atomic<int> completed(0);
+    std::vector<WorkerStats> stats(workers);
+    std::vector<std::thread> threads;
+    Timer clock;
+    clock.start();
+
+    for(int i = 0; i < workers; i++)
+        threads.push_back(std::thread(multiPeerWorker, sockets[i], max, windowSize, clients,
+                                      &completed, clock, &stats[i]));
+    for(int i = 0; i < workers; i++)
+        threads[i].join();
+    for(int i = 1; i < workers; i++)
+        delete sockets[i];
+
+    //each client is timed from its first packet to its last, and the whole
+    //run from the first client's first to the last client's last
+    std::vector<long> completions;
+    long packets = 0;
+    long start = -1;
+    long end = 0;
+    for(int i = 0; i < workers; i++)
+    {
+        cerr << "worker " << i << ": flows = " << stats[i].flows << " packets = " << stats[i].packets;
+        cerr << " packets per call = " << (stats[i].calls > 0 ? stats[i].packets / stats[i].calls : 0) << endl;
+        completions.insert(completions.end(), stats[i].completions.begin(), stats[i].completions.end());
+        packets += stats[i].packets;
+        if(stats[i].firstStarted >= 0 && (start < 0 || stats[i].firstStarted < start))
+            start = stats[i].firstStarted;
+        if(stats[i].lastFinished > end)
+            end = stats[i].lastFinished;
+    }
+    std::sort(completions.begin(), completions.end());
+
+    long time = start >= 0 ? end - start : 0;
+    cerr << "clients = ";
+    cout << completions.size() << " ";
+    cerr << "packets = ";
+    cout << packets << " ";
+    cerr << "time = ";
+    cout << time << " ";
+    cerr << "goodput = ";
+    cout << (time > 0 ? (double)completions.size() * max * MSGSIZE * 8 / time : 0) << " ";
+    cerr << "Mbps, client time min / median / max = ";
+    if(!completions.empty())
+        cout << completions.front() << " " << completions[completions.size() / 2] << " " << completions.back();
+    cout << endl;
+}